@@ -0,0 +1,162 @@
+#include "datagen.h"
+#include <stdio.h>
+#include <math.h>
+
+/* History starts here (Nov 2023) and moves on 0-29 seconds per line */
+#define DATAGEN_START_TIME 1700000000
+
+static const char *const adjectives[] = {
+    "Red", "Blue", "Green", "Small", "Large", "Smart", "Classic", "Pro", "Mini", "Ultra",
+    "Eco", "Deluxe", "Basic", "Compact", "Wireless", "Heavy"
+};
+static const char *const nouns[] = {
+    "Laptop", "Mouse", "Chair", "Lamp", "Kettle", "Backpack", "Monitor", "Cable", "Desk",
+    "Notebook", "Speaker", "Bottle", "Jacket", "Drill", "Blender", "Camera"
+};
+static const char *const category_words[] = {
+    "Electronics", "Office", "Home", "Kitchen", "Garden", "Sports", "Toys", "Books",
+    "Tools", "Clothing", "Health", "Beauty"
+};
+
+void datagen_defaults(DatagenOptions *opt) {
+    opt->products = 10000;
+    opt->history = 200000;
+    opt->categories = 24;
+    opt->zipf = 1.1;
+    opt->seed = 1;
+}
+
+static FILE *open_output(const char *dir, const char *name, GError **error) {
+    char *path = g_build_filename(dir, name, NULL);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        g_set_error(error, g_quark_from_static_string("datagen"), 1,
+                    "Failed to open %s for writing", path);
+    } else {
+        setvbuf(f, NULL, _IOFBF, 1 << 20);
+    }
+    g_free(path);
+    return f;
+}
+
+static gboolean close_output(FILE *f, const char *name, GError **error) {
+    gboolean ok = !ferror(f);
+    if (fclose(f) != 0) ok = FALSE;
+    if (!ok) {
+        g_set_error(error, g_quark_from_static_string("datagen"), 2, "Failed to write %s", name);
+    }
+    return ok;
+}
+
+/* Cumulative Zipf weights: product of rank k is picked with weight 1/k^s */
+static double *zipf_table(guint n, double s) {
+    double *cdf = g_new(double, n);
+    double sum = 0;
+    for (guint k = 0; k < n; k++) {
+        sum += 1.0 / pow(k + 1, s);
+        cdf[k] = sum;
+    }
+    for (guint k = 0; k < n; k++) cdf[k] /= sum;
+    return cdf;
+}
+
+/* The rank whose cumulative weight first reaches u (binary search) */
+static guint zipf_pick(const double *cdf, guint n, double u) {
+    guint lo = 0, hi = n - 1;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        if (cdf[mid] < u) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void write_money(FILE *f, gint64 cents) {
+    fprintf(f, "%s%" G_GINT64_FORMAT ".%02d", cents < 0 ? "-" : "",
+            ABS(cents) / 100, (int)(ABS(cents) % 100));
+}
+
+/* This function writes both files */
+/* History is made first (it decides every product's final quantity and sold), */
+/* then the products are written with those numbers */
+gboolean datagen_write(const char *dir, const DatagenOptions *opt, GError **error) {
+    if (opt->products == 0) {
+        g_set_error(error, g_quark_from_static_string("datagen"), 3, "Need at least one product");
+        return FALSE;
+    }
+    guint n = opt->products;
+    GRand *rand = g_rand_new_with_seed(opt->seed);
+
+    gint64 *price = g_new(gint64, n);
+    guint *category = g_new(guint, n);
+    int *quantity = g_new(int, n);
+    int *sold = g_new0(int, n);
+    guint *by_rank = g_new(guint, n);  /* Sales rank -> product, shuffled */
+    for (guint i = 0; i < n; i++) {
+        price[i] = g_rand_int_range(rand, 50, 50001);  /* 0.50 to 500.00 */
+        category[i] = (guint)g_rand_int_range(rand, 0, (gint32)MAX(opt->categories, 1));
+        quantity[i] = g_rand_int_range(rand, 0, 1000);
+        by_rank[i] = i;
+    }
+    for (guint i = n - 1; i > 0; i--) {
+        guint j = (guint)g_rand_int_range(rand, 0, (gint32)i + 1);
+        guint t = by_rank[i];
+        by_rank[i] = by_rank[j];
+        by_rank[j] = t;
+    }
+    double *cdf = zipf_table(n, opt->zipf);
+
+    gboolean ok = FALSE;
+    FILE *f = open_output(dir, "history.csv", error);
+    if (f) {
+        gint64 now = DATAGEN_START_TIME;
+        for (guint line = 0; line < opt->history; line++) {
+            now += g_rand_int_range(rand, 0, 30);
+            guint32 pick = g_rand_int_range(rand, 0, 100);
+            /* Sales and restocks go mostly to the popular products, discounts anywhere */
+            guint p = pick < 95 ? by_rank[zipf_pick(cdf, n, g_rand_double(rand))]
+                                : (guint)g_rand_int_range(rand, 0, (gint32)n);
+            int qty = pick < 75 ? g_rand_int_range(rand, 1, 6) : g_rand_int_range(rand, 6, 101);
+            if (pick < 75 && quantity[p] >= qty) {
+                quantity[p] -= qty;
+                sold[p] += qty;
+                fprintf(f, "%" G_GINT64_FORMAT ",SELL,P%07u,%d,", now, p, -qty);
+                write_money(f, price[p] * qty);
+                fputs(",Sold product\n", f);
+            } else if (pick < 95) {
+                /* A sold out product gets restocked instead, like a shop would */
+                if (pick < 75) qty += 10;
+                quantity[p] += qty;
+                fprintf(f, "%" G_GINT64_FORMAT ",UPDATE,P%07u,%d,", now, p, qty);
+                write_money(f, price[p] * qty);
+                fputs(",Updated stock\n", f);
+            } else {
+                fprintf(f, "%" G_GINT64_FORMAT ",DISCOUNT,P%07u,0,", now, p);
+                write_money(f, price[p] * 9 / 10);
+                fputs(",Applied discount\n", f);
+            }
+        }
+        ok = close_output(f, "history.csv", error);
+    }
+
+    if (ok && (f = open_output(dir, "products.csv", error)) != NULL) {
+        for (guint i = 0; i < n; i++) {
+            fprintf(f, "P%07u,%s %s %u,%s %u,", i,
+                    adjectives[i % G_N_ELEMENTS(adjectives)],
+                    nouns[(i / G_N_ELEMENTS(adjectives)) % G_N_ELEMENTS(nouns)], i,
+                    category_words[category[i] % G_N_ELEMENTS(category_words)], category[i]);
+            write_money(f, price[i]);
+            fprintf(f, ",%d,%d\n", quantity[i], sold[i]);
+        }
+        ok = close_output(f, "products.csv", error);
+    }
+
+    g_free(cdf);
+    g_free(by_rank);
+    g_free(sold);
+    g_free(quantity);
+    g_free(category);
+    g_free(price);
+    g_rand_free(rand);
+    return ok;
+}
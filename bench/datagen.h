@@ -0,0 +1,26 @@
+#ifndef DATAGEN_H
+#define DATAGEN_H
+
+#include <glib.h>
+
+/* This file makes made-up products.csv and history.csv files of any size */
+/* The same options and seed always give exactly the same files, so results */
+/* from different builds can be compared. Sales follow a Zipf distribution */
+/* (a few products sell a lot, most sell a little), like real shops. */
+
+typedef struct {
+    guint products;     /* How many products */
+    guint history;      /* How many history lines */
+    guint categories;   /* How many different categories */
+    double zipf;        /* Zipf exponent for which product sells (0 = all the same) */
+    guint32 seed;
+} DatagenOptions;
+
+/* Defaults: 10000 products, 200000 history lines, 24 categories, zipf 1.1, seed 1 */
+void datagen_defaults(DatagenOptions *opt);
+
+/* Write dir/products.csv and dir/history.csv (the folder must exist) */
+/* The sold column of each product matches its SELL lines in history */
+gboolean datagen_write(const char *dir, const DatagenOptions *opt, GError **error);
+
+#endif /* DATAGEN_H */
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include "datagen.h"
+#include "model.h"
+#include "inventory.h"
+#include "storage.h"
+#include "logic.h"
+#include "report.h"
+
+/* stock_bench times the core functions at several data sizes and prints */
+/* the results as JSON, so runs from different versions can be compared: */
+/*   ./stock_bench -o results.json */
+/* Every size gets fresh data from datagen.c in a temporary folder. */
+
+/* How many times the small operations run (so they take a measurable time) */
+#define BENCH_LOOKUPS 1000000
+#define BENCH_SELLS 200000
+#define BENCH_TOTALS 1000000
+/* Lookups and sells cycle through this many pre-made IDs */
+#define BENCH_IDS 4096
+typedef char BenchId[16];
+
+static char *sizes_arg = NULL;
+static gint history_factor = 20;
+static double zipf = 1.1;
+static gint seed = 1;
+static char *output = NULL;
+
+/* Keeps the compiler from dropping calls whose result isn't used */
+static volatile gint64 sink;
+
+typedef struct {
+    GString *json;
+    guint count;  /* Results so far (for the commas) */
+} Results;
+
+static void add_result(Results *res, const char *name, guint products, guint history,
+                       guint64 ops, gint64 usec) {
+    double seconds = (double)usec / G_USEC_PER_SEC;
+    g_string_append_printf(res->json,
+                           "%s\n    {\"name\": \"%s\", \"products\": %u, \"history\": %u, "
+                           "\"ops\": %" G_GUINT64_FORMAT ", \"seconds\": %.6f, "
+                           "\"ns_per_op\": %.1f}",
+                           res->count ? "," : "", name, products, history, ops, seconds,
+                           ops ? (double)usec * 1000.0 / (double)ops : 0.0);
+    res->count++;
+    g_printerr("%-28s %8u products %10u history  %10.1f ns/op\n", name, products, history,
+               ops ? (double)usec * 1000.0 / (double)ops : 0.0);
+}
+
+static char *data_path(const char *dir, const char *name) {
+    return g_build_filename(dir, name, NULL);
+}
+
+/* This function runs every benchmark on one data size */
+static gboolean bench_size(Results *res, guint n_products, GError **error) {
+    DatagenOptions opt;
+    datagen_defaults(&opt);
+    opt.products = n_products;
+    opt.history = n_products * (guint)history_factor;
+    opt.zipf = zipf;
+    opt.seed = (guint32)seed;
+
+    char *dir = g_dir_make_tmp("stock_bench_XXXXXX", error);
+    if (!dir) return FALSE;
+    char *products_csv = data_path(dir, "products.csv");
+    char *history_csv = data_path(dir, "history.csv");
+    char *products_out = data_path(dir, "products_out.csv");
+    char *history_out = data_path(dir, "history_out.csv");
+    gboolean ok = datagen_write(dir, &opt, error);
+    inventory_init(dir);
+
+    gint64 start;
+    if (ok) {
+        start = g_get_monotonic_time();
+        ok = storage_load_products(products_csv, error);
+        add_result(res, "storage_load_products", opt.products, opt.history, products->len,
+                   g_get_monotonic_time() - start);
+    }
+    if (ok) {
+        start = g_get_monotonic_time();
+        ok = storage_load_history(history_csv, error);
+        add_result(res, "storage_load_history", opt.products, opt.history, history->len,
+                   g_get_monotonic_time() - start);
+    }
+
+    if (ok) {
+        /* The same random IDs for every run, a few of them for products that don't exist */
+        GRand *rand = g_rand_new_with_seed((guint32)seed);
+        BenchId *ids = g_new(BenchId, BENCH_IDS);
+        for (guint i = 0; i < BENCH_IDS; i++) {
+            g_snprintf(ids[i], sizeof(ids[i]), "P%07d",
+                       g_rand_int_range(rand, 0, (gint32)(n_products + n_products / 16 + 1)));
+        }
+        g_rand_free(rand);
+
+        start = g_get_monotonic_time();
+        gint64 found = 0;
+        for (guint i = 0; i < BENCH_LOOKUPS; i++) {
+            if (find_product_by_id(ids[i % BENCH_IDS])) found++;
+        }
+        sink = found;
+        add_result(res, "find_product_by_id", opt.products, opt.history, BENCH_LOOKUPS,
+                   g_get_monotonic_time() - start);
+
+        start = g_get_monotonic_time();
+        gint64 value = 0;
+        for (guint i = 0; i < BENCH_TOTALS; i++) value += compute_total_stock_value();
+        sink = value;
+        add_result(res, "compute_total_stock_value", opt.products, opt.history, BENCH_TOTALS,
+                   g_get_monotonic_time() - start);
+
+        /* No journal is open, so this is the in-memory part of a sale */
+        start = g_get_monotonic_time();
+        for (guint i = 0; i < BENCH_SELLS; i++) sell_product(ids[i % BENCH_IDS], 1, NULL, NULL);
+        add_result(res, "sell_product", opt.products, opt.history, BENCH_SELLS,
+                   g_get_monotonic_time() - start);
+        g_free(ids);
+
+        start = g_get_monotonic_time();
+        Report *r = report_new();
+        report_run(r, NULL);
+        add_result(res, "report", opt.products, opt.history, r->history_len,
+                   g_get_monotonic_time() - start);
+        report_free(r);
+
+        start = g_get_monotonic_time();
+        ok = storage_save_products(products_out, error);
+        add_result(res, "storage_save_products", opt.products, opt.history, products->len,
+                   g_get_monotonic_time() - start);
+    }
+    if (ok) {
+        start = g_get_monotonic_time();
+        ok = storage_save_history(history_out, error);
+        add_result(res, "storage_save_history", opt.products, opt.history, history->len,
+                   g_get_monotonic_time() - start);
+    }
+
+    inventory_free();
+    g_remove(products_csv);
+    g_remove(history_csv);
+    g_remove(products_out);
+    g_remove(history_out);
+    g_rmdir(dir);
+    g_free(products_csv);
+    g_free(history_csv);
+    g_free(products_out);
+    g_free(history_out);
+    g_free(dir);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    GOptionEntry entries[] = {
+        { "sizes", 'S', 0, G_OPTION_ARG_STRING, &sizes_arg,
+          "Product counts to run, comma separated (default: 1000,10000,100000)", "LIST" },
+        { "history-factor", 'f', 0, G_OPTION_ARG_INT, &history_factor,
+          "History lines per product (default: 20)", "N" },
+        { "zipf", 'z', 0, G_OPTION_ARG_DOUBLE, &zipf, "How skewed sales are (default: 1.1)",
+          "S" },
+        { "seed", 's', 0, G_OPTION_ARG_INT, &seed, "Random seed (default: 1)", "N" },
+        { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+          "Write the JSON here instead of to stdout", "FILE" },
+        { NULL }
+    };
+    GOptionContext *context = g_option_context_new(NULL);
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_set_summary(context, "Times loading, saving, lookups, sales and the report.");
+
+    GError *err = NULL;
+    if (!g_option_context_parse(context, &argc, &argv, &err)) {
+        g_printerr("stock_bench: %s\n", err->message);
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return 2;
+    }
+    g_option_context_free(context);
+    if (history_factor < 0 || zipf < 0) {
+        g_printerr("stock_bench: --history-factor and --zipf can't be negative\n");
+        return 2;
+    }
+
+    char **sizes = g_strsplit(sizes_arg ? sizes_arg : "1000,10000,100000", ",", -1);
+    Results res = { g_string_new(NULL), 0 };
+    g_string_append_printf(res.json, "{\n  \"version\": 1,\n  \"history_factor\": %d,\n"
+                           "  \"zipf\": %.3f,\n  \"seed\": %d,\n  \"results\": [",
+                           history_factor, zipf, seed);
+
+    int status = 0;
+    for (guint i = 0; sizes[i] && status == 0; i++) {
+        guint64 n;
+        if (!g_ascii_string_to_unsigned(g_strstrip(sizes[i]), 10, 1, G_MAXINT / 32, &n, &err) ||
+            !bench_size(&res, (guint)n, &err)) {
+            g_printerr("stock_bench: %s\n", err->message);
+            g_clear_error(&err);
+            status = 1;
+        }
+    }
+    g_string_append(res.json, "\n  ]\n}\n");
+
+    if (status == 0) {
+        if (output) {
+            if (!g_file_set_contents(output, res.json->str, (gssize)res.json->len, &err)) {
+                g_printerr("stock_bench: %s\n", err->message);
+                g_clear_error(&err);
+                status = 1;
+            }
+        } else {
+            fputs(res.json->str, stdout);
+        }
+    }
+
+    g_string_free(res.json, TRUE);
+    g_strfreev(sizes);
+    g_free(sizes_arg);
+    g_free(output);
+    return status;
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include "datagen.h"
+
+/* stock_gen writes a made-up data folder for trying the app at a big size: */
+/*   ./stock_gen -p 100000 -H 5000000 -o big_data && ./stock_manager ... */
+/* The same options always give the same files (see datagen.h) */
+
+int main(int argc, char **argv) {
+    DatagenOptions opt;
+    datagen_defaults(&opt);
+    char *out_dir = NULL;
+    gint products = (gint)opt.products, history = (gint)opt.history;
+    gint categories = (gint)opt.categories, seed = (gint)opt.seed;
+
+    GOptionEntry entries[] = {
+        { "output", 'o', 0, G_OPTION_ARG_FILENAME, &out_dir,
+          "Folder to write products.csv and history.csv to (default: bench_data)", "DIR" },
+        { "products", 'p', 0, G_OPTION_ARG_INT, &products, "Number of products (default: 10000)",
+          "N" },
+        { "history", 'H', 0, G_OPTION_ARG_INT, &history,
+          "Number of history lines (default: 200000)", "N" },
+        { "categories", 'c', 0, G_OPTION_ARG_INT, &categories,
+          "Number of categories (default: 24)", "N" },
+        { "zipf", 'z', 0, G_OPTION_ARG_DOUBLE, &opt.zipf,
+          "How skewed sales are, 0 = even (default: 1.1)", "S" },
+        { "seed", 's', 0, G_OPTION_ARG_INT, &seed, "Random seed (default: 1)", "N" },
+        { NULL }
+    };
+    GOptionContext *context = g_option_context_new(NULL);
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_set_summary(context, "Writes made-up products.csv and history.csv files.");
+
+    GError *err = NULL;
+    if (!g_option_context_parse(context, &argc, &argv, &err)) {
+        g_printerr("stock_gen: %s\n", err->message);
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return 2;
+    }
+    g_option_context_free(context);
+    if (products < 1 || history < 0 || categories < 1 || opt.zipf < 0) {
+        g_printerr("stock_gen: sizes must be positive\n");
+        return 2;
+    }
+    opt.products = (guint)products;
+    opt.history = (guint)history;
+    opt.categories = (guint)categories;
+    opt.seed = (guint32)seed;
+    if (!out_dir) out_dir = g_strdup("bench_data");
+
+    int status = 0;
+    g_mkdir_with_parents(out_dir, 0755);
+    if (datagen_write(out_dir, &opt, &err)) {
+        printf("Wrote %u products and %u history lines to %s\n", opt.products, opt.history,
+               out_dir);
+    } else {
+        g_printerr("stock_gen: %s\n", err->message);
+        g_clear_error(&err);
+        status = 1;
+    }
+    g_free(out_dir);
+    return status;
+}
@@ -0,0 +1,116 @@
+#include "autosave.h"
+#include "logic.h"
+#include "storage.h"
+#include "trace.h"
+#include <glib/gstdio.h>
+
+static char *autosave_path = NULL;    /* data_dir/products.csv */
+static char *delta_path = NULL;       /* data_dir/products.delta */
+static guint autosave_timer = 0;
+static GThread *save_thread = NULL;   /* The last save started (joined on the next tick) */
+static gint save_running = 0;         /* 1 until save_thread is done writing */
+static gint saved_changes = 0;        /* logic_change_count() of what's on disk */
+static gboolean merge_pending = FALSE;  /* The last merge failed - only touched by save_thread */
+
+guint autosave_interval_from_env(void) {
+    const char *env = g_getenv("STOCK_AUTOSAVE_INTERVAL_MS");
+    if (env && *env) return (guint)g_ascii_strtoull(env, NULL, 10);
+    return AUTOSAVE_DEFAULT_INTERVAL_MS;
+}
+
+static gint64 file_size(const char *path) {
+    GStatBuf st;
+    return g_stat(path, &st) == 0 ? (gint64)st.st_size : 0;
+}
+
+/* Merge: write every product to products.csv and start a new delta */
+static void merge_products(void) {
+    guint n, changes;
+    Product *copy = logic_copy_products(&n, &changes, TRUE);
+    GPtrArray *list = g_ptr_array_sized_new(n);
+    for (guint i = 0; i < n; i++) g_ptr_array_add(list, &copy[i]);
+
+    GError *err = NULL;
+    merge_pending = TRUE;
+    if (!storage_save_product_list(autosave_path, list, &err)) {
+        /* The delta still has everything, and the next tick tries again */
+        g_warning("Autosave failed: %s", err->message);
+        g_clear_error(&err);
+    } else if (g_remove(delta_path) != 0 && g_file_test(delta_path, G_FILE_TEST_EXISTS)) {
+        /* Checkpoints can't go on top of the old delta - merge again next time */
+        g_warning("Autosave couldn't remove %s", delta_path);
+    } else {
+        merge_pending = FALSE;
+        g_atomic_int_set(&saved_changes, (gint)changes);
+    }
+    g_ptr_array_free(list, TRUE);
+    g_free(copy);
+}
+
+/* Checkpoint: append only the products that changed to products.delta */
+static void checkpoint_products(void) {
+    guint changes;
+    GArray *rows = logic_take_changes(&changes);
+    GError *err = NULL;
+    if (storage_append_product_delta(delta_path, autosave_path, rows, &err)) {
+        g_atomic_int_set(&saved_changes, (gint)changes);
+    } else {
+        /* Not saved - they go in the next checkpoint */
+        g_warning("Autosave failed: %s", err->message);
+        g_clear_error(&err);
+        logic_requeue_changes(rows);
+    }
+    g_array_unref(rows);
+}
+
+/* Worker thread: write the changes without holding any locks */
+static gpointer save_products_thread(gpointer data) {
+    trace_set_thread_name("autosave");
+    TRACE_BEGIN("autosave");
+    /* A product changed many times has a row per checkpoint, so once the */
+    /* delta is a good part of the base it's cheaper to fold it in */
+    gint64 limit = MAX(AUTOSAVE_MERGE_MIN_BYTES, file_size(autosave_path) / 4);
+    if (merge_pending || file_size(delta_path) > limit) {
+        merge_products();
+    } else {
+        checkpoint_products();
+    }
+    TRACE_END("autosave");
+    g_atomic_int_set(&save_running, 0);
+    return NULL;
+}
+
+static gboolean on_autosave_tick(gpointer user_data) {
+    if (save_thread) {
+        if (g_atomic_int_get(&save_running)) return G_SOURCE_CONTINUE;  /* Disk is slow */
+        g_thread_join(save_thread);
+        save_thread = NULL;
+    }
+    if (logic_change_count() == (guint)g_atomic_int_get(&saved_changes)) {
+        return G_SOURCE_CONTINUE;  /* Nothing changed since the last save */
+    }
+    g_atomic_int_set(&save_running, 1);
+    save_thread = g_thread_new("autosave", save_products_thread, NULL);
+    return G_SOURCE_CONTINUE;
+}
+
+void autosave_start(const char *data_dir, guint interval_ms) {
+    if (interval_ms == 0 || autosave_timer) return;
+    autosave_path = g_build_filename(data_dir, "products.csv", NULL);
+    delta_path = g_build_filename(data_dir, "products.delta", NULL);
+    g_atomic_int_set(&saved_changes, (gint)logic_change_count());
+    autosave_timer = g_timeout_add(interval_ms, on_autosave_tick, NULL);
+}
+
+void autosave_stop(void) {
+    if (autosave_timer) {
+        g_source_remove(autosave_timer);
+        autosave_timer = 0;
+    }
+    if (save_thread) {
+        g_thread_join(save_thread);
+        save_thread = NULL;
+    }
+    g_clear_pointer(&autosave_path, g_free);
+    g_clear_pointer(&delta_path, g_free);
+}
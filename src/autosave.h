@@ -0,0 +1,38 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include <glib.h>
+
+/* This file saves the products every few seconds while the app (or the */
+/* server) runs, so a crash loses at most one interval of changes instead */
+/* of the whole session. History doesn't need it - the journal already */
+/* writes every entry to history.csv as it happens. */
+/* */
+/* A timer on the main loop checks logic_change_count(). Only if something */
+/* changed does it start a worker thread. Usually that thread appends just */
+/* the changed products to products.delta (logic_take_changes), so a */
+/* checkpoint costs as much as there were changes, not as much as there are */
+/* products. Once the delta gets big the thread merges instead: it copies */
+/* every product (logic_copy_products), writes products.csv with storage.c's */
+/* temp file + fsync + rename and deletes the delta. Loading applies the */
+/* delta on top of products.csv. The main thread never waits for the disk. */
+
+/* Merge once products.delta is bigger than this, or than a quarter of */
+/* products.csv if that's bigger */
+#define AUTOSAVE_MERGE_MIN_BYTES (256 * 1024)
+
+/* How often, unless STOCK_AUTOSAVE_INTERVAL_MS says otherwise (0 = never) */
+#define AUTOSAVE_DEFAULT_INTERVAL_MS 30000
+
+/* The interval from STOCK_AUTOSAVE_INTERVAL_MS, or the default */
+guint autosave_interval_from_env(void);
+
+/* Start autosaving data_dir/products.csv and products.delta (needs a running main loop) */
+/* Call it after loading - what's loaded counts as already saved */
+void autosave_start(const char *data_dir, guint interval_ms);
+
+/* Stop the timer and wait for a save that's still running */
+/* Call it before the final save, so the two don't write at the same time */
+void autosave_stop(void);
+
+#endif /* AUTOSAVE_H */
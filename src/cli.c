@@ -0,0 +1,719 @@
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include "model.h"
+#include "inventory.h"
+#include "logic.h"
+#include "storage.h"
+#include "report.h"
+#include "history.h"
+#include "csv.h"
+#include "server.h"
+#include "metrics.h"
+#include "trace.h"
+#include "autosave.h"
+
+/* This is the command line tool - it works on the same data files as the */
+/* app, but without GTK, so scripts can run big batches quickly. */
+/* Batch commands read one operation per line (CSV) from a file or stdin, */
+/* and everything is saved once at the end. */
+
+/* Where the data files are (-d changes it) */
+static char *data_dir = NULL;
+
+/* How often the server fsyncs history.csv, like the app does */
+#define SERVE_FSYNC_INTERVAL_MS 1000
+
+/* stress: how many products, and how many operations each thread does */
+/* The churn products are also removed and added again while the others sell */
+#define STRESS_PRODUCTS 64
+#define STRESS_CHURN_PRODUCTS 16
+#define STRESS_ALL_PRODUCTS (STRESS_PRODUCTS + STRESS_CHURN_PRODUCTS)
+#define STRESS_TXN_LINES 3
+#define STRESS_OPS_PER_THREAD 200000
+#define STRESS_START_QUANTITY 1000
+
+/* bench-txn: products to pick from and items per basket */
+#define BENCH_PRODUCTS 1000
+#define BENCH_BASKET 5
+
+/* One batch operation - fields is one CSV record of the input */
+typedef gboolean (*BatchFunc)(CsvField *fields, guint n, GError **error);
+
+typedef struct {
+    const char *name;
+    BatchFunc batch;               /* Batch commands: the operation for one record */
+    int (*run)(const char *arg);   /* The other commands: the whole command */
+    const char *help;
+} CliCommand;
+
+/* Input errors use their own domain, like logic errors use "logic" */
+static void set_input_error(GError **error, const char *msg) {
+    g_set_error(error, g_quark_from_static_string("cli"), 1, "%s", msg);
+}
+
+/* import: id,name,category,price,quantity (products.csv lines work too - */
+/* the sold column is ignored, a new product starts at 0 sold) */
+static gboolean import_record(CsvField *fields, guint n, GError **error) {
+    Money price;
+    int qty;
+    if (n < 5) {
+        set_input_error(error, "Expected id,name,category,price,quantity");
+        return FALSE;
+    }
+    if (!money_parse(fields[3].str, (gssize)fields[3].len, &price)) {
+        set_input_error(error, "Price must be a number with at most 2 decimals");
+        return FALSE;
+    }
+    if (!csv_field_to_int(&fields[4], &qty)) {
+        set_input_error(error, "Quantity must be a whole number");
+        return FALSE;
+    }
+    return add_product(fields[0].str, fields[1].str, fields[2].str, price, qty, error);
+}
+
+/* sell and restock: id,quantity */
+static gboolean parse_id_qty(CsvField *fields, guint n, int *qty, GError **error) {
+    if (n != 2 || !csv_field_to_int(&fields[1], qty)) {
+        set_input_error(error, "Expected id,quantity");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean sell_record(CsvField *fields, guint n, GError **error) {
+    int qty;
+    Money total;
+    return parse_id_qty(fields, n, &qty, error) &&
+           sell_product(fields[0].str, qty, &total, error);
+}
+
+static gboolean restock_record(CsvField *fields, guint n, GError **error) {
+    int qty;
+    return parse_id_qty(fields, n, &qty, error) &&
+           update_stock(fields[0].str, qty, error);
+}
+
+static int cmd_report(const char *arg);
+static int cmd_export(const char *arg);
+static int cmd_serve(const char *arg);
+static int cmd_stress(const char *arg);
+static int cmd_bench_txn(const char *arg);
+
+static const CliCommand commands[] = {
+    { "import",  import_record,  NULL,
+      "import [FILE]   add products (id,name,category,price,quantity)" },
+    { "sell",    sell_record,    NULL, "sell [FILE]     sell products (id,quantity)" },
+    { "restock", restock_record, NULL, "restock [FILE]  add stock (id,quantity - more than 5)" },
+    { "report",  NULL, cmd_report,     "report          print the stock report" },
+    { "export",  NULL, cmd_export,     "export FILE     write all products to FILE as CSV" },
+    { "serve",   NULL, cmd_serve,
+      "serve [SOCKET]  take requests from checkout stations (default DIR/stock.sock)" },
+    { "stress",  NULL, cmd_stress,
+      "stress [N]      check the locking with N threads (default 8) - uses no files" },
+    { "bench-txn", NULL, cmd_bench_txn,
+      "bench-txn [N]   time N baskets (default 200000) as sells vs. transactions" }
+};
+
+/* Load everything - history too, so the history snapshot stays in step */
+static gboolean load_data(void) {
+    GError *err = NULL;
+    inventory_init(data_dir);
+    if (!inventory_load_products(data_dir, &err) || !inventory_load_history(data_dir, &err)) {
+        g_printerr("stock_cli: %s\n", err->message);
+        g_clear_error(&err);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* This function saves the batch: the new history entries go to history.csv */
+/* in one write + fsync, then products.csv and the snapshots are rewritten */
+static gboolean commit(guint first_new_entry) {
+    GError *err = NULL;
+    /* There's no main loop here, so the journal's timer never fires - */
+    /* closing it (in inventory_save) does the only fsync */
+    if (!inventory_open_journal(data_dir, 1000, &err)) {
+        g_printerr("stock_cli: %s\n", err->message);
+        g_clear_error(&err);
+        return FALSE;
+    }
+    for (guint i = first_new_entry; i < history->len; i++) {
+        storage_journal_append(history_index(history, i));
+    }
+    if (!inventory_save(data_dir, &err)) {
+        g_printerr("stock_cli: %s\n", err->message);
+        g_clear_error(&err);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* This function runs one batch command over every record of the input */
+/* A bad record is reported and skipped, the rest still go through */
+static int run_batch(const CliCommand *cmd, const char *input) {
+    CsvReader *r;
+    if (!input || strcmp(input, "-") == 0) {
+        r = csv_reader_open_file(stdin);
+    } else {
+        GError *err = NULL;
+        r = csv_reader_open(input, 0, &err);
+        if (!r) {
+            g_printerr("stock_cli: %s\n", err->message);
+            g_clear_error(&err);
+            return 1;
+        }
+    }
+
+    if (!load_data()) {
+        csv_reader_close(r);
+        return 1;
+    }
+    guint first_new_entry = history->len;
+
+    CsvField *fields;
+    guint n;
+    guint64 record = 0, done = 0, failed = 0;
+    while (csv_reader_next(r, &fields, &n)) {
+        GError *err = NULL;
+        record++;
+        if (cmd->batch(fields, n, &err)) {
+            done++;
+        } else {
+            g_printerr("%s: record %" G_GUINT64_FORMAT ": %s\n", cmd->name, record,
+                       err->message);
+            g_clear_error(&err);
+            failed++;
+        }
+    }
+    guint64 malformed = csv_reader_malformed(r);
+    csv_reader_close(r);
+
+    int status = failed > 0 || malformed > 0 ? 1 : 0;
+    if (done > 0 && !commit(first_new_entry)) status = 1;
+    g_printerr("%s: %" G_GUINT64_FORMAT " done, %" G_GUINT64_FORMAT " failed, %"
+               G_GUINT64_FORMAT " malformed\n", cmd->name, done, failed, malformed);
+    inventory_free();
+    return status;
+}
+
+static void print_time(const char *label, gint64 timestamp) {
+    char buf[32];
+    time_t when = (time_t)timestamp;
+    struct tm *tm_info = localtime(&when);
+    if (!tm_info || strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", tm_info) == 0) {
+        g_strlcpy(buf, "?", sizeof(buf));
+    }
+    printf("%s%s\n", label, buf);
+}
+
+/* report: same numbers as the report window in the app */
+static int cmd_report(const char *arg) {
+    if (!load_data()) return 1;
+
+    Report *r = report_new();
+    report_run(r, NULL);
+    char money_buf[MONEY_BUF_SIZE];
+
+    printf("Total products: %u\n", r->total_products);
+    printf("Total stock value: %s\n", money_format(r->stock_value, money_buf, sizeof(money_buf)));
+    printf("Total stock sold: %" G_GINT64_FORMAT "\n", r->total_sold);
+    if (r->n_top > 0) {
+        printf("Most active product: %s (sold %d)\n", r->top[0].name, r->top[0].sold);
+        printf("Best sellers:\n");
+        for (guint i = 0; i < r->n_top; i++) {
+            printf("  %u. %s (%s) - sold %d\n", i + 1, r->top[i].name, r->top[i].id,
+                   r->top[i].sold);
+        }
+    } else {
+        printf("Most active product: N/A\n");
+    }
+
+    if (r->ops->len > 0) {
+        printf("History: %u entries\n", r->history_len);
+        print_time("  from ", r->first_time);
+        print_time("  to   ", r->last_time);
+        for (guint i = 0; i < r->ops->len; i++) {
+            ReportOp *op = &g_array_index(r->ops, ReportOp, i);
+            printf("  %s: %" G_GUINT64_FORMAT " entries, quantity %+" G_GINT64_FORMAT
+                   ", value %s\n", history_string(op->op), op->entries, op->quantity,
+                   money_format(op->value, money_buf, sizeof(money_buf)));
+        }
+    }
+
+    if (r->categories->len > 0) {
+        printf("By category:\n");
+        for (guint i = 0; i < r->categories->len; i++) {
+            ReportCategory *c = &g_array_index(r->categories, ReportCategory, i);
+            printf("  %s: %u products, %" G_GINT64_FORMAT " in stock, value %s, "
+                   "sold %" G_GINT64_FORMAT ", %u low on stock\n",
+                   c->name[0] ? c->name : "(no category)", c->products, c->quantity,
+                   money_format(c->stock_value, money_buf, sizeof(money_buf)),
+                   c->sold, c->low_stock);
+        }
+    }
+
+    report_free(r);
+    inventory_free();
+    return 0;
+}
+
+/* export: products only, in the products.csv format */
+static int cmd_export(const char *arg) {
+    if (!arg) {
+        g_printerr("stock_cli: export needs a file name\n");
+        return 2;
+    }
+    if (!load_data()) return 1;
+
+    GError *err = NULL;
+    int status = 0;
+    if (!storage_save_products(arg, &err)) {
+        g_printerr("stock_cli: %s\n", err->message);
+        g_clear_error(&err);
+        status = 1;
+    }
+    inventory_free();
+    return status;
+}
+
+/* serve: run the socket server (server.h) until Ctrl+C, then save */
+/* History goes to the journal as requests come in, products are saved at the end */
+/* The operation timings go to DIR/metrics.txt on SIGUSR1 and at the end */
+/* Products are also autosaved while it runs, like in the app */
+static int cmd_serve(const char *arg) {
+    if (!load_data()) return 1;
+
+    GError *err = NULL;
+    int status = 0;
+    char *socket_path = arg ? g_strdup(arg) : g_build_filename(data_dir, "stock.sock", NULL);
+    char *metrics_path = g_build_filename(data_dir, METRICS_FILE, NULL);
+    if (inventory_open_journal(data_dir, SERVE_FSYNC_INTERVAL_MS, &err)) {
+        autosave_start(data_dir, autosave_interval_from_env());
+        if (!server_run(socket_path, metrics_path, &err)) status = 1;
+        autosave_stop();
+    } else {
+        status = 1;
+    }
+    if (status != 0) {
+        g_printerr("stock_cli: %s\n", err->message);
+        g_clear_error(&err);
+    }
+    if (!inventory_save(data_dir, &err)) {
+        g_printerr("stock_cli: %s\n", err->message);
+        g_clear_error(&err);
+        status = 1;
+    }
+    if (!metrics_dump(metrics_path, &err)) {
+        g_printerr("stock_cli: %s\n", err->message);
+        g_clear_error(&err);
+    }
+    g_free(metrics_path);
+    g_free(socket_path);
+    inventory_free();
+    return status;
+}
+
+/* What one stress thread did - only the operations that went through */
+typedef struct {
+    guint seed;
+    guint64 sells, sold_units;
+    guint64 restocks, restocked_units;
+    guint64 txns;  /* Each one is STRESS_TXN_LINES sells/restocks (counted above too) */
+    guint64 adds, removes;
+    guint64 lookups;
+    guint64 bad_lookups;  /* Numbers that can't be right (like negative stock) */
+} StressWorker;
+
+/* 0 .. STRESS_PRODUCTS - 1 are always there, the rest are the churn products */
+static void stress_id(char *buf, gsize size, guint i) {
+    if (i < STRESS_PRODUCTS) g_snprintf(buf, size, "STRESS%03u", i);
+    else g_snprintf(buf, size, "CHURN%03u", i - STRESS_PRODUCTS);
+}
+
+static gboolean stress_add(const char *id, guint i) {
+    const char *category = i < STRESS_PRODUCTS ? (i % 2 ? "Odd" : "Even") : "Churn";
+    return add_product(id, id, category, 100 + i, STRESS_START_QUANTITY, NULL);
+}
+
+/* One random basket of sells and restocks - counted only if it went through */
+static void stress_txn(StressWorker *w, GRand *rand) {
+    char ids[STRESS_TXN_LINES][32];
+    TxnLine lines[STRESS_TXN_LINES];
+    for (guint i = 0; i < STRESS_TXN_LINES; i++) {
+        stress_id(ids[i], sizeof(ids[i]), (guint)g_rand_int_range(rand, 0, STRESS_ALL_PRODUCTS));
+        lines[i].id = ids[i];
+        if (g_rand_boolean(rand)) {
+            lines[i].op = HISTORY_OP_SELL;
+            lines[i].qty = g_rand_int_range(rand, 1, 6);
+        } else {
+            lines[i].op = HISTORY_OP_UPDATE;
+            lines[i].qty = g_rand_int_range(rand, 6, 21);
+        }
+    }
+    if (!run_transaction(lines, STRESS_TXN_LINES, NULL, NULL, NULL)) return;
+    w->txns++;
+    for (guint i = 0; i < STRESS_TXN_LINES; i++) {
+        if (lines[i].op == HISTORY_OP_SELL) {
+            w->sells++;
+            w->sold_units += (guint64)lines[i].qty;
+        } else {
+            w->restocks++;
+            w->restocked_units += (guint64)lines[i].qty;
+        }
+    }
+}
+
+/* This function is one stress thread: random sells, restocks, transactions, */
+/* adds and removes of the churn products, and lookups */
+static gpointer stress_run(gpointer data) {
+    StressWorker *w = data;
+    GRand *rand = g_rand_new_with_seed(w->seed);
+    char id[32];
+    for (guint i = 0; i < STRESS_OPS_PER_THREAD; i++) {
+        guint n = (guint)g_rand_int_range(rand, 0, STRESS_ALL_PRODUCTS);
+        stress_id(id, sizeof(id), n);
+        guint32 pick = g_rand_int_range(rand, 0, 100);
+        if (pick < 40) {
+            int qty = g_rand_int_range(rand, 1, 6);
+            /* Running out of stock is fine - it just doesn't count */
+            if (sell_product(id, qty, NULL, NULL)) {
+                w->sells++;
+                w->sold_units += (guint64)qty;
+            }
+        } else if (pick < 52) {
+            int qty = g_rand_int_range(rand, 6, 21);
+            if (update_stock(id, qty, NULL)) {
+                w->restocks++;
+                w->restocked_units += (guint64)qty;
+            }
+        } else if (pick < 57) {
+            stress_txn(w, rand);
+        } else if (pick < 60) {
+            /* Only the churn products come and go (it fails if it's already */
+            /* there / already gone, that's fine) */
+            if (n < STRESS_PRODUCTS) continue;
+            if (pick < 58) {
+                if (remove_product(id, NULL)) w->removes++;
+            } else {
+                if (stress_add(id, n)) w->adds++;
+            }
+        } else {
+            Product copy;
+            Product *top[5];
+            w->lookups++;
+            /* Lookups only ask for products that are always there */
+            stress_id(id, sizeof(id), n % STRESS_PRODUCTS);
+            if (pick < 80) {
+                if (get_stock_level(id, NULL, NULL) < 0) w->bad_lookups++;
+            } else if (pick < 95) {
+                if (!lookup_product(id, &copy, NULL) || copy.quantity < 0 ||
+                    copy.sold < 0) {
+                    w->bad_lookups++;
+                }
+            } else {
+                if (compute_total_stock_value() < 0 || compute_total_sold() < 0 ||
+                    get_best_sellers(top, G_N_ELEMENTS(top)) == 0) {
+                    w->bad_lookups++;
+                }
+            }
+        }
+    }
+    g_rand_free(rand);
+    return NULL;
+}
+
+/* stress: many threads change the same few products at once, then we check */
+/* that the products, the running totals and history all still add up */
+/* Everything stays in memory - nothing is loaded or saved */
+static int cmd_stress(const char *arg) {
+    guint n_threads = 8;
+    if (arg) {
+        guint64 n;
+        if (!g_ascii_string_to_unsigned(arg, 10, 1, 1024, &n, NULL)) {
+            g_printerr("stock_cli: stress needs a thread count from 1 to 1024\n");
+            return 2;
+        }
+        n_threads = (guint)n;
+    }
+
+    inventory_init(data_dir);
+    char id[32];
+    for (guint i = 0; i < STRESS_ALL_PRODUCTS; i++) {
+        stress_id(id, sizeof(id), i);
+        stress_add(id, i);
+    }
+
+    StressWorker *workers = g_new0(StressWorker, n_threads);
+    GThread **threads = g_new(GThread *, n_threads);
+    gint64 start = g_get_monotonic_time();
+    for (guint i = 0; i < n_threads; i++) {
+        workers[i].seed = i + 1;
+        threads[i] = g_thread_new("stress", stress_run, &workers[i]);
+    }
+    for (guint i = 0; i < n_threads; i++) g_thread_join(threads[i]);
+    double seconds = (double)(g_get_monotonic_time() - start) / G_USEC_PER_SEC;
+
+    guint64 sells = 0, sold_units = 0, restocks = 0, restocked_units = 0, lookups = 0;
+    guint64 txns = 0, adds = 0, removes = 0, bad_lookups = 0;
+    for (guint i = 0; i < n_threads; i++) {
+        sells += workers[i].sells;
+        sold_units += workers[i].sold_units;
+        restocks += workers[i].restocks;
+        restocked_units += workers[i].restocked_units;
+        txns += workers[i].txns;
+        adds += workers[i].adds;
+        removes += workers[i].removes;
+        lookups += workers[i].lookups;
+        bad_lookups += workers[i].bad_lookups;
+    }
+    printf("%u threads: %" G_GUINT64_FORMAT " sells, %" G_GUINT64_FORMAT " restocks (%"
+           G_GUINT64_FORMAT " transactions), %" G_GUINT64_FORMAT " adds, %" G_GUINT64_FORMAT
+           " removes, %" G_GUINT64_FORMAT " lookups in %.2f s\n", n_threads, sells, restocks,
+           txns, adds, removes, lookups, seconds);
+
+    gboolean ok = TRUE;
+    if (bad_lookups > 0) {
+        printf("FAIL: %" G_GUINT64_FORMAT " lookups saw impossible numbers\n", bad_lookups);
+        ok = FALSE;
+    }
+    if (!verify_aggregates()) {
+        printf("FAIL: running totals don't match the products\n");
+        ok = FALSE;
+    }
+    guint64 expected = STRESS_ALL_PRODUCTS + adds + removes + sells + restocks;
+    if (history->len != expected) {
+        printf("FAIL: %u history entries, expected %" G_GUINT64_FORMAT "\n", history->len,
+               expected);
+        ok = FALSE;
+    }
+
+    /* Replay history per product - it has to end up at the same numbers */
+    /* (an add starts the product over, a remove means it has to be gone) */
+    gint64 replay_qty[STRESS_ALL_PRODUCTS] = { 0 }, replay_sold[STRESS_ALL_PRODUCTS] = { 0 };
+    gboolean replay_there[STRESS_ALL_PRODUCTS] = { FALSE };
+    char ids[STRESS_ALL_PRODUCTS][32];
+    GHashTable *slot_of = g_hash_table_new(g_str_hash, g_str_equal);  /* ID -> index + 1 */
+    for (guint i = 0; i < STRESS_ALL_PRODUCTS; i++) {
+        stress_id(ids[i], sizeof(ids[i]), i);
+        g_hash_table_insert(slot_of, ids[i], GUINT_TO_POINTER(i + 1));
+    }
+    /* And each transaction's entries have to sit together, all of them */
+    GHashTable *txns_seen = g_hash_table_new(NULL, NULL);
+    guint32 txn = 0;
+    guint txn_len = 0;
+    gboolean txn_split = FALSE;
+    gint64 history_sold = 0, history_restocked = 0;
+    for (guint j = 0; j < history->len; j++) {
+        HistoryEntry *h = history_index(history, j);
+        if (h->txn != txn) {
+            if (txn && txn_len != STRESS_TXN_LINES) txn_split = TRUE;
+            if (h->txn && !g_hash_table_add(txns_seen, GUINT_TO_POINTER(h->txn))) txn_split = TRUE;
+            txn = h->txn;
+            txn_len = 0;
+        }
+        if (txn) txn_len++;
+
+        guint slot = GPOINTER_TO_UINT(g_hash_table_lookup(slot_of, history_product_id(h)));
+        if (slot == 0) continue;
+        switch (h->op) {
+        case HISTORY_OP_ADD:
+            replay_qty[slot - 1] = h->quantity_change;
+            replay_sold[slot - 1] = 0;
+            replay_there[slot - 1] = TRUE;
+            break;
+        case HISTORY_OP_REMOVE:
+            replay_there[slot - 1] = FALSE;
+            break;
+        case HISTORY_OP_SELL:
+            replay_qty[slot - 1] += h->quantity_change;
+            replay_sold[slot - 1] -= h->quantity_change;
+            history_sold -= h->quantity_change;
+            break;
+        default:
+            replay_qty[slot - 1] += h->quantity_change;
+            history_restocked += h->quantity_change;
+            break;
+        }
+    }
+    if (txn && txn_len != STRESS_TXN_LINES) txn_split = TRUE;
+    if (txn_split || g_hash_table_size(txns_seen) != txns) {
+        printf("FAIL: transactions are split up or missing in history\n");
+        ok = FALSE;
+    }
+    g_hash_table_destroy(txns_seen);
+    g_hash_table_destroy(slot_of);
+
+    gint64 sold = 0;
+    for (guint i = 0; i < STRESS_ALL_PRODUCTS; i++) {
+        Product p;
+        gboolean there = lookup_product(ids[i], &p, NULL);
+        if (there != replay_there[i]) {
+            printf("FAIL: %s is %s, history says it %s\n", ids[i], there ? "there" : "gone",
+                   replay_there[i] ? "isn't removed" : "was removed");
+            ok = FALSE;
+        } else if (there && (replay_qty[i] != p.quantity || replay_sold[i] != p.sold)) {
+            printf("FAIL: %s has %d in stock and %d sold, history says %" G_GINT64_FORMAT
+                   " and %" G_GINT64_FORMAT "\n", p.id, p.quantity, p.sold, replay_qty[i],
+                   replay_sold[i]);
+            ok = FALSE;
+        }
+        if (there) sold += p.sold;
+    }
+    if (history_sold != (gint64)sold_units || history_restocked != (gint64)restocked_units ||
+        compute_total_sold() != sold) {
+        printf("FAIL: units in stock or sold don't match what the threads did\n");
+        ok = FALSE;
+    }
+    printf("%s\n", ok ? "OK" : "FAILED");
+
+    g_free(threads);
+    g_free(workers);
+    inventory_free();
+    return ok ? 0 : 1;
+}
+
+/* This function sells n_baskets random baskets, either one sell_product per */
+/* item or one run_transaction per basket - returns baskets per second */
+static double bench_baskets(guint n_baskets, gboolean as_txn) {
+    GRand *rand = g_rand_new_with_seed(42);  /* Same baskets both times */
+    char ids[BENCH_BASKET][32];
+    TxnLine lines[BENCH_BASKET];
+    guint64 failed = 0;
+
+    gint64 start = g_get_monotonic_time();
+    for (guint b = 0; b < n_baskets; b++) {
+        for (guint i = 0; i < BENCH_BASKET; i++) {
+            g_snprintf(ids[i], sizeof(ids[i]), "BENCH%04d",
+                       g_rand_int_range(rand, 0, BENCH_PRODUCTS));
+            lines[i].id = ids[i];
+            lines[i].op = HISTORY_OP_SELL;
+            lines[i].qty = g_rand_int_range(rand, 1, 4);
+        }
+        if (as_txn) {
+            if (!run_transaction(lines, BENCH_BASKET, NULL, NULL, NULL)) failed++;
+        } else {
+            for (guint i = 0; i < BENCH_BASKET; i++) {
+                if (!sell_product(lines[i].id, lines[i].qty, NULL, NULL)) failed++;
+            }
+        }
+    }
+    double seconds = (double)(g_get_monotonic_time() - start) / G_USEC_PER_SEC;
+    g_rand_free(rand);
+    if (failed > 0) g_printerr("bench-txn: %" G_GUINT64_FORMAT " failed\n", failed);
+    return seconds > 0 ? n_baskets / seconds : 0.0;
+}
+
+/* bench-txn: the same baskets sold item by item and as transactions */
+/* History goes to a journal in a temporary folder, so the CSV writing counts too */
+static int cmd_bench_txn(const char *arg) {
+    guint n_baskets = 200000;
+    if (arg) {
+        guint64 n;
+        if (!g_ascii_string_to_unsigned(arg, 10, 1, G_MAXUINT, &n, NULL)) {
+            g_printerr("stock_cli: bench-txn needs a number of baskets\n");
+            return 2;
+        }
+        n_baskets = (guint)n;
+    }
+
+    GError *err = NULL;
+    char *dir = g_dir_make_tmp("stock_bench_XXXXXX", &err);
+    if (!dir) {
+        g_printerr("stock_cli: %s\n", err->message);
+        g_clear_error(&err);
+        return 1;
+    }
+    inventory_init(dir);
+    char id[32];
+    for (guint i = 0; i < BENCH_PRODUCTS; i++) {
+        g_snprintf(id, sizeof(id), "BENCH%04u", i);
+        add_product(id, id, "Bench", 100, G_MAXINT / 2, NULL);
+    }
+
+    int status = 0;
+    char *journal = g_build_filename(dir, "history.csv", NULL);
+    if (inventory_open_journal(dir, 1000, &err)) {
+        double single = bench_baskets(n_baskets, FALSE);
+        double txn = bench_baskets(n_baskets, TRUE);
+        printf("%u baskets of %d items\n", n_baskets, BENCH_BASKET);
+        printf("  sell_product per item: %.0f baskets/s\n", single);
+        printf("  run_transaction:       %.0f baskets/s (%.2fx)\n", txn,
+               single > 0 ? txn / single : 0.0);
+        storage_journal_close();
+    } else {
+        g_printerr("stock_cli: %s\n", err->message);
+        g_clear_error(&err);
+        status = 1;
+    }
+
+    inventory_free();
+    g_remove(journal);
+    g_rmdir(dir);
+    g_free(journal);
+    g_free(dir);
+    return status;
+}
+
+int main(int argc, char **argv) {
+    char *trace_file = NULL;
+    GOptionEntry entries[] = {
+        { "data-dir", 'd', 0, G_OPTION_ARG_FILENAME, &data_dir,
+          "Folder with products.csv and history.csv (default: data)", "DIR" },
+        { "trace", 't', 0, G_OPTION_ARG_FILENAME, &trace_file,
+          "Write a Chrome trace of the run to FILE (or set STOCK_TRACE)", "FILE" },
+        { NULL }
+    };
+    GString *summary = g_string_new("Commands:");
+    for (guint i = 0; i < G_N_ELEMENTS(commands); i++) {
+        g_string_append_printf(summary, "\n  %s", commands[i].help);
+    }
+    g_string_append(summary, "\n\nFILE is a CSV file, or stdin if it's missing or \"-\".");
+
+    GOptionContext *context = g_option_context_new("COMMAND [FILE]");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_set_summary(context, summary->str);
+    g_string_free(summary, TRUE);
+
+    GError *err = NULL;
+    if (!g_option_context_parse(context, &argc, &argv, &err)) {
+        g_printerr("stock_cli: %s\n", err->message);
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return 2;
+    }
+    if (argc < 2 || argc > 3) {
+        char *help = g_option_context_get_help(context, TRUE, NULL);
+        g_printerr("%s", help);
+        g_free(help);
+        g_option_context_free(context);
+        return 2;
+    }
+    g_option_context_free(context);
+    if (!data_dir) data_dir = g_strdup("data");
+    if (trace_file) trace_start(trace_file);
+    else trace_start_from_env();
+
+    const char *arg = argc > 2 ? argv[2] : NULL;
+    int status = 2;
+    gboolean found = FALSE;
+    for (guint i = 0; i < G_N_ELEMENTS(commands); i++) {
+        if (strcmp(argv[1], commands[i].name) != 0) continue;
+        found = TRUE;
+        if (commands[i].batch) {
+            status = run_batch(&commands[i], arg);
+        } else {
+            status = commands[i].run(arg);
+        }
+        break;
+    }
+    if (!found) g_printerr("stock_cli: unknown command '%s'\n", argv[1]);
+
+    if (!trace_stop(&err)) {
+        g_printerr("stock_cli: %s\n", err->message);
+        g_clear_error(&err);
+    }
+    g_free(trace_file);
+    g_free(data_dir);
+    return status;
+}
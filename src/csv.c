@@ -0,0 +1,302 @@
+#include "csv.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* How much we read from the file at a time */
+/* A single record can't be longer than this - longer ones count as malformed */
+#define CSV_BLOCK_SIZE (1024 * 1024)
+
+struct CsvReader {
+    FILE *file;
+    char *buf;          /* CSV_BLOCK_SIZE + 1 bytes, so there's always room for a last NUL */
+    gsize pos;          /* Where the next record starts */
+    gsize len;          /* How many bytes of buf are filled */
+    gboolean eof;       /* Nothing more to read from the file */
+    GArray *fields;     /* CsvField for the current record */
+    guint64 malformed;  /* Broken records we skipped */
+};
+
+/* Find the first a or b between p and end, or NULL */
+/* With SSE2 (every x86-64 CPU) this checks 16 bytes per step */
+static char *scan_for2(char *p, const char *end, char a, char b) {
+#ifdef __SSE2__
+    __m128i va = _mm_set1_epi8(a);
+    __m128i vb = _mm_set1_epi8(b);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va),
+                                                  _mm_cmpeq_epi8(v, vb)));
+        if (mask) {
+            return p + g_bit_nth_lsf((gulong)mask, -1);
+        }
+        p += 16;
+    }
+#endif
+    for (; p < end; p++) {
+        if (*p == a || *p == b) return p;
+    }
+    return NULL;
+}
+
+/* Find the '\n' that ends the record starting at p */
+/* A newline inside quotes doesn't count, so we have to track the quotes. Like */
+/* RFC 4180, a quote only opens a quoted field at the start of a field - one in */
+/* the middle (12" screen) is just a normal character */
+static char *find_record_end(char *p, const char *end) {
+    char *record_start = p;
+    char *after_close = NULL;  /* Right after the last closing quote ("" reopens) */
+    while (p < end) {
+        char *q = scan_for2(p, end, '\n', '"');
+        if (!q) return NULL;
+        if (*q == '\n') return q;
+        if (q == record_start || q[-1] == ',' || q == after_close) {
+            /* Opening quote - jump to the closing one */
+            char *close = memchr(q + 1, '"', end - (q + 1));
+            if (!close) return NULL;
+            p = after_close = close + 1;
+        } else {
+            p = q + 1;
+        }
+    }
+    return NULL;
+}
+
+/* Move the unread bytes to the front of the buffer and read more after them */
+static void fill_buffer(CsvReader *r) {
+    if (r->pos > 0) {
+        memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+        r->len -= r->pos;
+        r->pos = 0;
+    }
+    size_t n = fread(r->buf + r->len, 1, CSV_BLOCK_SIZE - r->len, r->file);
+    r->len += n;
+    if (n == 0) r->eof = TRUE;
+}
+
+/* Throw away everything up to the next raw newline (for records that are too long) */
+static void skip_line(CsvReader *r) {
+    for (;;) {
+        char *nl = memchr(r->buf + r->pos, '\n', r->len - r->pos);
+        if (nl) {
+            r->pos = (gsize)(nl - r->buf) + 1;
+            return;
+        }
+        r->pos = r->len;
+        if (r->eof) return;
+        fill_buffer(r);
+    }
+}
+
+/* Split buf[start..end) into fields, in place */
+/* Each field gets a NUL written after it; quoted fields are unescaped over themselves */
+static gboolean split_record(CsvReader *r, gsize start, gsize end) {
+    char *p = r->buf + start;
+    char *stop = r->buf + end;
+    gboolean more = TRUE;
+
+    g_array_set_size(r->fields, 0);
+    while (more) {
+        CsvField f;
+        if (p < stop && *p == '"') {
+            /* Quoted field - copy it down over the opening quote, "" becomes " */
+            char *out = p;
+            f.str = p;
+            p++;
+            for (;;) {
+                char *q = memchr(p, '"', stop - p);
+                if (!q) return FALSE;  /* The quote never closes */
+                memmove(out, p, q - p);
+                out += q - p;
+                p = q + 1;
+                if (p < stop && *p == '"') {
+                    *out++ = '"';  /* Escaped quote */
+                    p++;
+                } else {
+                    break;  /* Closing quote */
+                }
+            }
+            more = p < stop;
+            if (more && *p != ',') return FALSE;  /* Junk after the closing quote */
+            f.len = (gsize)(out - f.str);
+            *out = '\0';
+            p++;
+        } else {
+            char *q = memchr(p, ',', stop - p);
+            more = q != NULL;
+            if (!q) q = stop;
+            f.str = p;
+            f.len = (gsize)(q - p);
+            *q = '\0';
+            p = q + 1;
+        }
+        g_array_append_val(r->fields, f);
+    }
+    return TRUE;
+}
+
+/* This function opens a CSV file for reading */
+CsvReader *csv_reader_open(const char *path, gint64 offset, GError **error) {
+    FILE *f = g_fopen(path, "rb");
+    if (!f) {
+        int saved = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved),
+                    "Failed to open %s: %s", path, g_strerror(saved));
+        return NULL;
+    }
+    if (offset > 0) {
+#ifdef G_OS_WIN32
+        int rc = _fseeki64(f, offset, SEEK_SET);  /* Files can be bigger than 2 GB */
+#else
+        int rc = fseeko(f, (off_t)offset, SEEK_SET);
+#endif
+        if (rc != 0) {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                        "Failed to seek in %s", path);
+            fclose(f);
+            return NULL;
+        }
+    }
+    return csv_reader_open_file(f);
+}
+
+CsvReader *csv_reader_open_file(FILE *f) {
+    setvbuf(f, NULL, _IONBF, 0);  /* We read big blocks ourselves */
+
+    CsvReader *r = g_new0(CsvReader, 1);
+    r->file = f;
+    r->buf = g_malloc(CSV_BLOCK_SIZE + 1);
+    r->fields = g_array_sized_new(FALSE, FALSE, sizeof(CsvField), 8);
+    return r;
+}
+
+/* This function gets the next record */
+gboolean csv_reader_next(CsvReader *r, CsvField **fields, guint *n_fields) {
+    for (;;) {
+        gsize start = r->pos;
+        gsize end, next;
+        char *nl = find_record_end(r->buf + r->pos, r->buf + r->len);
+        if (nl) {
+            end = (gsize)(nl - r->buf);
+            next = end + 1;
+        } else if (!r->eof) {
+            if (r->len - r->pos >= CSV_BLOCK_SIZE) {
+                /* The whole buffer is one record and it's still not over */
+                skip_line(r);
+                r->malformed++;
+            } else {
+                fill_buffer(r);
+            }
+            continue;
+        } else if (r->pos < r->len) {
+            end = r->len;  /* Last line without a '\n' */
+            next = r->len;
+        } else {
+            return FALSE;  /* All done */
+        }
+
+        r->pos = next;
+        if (end > start && r->buf[end - 1] == '\r') end--;  /* Windows line ending */
+        if (end == start) continue;  /* Empty line */
+
+        if (!split_record(r, start, end)) {
+            r->malformed++;
+            continue;
+        }
+        *fields = (CsvField *)(void *)r->fields->data;
+        *n_fields = r->fields->len;
+        return TRUE;
+    }
+}
+
+void csv_reader_reject(CsvReader *r) {
+    r->malformed++;
+}
+
+guint64 csv_reader_malformed(CsvReader *r) {
+    return r->malformed;
+}
+
+void csv_reader_close(CsvReader *r) {
+    if (!r) return;
+    fclose(r->file);
+    g_free(r->buf);
+    g_array_free(r->fields, TRUE);
+    g_free(r);
+}
+
+/* Skip spaces at both ends of a field */
+static void trim_field(const CsvField *f, const char **p, const char **end) {
+    *p = f->str;
+    *end = f->str + f->len;
+    while (*p < *end && g_ascii_isspace(**p)) (*p)++;
+    while (*end > *p && g_ascii_isspace((*end)[-1])) (*end)--;
+}
+
+/* This function reads a whole number out of a field, digit by digit */
+gboolean csv_field_to_int64(const CsvField *f, gint64 *out) {
+    const char *p, *end;
+    trim_field(f, &p, &end);
+
+    gboolean negative = FALSE;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+    if (p == end) return FALSE;  /* No digits at all */
+
+    guint64 value = 0;
+    for (; p < end; p++) {
+        if (!g_ascii_isdigit(*p)) return FALSE;
+        guint digit = (guint)(*p - '0');
+        if (value > (G_MAXUINT64 - digit) / 10) return FALSE;  /* Too big */
+        value = value * 10 + digit;
+    }
+    if (negative) {
+        if (value > (guint64)G_MAXINT64 + 1) return FALSE;
+        *out = (gint64)(0 - value);
+    } else {
+        if (value > (guint64)G_MAXINT64) return FALSE;
+        *out = (gint64)value;
+    }
+    return TRUE;
+}
+
+gboolean csv_field_to_int(const CsvField *f, int *out) {
+    gint64 v;
+    if (!csv_field_to_int64(f, &v) || v < G_MININT || v > G_MAXINT) return FALSE;
+    *out = (int)v;
+    return TRUE;
+}
+
+/* The field is already NUL-terminated in the buffer, so strtod can read it in place */
+gboolean csv_field_to_double(const CsvField *f, double *out) {
+    const char *p, *end;
+    trim_field(f, &p, &end);
+    if (p == end) return FALSE;
+
+    char *parsed_end = NULL;
+    double v = g_ascii_strtod(p, &parsed_end);  /* Always uses '.', whatever the locale */
+    if (parsed_end != end) return FALSE;
+    *out = v;
+    return TRUE;
+}
+
+/* This function writes one field, quoting it if it has a comma, quote or newline */
+void csv_append_field(GString *out, const char *s) {
+    if (s[strcspn(s, ",\"\r\n")] == '\0') {
+        g_string_append(out, s);  /* Nothing special - write it as is */
+        return;
+    }
+    g_string_append_c(out, '"');
+    for (; *s; s++) {
+        if (*s == '"') g_string_append_c(out, '"');  /* " becomes "" */
+        g_string_append_c(out, *s);
+    }
+    g_string_append_c(out, '"');
+}
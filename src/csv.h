@@ -0,0 +1,51 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include <glib.h>
+#include <stdio.h>
+
+/* This file has a fast CSV reader that both loaders in storage.c use */
+/* It reads the file in big blocks and splits records right inside the block, */
+/* so there are no per-line copies. Quoting follows RFC 4180: a field can be */
+/* put in double quotes and then contain commas, newlines and "" for a quote. */
+
+/* One field of the current record */
+/* str points into the reader's buffer and is NUL-terminated, so it can be */
+/* used as a normal C string - but only until the next csv_reader_next call */
+typedef struct {
+    char *str;
+    gsize len;
+} CsvField;
+
+typedef struct CsvReader CsvReader;
+
+/* Open a CSV file and start reading at byte offset */
+/* On failure returns NULL and sets error (G_FILE_ERROR_NOENT if the file is missing) */
+CsvReader *csv_reader_open(const char *path, gint64 offset, GError **error);
+
+/* Read from an already open file, like stdin (csv_reader_close closes it) */
+CsvReader *csv_reader_open_file(FILE *f);
+
+/* Read the next record - returns FALSE at the end of the file */
+/* Empty lines are skipped; broken lines (like a quote that never closes, or a */
+/* line longer than the block size) are skipped and counted as malformed */
+gboolean csv_reader_next(CsvReader *r, CsvField **fields, guint *n_fields);
+
+/* The caller didn't like the record it just got (wrong field count, bad number) */
+void csv_reader_reject(CsvReader *r);
+
+/* How many malformed records were skipped so far */
+guint64 csv_reader_malformed(CsvReader *r);
+
+void csv_reader_close(CsvReader *r);
+
+/* Parse numbers straight out of a field - no copies, and the whole field must be */
+/* a number (spaces around it are OK). Returns FALSE for anything else */
+gboolean csv_field_to_int64(const CsvField *f, gint64 *out);
+gboolean csv_field_to_int(const CsvField *f, int *out);
+gboolean csv_field_to_double(const CsvField *f, double *out);
+
+/* Append s to out as one CSV field, adding quotes only when it needs them */
+void csv_append_field(GString *out, const char *s);
+
+#endif /* CSV_H */
@@ -0,0 +1,108 @@
+#include "history.h"
+
+/* The table starts with these, so the built-in operations always get the */
+/* same numbers (the HistoryOp values). Index 0 is the empty string */
+static const char *const builtin_strings[HISTORY_N_OPS] = {
+    "", "ADD", "UPDATE", "SELL", "REMOVE", "DISCOUNT"
+};
+
+static GStringChunk *string_data = NULL;  /* The text itself, packed together */
+static GPtrArray *strings = NULL;         /* Number -> text */
+static GHashTable *string_lookup = NULL;  /* Text -> number (stored as number + 1) */
+
+/* Make the table on first use */
+static void ensure_table(void) {
+    if (strings) return;
+    string_data = g_string_chunk_new(64 * 1024);
+    strings = g_ptr_array_new();
+    string_lookup = g_hash_table_new(g_str_hash, g_str_equal);
+    for (guint i = 0; i < HISTORY_N_OPS; i++) {
+        history_intern(builtin_strings[i]);
+    }
+}
+
+/* This function looks the text up and adds it if it's new */
+guint32 history_intern(const char *s) {
+    ensure_table();
+    gpointer found = g_hash_table_lookup(string_lookup, s);
+    if (found) return GPOINTER_TO_UINT(found) - 1;
+
+    char *copy = g_string_chunk_insert(string_data, s);
+    guint32 index = strings->len;
+    g_ptr_array_add(strings, copy);
+    g_hash_table_insert(string_lookup, copy, GUINT_TO_POINTER(index + 1));
+    return index;
+}
+
+const char *history_string(guint32 index) {
+    ensure_table();
+    if (index >= strings->len) return "";  /* Only a broken snapshot could get us here */
+    return g_ptr_array_index(strings, index);
+}
+
+const char *history_op_name(const HistoryEntry *h) {
+    return history_string(h->op);
+}
+
+const char *history_product_id(const HistoryEntry *h) {
+    return history_string(h->product);
+}
+
+const char *history_description(const HistoryEntry *h) {
+    return history_string(h->description);
+}
+
+guint history_strings_count(void) {
+    ensure_table();
+    return strings->len;
+}
+
+/* The text stays in the string chunk until history_strings_free - it's only */
+/* used for a bad snapshot at startup, so that little bit of waste is fine */
+void history_strings_truncate(guint count) {
+    ensure_table();
+    if (count < HISTORY_N_OPS) count = HISTORY_N_OPS;  /* Never drop the built-ins */
+    for (guint i = count; i < strings->len; i++) {
+        g_hash_table_remove(string_lookup, g_ptr_array_index(strings, i));
+    }
+    if (count < strings->len) g_ptr_array_set_size(strings, (gint)count);
+}
+
+void history_strings_free(void) {
+    if (!strings) return;
+    g_hash_table_destroy(string_lookup);
+    g_ptr_array_free(strings, TRUE);
+    g_string_chunk_free(string_data);
+    string_lookup = NULL;
+    strings = NULL;
+    string_data = NULL;
+}
+
+/* The list is about 512 KB of block pointers, but calloc'ed memory isn't */
+/* really there until it's touched, so only the blocks in use cost anything */
+HistoryList *history_list_new(void) {
+    return g_new0(HistoryList, 1);
+}
+
+/* This function adds one entry at the end, making a new block when the last one is full */
+/* The entry is stored before len goes up, so a reader never sees an empty slot */
+void history_list_append(HistoryList *list, HistoryEntry *h) {
+    guint block = list->len >> HISTORY_BLOCK_BITS;
+    if (!list->blocks[block]) list->blocks[block] = g_new(HistoryEntry *, HISTORY_BLOCK_SIZE);
+    list->blocks[block][list->len & (HISTORY_BLOCK_SIZE - 1)] = h;
+    list->len++;
+}
+
+/* The blocks are kept for the entries that come next. Only used for a bad */
+/* snapshot at startup, before anyone else can be reading the list */
+void history_list_truncate(HistoryList *list, guint len) {
+    if (len < list->len) list->len = len;
+}
+
+void history_list_free(HistoryList *list) {
+    if (!list) return;
+    for (guint i = 0; i < HISTORY_MAX_BLOCKS && list->blocks[i]; i++) {
+        g_free(list->blocks[i]);
+    }
+    g_free(list);
+}
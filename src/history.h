@@ -0,0 +1,40 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "model.h"
+
+/* This file keeps the text that history entries refer to */
+/* A HistoryEntry doesn't hold any strings itself - operation, product ID and */
+/* description are numbers into one table where each different text is stored */
+/* once. There are only a handful of operations and descriptions and a few */
+/* thousand product IDs, so millions of entries share very little text. */
+/* Like the pools, the table has no lock of its own: new texts are only added */
+/* by the loaders and under logic.c's history lock. */
+
+/* Get the number for a text, adding it to the table the first time */
+guint32 history_intern(const char *s);
+
+/* The text for a number ("" for numbers that aren't in the table) */
+const char *history_string(guint32 index);
+
+/* Shortcuts for the three texts of an entry */
+const char *history_op_name(const HistoryEntry *h);
+const char *history_product_id(const HistoryEntry *h);
+const char *history_description(const HistoryEntry *h);
+
+/* How many texts are in the table, and forgetting the ones after count */
+/* (used when a snapshot turns out bad and the CSV is read instead) */
+guint history_strings_count(void);
+void history_strings_truncate(guint count);
+
+/* Free the table (at shutdown, after the history entries are gone) */
+void history_strings_free(void);
+
+/* The history list itself (model.h). Like the table, it has no lock: */
+/* appends and truncates happen in the loaders and under the history lock */
+HistoryList *history_list_new(void);
+void history_list_append(HistoryList *list, HistoryEntry *h);
+void history_list_truncate(HistoryList *list, guint len);  /* Keeps the first len */
+void history_list_free(HistoryList *list);  /* Only the list - the entries are in the pool */
+
+#endif /* HISTORY_H */
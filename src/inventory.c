@@ -0,0 +1,127 @@
+#include "inventory.h"
+#include "storage.h"
+#include "snapshot.h"
+#include "logic.h"
+#include "pool.h"
+#include "history.h"
+#include <glib/gstdio.h>
+
+/* These are the global arrays that hold all our data */
+/* I put them here so every file can use them */
+GPtrArray *products = NULL;  /* List of all products */
+HistoryList *history = NULL; /* List of all history */
+GHashTable *product_index = NULL;  /* Product ID -> Product for fast lookup */
+
+/* data_dir/name - free with g_free */
+static char *data_file(const char *data_dir, const char *name) {
+    return g_build_filename(data_dir, name, NULL);
+}
+
+void inventory_init(const char *data_dir) {
+    /* Create empty lists for products and history */
+    products = g_ptr_array_new();
+    history = history_list_new();
+    /* Keys are the id strings inside each Product, so no key/value free functions */
+    product_index = g_hash_table_new(g_str_hash, g_str_equal);
+
+    /* Create data folder if it doesn't exist */
+    g_mkdir_with_parents(data_dir, 0755);
+}
+
+/* Touches only products and product_index */
+gboolean inventory_load_products(const char *data_dir, GError **error) {
+    char *snap = data_file(data_dir, "products.snap");
+    char *csv = data_file(data_dir, "products.csv");
+    char *delta = data_file(data_dir, "products.delta");
+    /* The binary snapshot is much faster - only parse the CSV if it's missing or stale */
+    gboolean ok = snapshot_load_products(snap, csv) || storage_load_products(csv, error);
+    /* Then the changes autosave checkpointed since products.csv was written */
+    gboolean stale = FALSE;
+    if (ok) ok = storage_load_product_delta(delta, csv, &stale, error);
+    if (stale) g_remove(delta);  /* products.csv already has those changes */
+    g_free(snap);
+    g_free(csv);
+    g_free(delta);
+    return ok;
+}
+
+/* Touches only history */
+gboolean inventory_load_history(const char *data_dir, GError **error) {
+    char *snap = data_file(data_dir, "history.snap");
+    char *csv = data_file(data_dir, "history.csv");
+    /* The history snapshot covers the start of history.csv - parse only the rest */
+    gint64 history_offset = 0;
+    snapshot_load_history(snap, csv, &history_offset);
+    gboolean ok = storage_load_history_from(csv, history_offset, error);
+    g_free(snap);
+    g_free(csv);
+    return ok;
+}
+
+gboolean inventory_open_journal(const char *data_dir, guint fsync_interval_ms,
+                                GError **error) {
+    char *csv = data_file(data_dir, "history.csv");
+    gboolean ok = storage_journal_open(csv, fsync_interval_ms, error);
+    g_free(csv);
+    return ok;
+}
+
+/* Products are written out in full; history is already in history.csv */
+/* (the journal), so only its last batch is left to write */
+gboolean inventory_save(const char *data_dir, GError **error) {
+    char *products_csv = data_file(data_dir, "products.csv");
+    char *products_snap = data_file(data_dir, "products.snap");
+    char *history_csv = data_file(data_dir, "history.csv");
+    char *history_snap = data_file(data_dir, "history.snap");
+    char *products_delta = data_file(data_dir, "products.delta");
+    GError *err = NULL;
+    gboolean ok = TRUE;
+
+    if (storage_save_products(products_csv, &err)) {
+        /* products.csv has every change now, the delta isn't needed */
+        g_remove(products_delta);
+        /* Snapshot right after the CSV so the snapshot matches it */
+        snapshot_save_products(products_snap, products_csv, &err);
+    }
+    if (err) {
+        g_propagate_prefixed_error(error, err, "Error saving products: ");
+        err = NULL;
+        ok = FALSE;
+    }
+
+    storage_journal_close();
+    /* Then add this session's entries to the history snapshot */
+    if (!snapshot_save_history(history_snap, history_csv, &err)) {
+        if (ok) {
+            g_propagate_prefixed_error(error, err, "Error saving history snapshot: ");
+        } else {
+            g_clear_error(&err);  /* Already reporting the products error */
+        }
+        ok = FALSE;
+    }
+
+    g_free(products_csv);
+    g_free(products_snap);
+    g_free(history_csv);
+    g_free(history_snap);
+    g_free(products_delta);
+    return ok;
+}
+
+void inventory_free(void) {
+    /* The index only points into the products, so drop it first */
+    if (product_index) {
+        g_hash_table_destroy(product_index);
+        product_index = NULL;
+    }
+    /* The running totals point at products too */
+    clear_aggregates();
+    /* Free the lists, then all products and history entries at once (they live in the pool) */
+    if (products) {
+        g_ptr_array_free(products, TRUE);
+        products = NULL;
+    }
+    g_clear_pointer(&history, history_list_free);
+    pool_free_all();
+    history_strings_free();
+}
@@ -0,0 +1,31 @@
+#ifndef INVENTORY_H
+#define INVENTORY_H
+
+#include "model.h"
+
+/* This file owns the products and history lists (the globals in model.h) */
+/* and knows which files in the data folder they are loaded from and saved */
+/* to. Both the GTK app (main.c) and the command line tool (cli.c) use it, */
+/* so they always read and write the data the same way. */
+
+/* Make the empty lists (and the data folder if it doesn't exist yet) */
+void inventory_init(const char *data_dir);
+
+/* Load from the snapshots, or the CSV files if the snapshots don't match */
+/* plus the products autosave checkpointed to products.delta since then */
+/* Products first, then history - they may run on a worker thread */
+gboolean inventory_load_products(const char *data_dir, GError **error);
+gboolean inventory_load_history(const char *data_dir, GError **error);
+
+/* Start appending new history entries to history.csv */
+/* (call after inventory_load_history so old entries aren't written twice) */
+gboolean inventory_open_journal(const char *data_dir, guint fsync_interval_ms,
+                                GError **error);
+
+/* Save products, close the journal and update the snapshots */
+gboolean inventory_save(const char *data_dir, GError **error);
+
+/* Free every product and history entry */
+void inventory_free(void);
+
+#endif /* INVENTORY_H */
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <string.h>
+#include <gio/gio.h>
+#include "csv.h"
+#ifdef G_OS_UNIX
+#include <gio/gunixsocketaddress.h>
+#endif
+
+/* This is stock_loadgen, a load generator for "stock_cli serve" */
+/* Every client is a thread with its own connection. It keeps up to */
+/* pipeline_depth requests on the way, sends them with one write and times */
+/* every answer. At the end it prints requests/s and latency percentiles. */
+/* Request mix: 60% stock level, 20% lookup, 15% sell 1, 5% restock 10 */
+
+static char *socket_path = NULL;
+static char *data_dir = NULL;
+static gint n_clients = 16;
+static gint n_requests = 100000;   /* Per client */
+static gint pipeline_depth = 32;
+
+/* The product IDs we send requests for (from products.csv) */
+static GPtrArray *ids = NULL;
+
+#ifdef G_OS_UNIX
+
+typedef struct {
+    guint index;
+    GArray *latencies;  /* gint64 microseconds, one per answer */
+    guint errors;       /* ERR answers (like selling more than is in stock) */
+    char *failure;      /* Set if the connection itself failed */
+} Worker;
+
+static void append_request(GString *out, GRand *rand) {
+    const char *id = g_ptr_array_index(ids, g_rand_int_range(rand, 0, (gint32)ids->len));
+    guint32 pick = g_rand_int_range(rand, 0, 100);
+    if (pick < 60) {
+        g_string_append_printf(out, "Q %s\n", id);
+    } else if (pick < 80) {
+        g_string_append_printf(out, "L %s\n", id);
+    } else if (pick < 95) {
+        g_string_append_printf(out, "S %s 1\n", id);
+    } else {
+        g_string_append_printf(out, "R %s 10\n", id);
+    }
+}
+
+static gboolean send_all(GSocket *socket, const char *data, gsize len, GError **error) {
+    while (len > 0) {
+        gssize n = g_socket_send(socket, data, len, NULL, error);
+        if (n < 0) return FALSE;
+        data += n;
+        len -= (gsize)n;
+    }
+    return TRUE;
+}
+
+/* This function is one client: it runs on its own thread */
+static gpointer worker_run(gpointer data) {
+    Worker *w = data;
+    GError *err = NULL;
+    GSocketClient *client = g_socket_client_new();
+    GSocketAddress *address = g_unix_socket_address_new(socket_path);
+    GSocketConnection *conn = g_socket_client_connect(client, G_SOCKET_CONNECTABLE(address),
+                                                      NULL, &err);
+    g_object_unref(address);
+    g_object_unref(client);
+    if (!conn) {
+        w->failure = g_strdup(err->message);
+        g_clear_error(&err);
+        return NULL;
+    }
+    GSocket *socket = g_socket_connection_get_socket(conn);
+
+    GRand *rand = g_rand_new_with_seed(w->index + 1);
+    /* When each request on the way was sent - answers come back in order, */
+    /* so request i is always in slot i % depth */
+    gint64 *sent_at = g_new(gint64, pipeline_depth);
+    GString *out = g_string_new(NULL);
+    GString *in = g_string_new(NULL);
+    char buf[16 * 1024];
+    guint sent = 0, answered = 0;
+
+    while (answered < (guint)n_requests) {
+        /* Top the pipeline up, all in one write */
+        g_string_truncate(out, 0);
+        gint64 now = g_get_monotonic_time();
+        while (sent < (guint)n_requests && sent - answered < (guint)pipeline_depth) {
+            append_request(out, rand);
+            sent_at[sent % pipeline_depth] = now;
+            sent++;
+        }
+        if (out->len > 0 && !send_all(socket, out->str, out->len, &err)) break;
+
+        gssize n = g_socket_receive(socket, buf, sizeof(buf), NULL, &err);
+        if (n <= 0) {
+            if (n == 0) w->failure = g_strdup("Server closed the connection");
+            break;
+        }
+        now = g_get_monotonic_time();
+        g_string_append_len(in, buf, n);
+
+        /* Every full line is the answer to the oldest request */
+        gsize start = 0;
+        char *nl;
+        while ((nl = memchr(in->str + start, '\n', in->len - start)) != NULL) {
+            gint64 latency = now - sent_at[answered % pipeline_depth];
+            g_array_append_val(w->latencies, latency);
+            if (strncmp(in->str + start, "ERR", 3) == 0) w->errors++;
+            answered++;
+            start = (gsize)(nl - in->str) + 1;
+        }
+        g_string_erase(in, 0, (gssize)start);
+    }
+    if (err) {
+        w->failure = g_strdup(err->message);
+        g_clear_error(&err);
+    }
+
+    g_string_free(in, TRUE);
+    g_string_free(out, TRUE);
+    g_free(sent_at);
+    g_rand_free(rand);
+    g_io_stream_close(G_IO_STREAM(conn), NULL, NULL);
+    g_object_unref(conn);
+    return NULL;
+}
+
+static int compare_gint64(gconstpointer a, gconstpointer b) {
+    gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* The value below which pct percent of the sorted latencies are */
+static gint64 percentile(GArray *sorted, double pct) {
+    guint i = (guint)(pct / 100.0 * (sorted->len - 1) + 0.5);
+    return g_array_index(sorted, gint64, i);
+}
+
+#endif /* G_OS_UNIX */
+
+/* Take the IDs from products.csv - the server has the same file loaded */
+static gboolean load_ids(GError **error) {
+    char *path = g_build_filename(data_dir, "products.csv", NULL);
+    CsvReader *r = csv_reader_open(path, 0, error);
+    g_free(path);
+    if (!r) return FALSE;
+
+    CsvField *fields;
+    guint n;
+    ids = g_ptr_array_new_with_free_func(g_free);
+    while (csv_reader_next(r, &fields, &n)) {
+        if (n == 6 && fields[0].len > 0) g_ptr_array_add(ids, g_strdup(fields[0].str));
+    }
+    csv_reader_close(r);
+    return TRUE;
+}
+
+int main(int argc, char **argv) {
+    GOptionEntry entries[] = {
+        { "socket", 's', 0, G_OPTION_ARG_FILENAME, &socket_path,
+          "Server socket (default: DIR/stock.sock)", "PATH" },
+        { "data-dir", 'd', 0, G_OPTION_ARG_FILENAME, &data_dir,
+          "Folder with the server's products.csv (default: data)", "DIR" },
+        { "clients", 'c', 0, G_OPTION_ARG_INT, &n_clients, "Connections (default: 16)", "N" },
+        { "requests", 'n', 0, G_OPTION_ARG_INT, &n_requests,
+          "Requests per connection (default: 100000)", "N" },
+        { "pipeline", 'p', 0, G_OPTION_ARG_INT, &pipeline_depth,
+          "Requests on the way per connection (default: 32)", "N" },
+        { NULL }
+    };
+    GOptionContext *context = g_option_context_new(NULL);
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_set_summary(context, "Sends requests to a running \"stock_cli serve\".");
+
+    GError *err = NULL;
+    if (!g_option_context_parse(context, &argc, &argv, &err)) {
+        g_printerr("stock_loadgen: %s\n", err->message);
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return 2;
+    }
+    g_option_context_free(context);
+    if (n_clients < 1 || n_requests < 1 || pipeline_depth < 1) {
+        g_printerr("stock_loadgen: -c, -n and -p must be at least 1\n");
+        return 2;
+    }
+    if (!data_dir) data_dir = g_strdup("data");
+    if (!socket_path) socket_path = g_build_filename(data_dir, "stock.sock", NULL);
+
+    if (!load_ids(&err)) {
+        g_printerr("stock_loadgen: %s\n", err->message);
+        g_clear_error(&err);
+        return 1;
+    }
+    if (ids->len == 0) {
+        g_printerr("stock_loadgen: no products to send requests for\n");
+        return 1;
+    }
+
+#ifdef G_OS_UNIX
+    Worker *workers = g_new0(Worker, n_clients);
+    GThread **threads = g_new(GThread *, n_clients);
+    gint64 start = g_get_monotonic_time();
+    for (gint i = 0; i < n_clients; i++) {
+        workers[i].index = (guint)i;
+        workers[i].latencies = g_array_sized_new(FALSE, FALSE, sizeof(gint64), (guint)n_requests);
+        threads[i] = g_thread_new("client", worker_run, &workers[i]);
+    }
+    for (gint i = 0; i < n_clients; i++) g_thread_join(threads[i]);
+    double seconds = (double)(g_get_monotonic_time() - start) / G_USEC_PER_SEC;
+
+    /* Put everyone's latencies together */
+    GArray *all = g_array_new(FALSE, FALSE, sizeof(gint64));
+    guint errors = 0, failed = 0;
+    for (gint i = 0; i < n_clients; i++) {
+        g_array_append_vals(all, workers[i].latencies->data, workers[i].latencies->len);
+        errors += workers[i].errors;
+        if (workers[i].failure) {
+            g_printerr("stock_loadgen: client %d: %s\n", i, workers[i].failure);
+            g_free(workers[i].failure);
+            failed++;
+        }
+        g_array_free(workers[i].latencies, TRUE);
+    }
+    g_array_sort(all, compare_gint64);
+
+    printf("%d clients x %d requests, pipeline %d\n", n_clients, n_requests, pipeline_depth);
+    printf("Answers: %u in %.2f s (%.0f requests/s)\n", all->len, seconds,
+           seconds > 0 ? all->len / seconds : 0.0);
+    if (all->len > 0) {
+        printf("Latency: p50 %" G_GINT64_FORMAT " us, p99 %" G_GINT64_FORMAT
+               " us, max %" G_GINT64_FORMAT " us\n", percentile(all, 50), percentile(all, 99),
+               g_array_index(all, gint64, all->len - 1));
+    }
+    printf("ERR answers: %u\n", errors);
+
+    g_array_free(all, TRUE);
+    g_free(threads);
+    g_free(workers);
+    g_ptr_array_free(ids, TRUE);
+    g_free(socket_path);
+    g_free(data_dir);
+    return failed > 0 ? 1 : 0;
+#else
+    g_printerr("stock_loadgen: Unix domain sockets are not available here\n");
+    return 1;
+#endif
+}
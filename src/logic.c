@@ -1,50 +1,413 @@
 #include "logic.h"
+#include "storage.h"
+#include "pool.h"
+#include "history.h"
+#include "search.h"
+#include "metrics.h"
+#include "trace.h"
 #include <string.h>
 
 extern GPtrArray *products;
-extern GPtrArray *history;
+extern HistoryList *history;
+extern GHashTable *product_index;
+
+/* Products are spread over this many locks, so sales of different products */
+/* almost never wait for each other */
+#define LOGIC_LOCK_SHARDS 64
+G_STATIC_ASSERT(LOGIC_LOCK_SHARDS <= 64);  /* A transaction keeps its shards in a guint64 */
+
+/* Baskets up to this size find repeated products by looking back through */
+/* their lines, bigger ones use a hash table */
+#define TXN_SMALL_BASKET 16
+
+/* The locks that make these functions safe to call from several threads */
+/* They are always taken in this order, so two threads can't wait on each other: */
+/*   inventory_lock -> a product's shard lock -> totals_lock or history_lock */
+/* A sale only holds its product's shard lock for long. The totals are atomic */
+/* adds, the ranking is re-sorted later (update_ranking), and history_lock is */
+/* only held to put the entry in the list - the journal is written after every */
+/* lock is let go. So sales of different products only meet for a moment */
+static GRWLock inventory_lock;  /* The products list, the ID and search indexes, the product */
+                                /* pool. Readers: anything that looks a product up (sells too, */
+                                /* they only change one product). Writers: add and remove */
+static GMutex shard_locks[LOGIC_LOCK_SHARDS];  /* A product's quantity and sold, rank_pending */
+static GRWLock totals_lock;     /* The categories table and members, and the ranking */
+static GMutex history_lock;     /* The history list, its pool and string table, the journal order */
+
+/* The newest transaction number (see next_txn) */
+static guint32 last_txn = 0;
+static gboolean last_txn_known = FALSE;
+
+/* Running totals for the whole inventory */
+/* Every function that changes a product updates these, so reading them is O(1) */
+/* They (and the category totals) are only changed with atomic adds */
+static Money total_stock_value = 0;     /* Sum of price * quantity, in cents */
+static gint64 total_sold = 0;           /* Sum of sold */
+static GSequence *best_sellers = NULL;  /* All products, sorted by rank_sold (lowest first) */
+static GHashTable *categories = NULL;   /* Category name -> Category */
+
+/* Products whose sold changed since the ranking was sorted, per shard */
+/* (rank_pending[i] belongs to shard_locks[i]) - see update_ranking */
+static GPtrArray *rank_pending[LOGIC_LOCK_SHARDS];
+
+/* Who wants to hear about changes (the main window) */
+/* It's called on the thread that made the change, with the locks held */
+static StockChangeFunc change_func = NULL;
+static gpointer change_data = NULL;
+
+/* Goes up by one for every change to a product (see logic_change_count) */
+static gint product_changes = 0;
+
+/* IDs of the products added, changed or removed since the last checkpoint */
+/* (logic_take_changes). Split like the locks: dirty_ids[i] belongs to */
+/* shard_locks[i], or to whoever holds inventory_lock for writing */
+static GHashTable *dirty_ids[LOGIC_LOCK_SHARDS];
+
+/* With make DEBUG=1 every change double-checks the totals against a full recount */
+#ifdef STOCK_DEBUG
+#define CHECK_AGGREGATES() \
+    G_STMT_START { \
+        if (!verify_aggregates()) g_warning("Inventory totals are out of sync in %s", G_STRFUNC); \
+    } G_STMT_END
+#else
+#define CHECK_AGGREGATES() G_STMT_START { } G_STMT_END
+#endif
+
+/* GLib only has atomics for ints and pointers - these are for the 64-bit totals */
+#ifdef __GNUC__
+#define atomic_add64(p, v) ((void)__atomic_fetch_add((p), (v), __ATOMIC_RELAXED))
+#define atomic_get64(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#else
+static GMutex atomic64_lock;
+static void atomic_add64(gint64 *p, gint64 v) {
+    g_mutex_lock(&atomic64_lock);
+    *p += v;
+    g_mutex_unlock(&atomic64_lock);
+}
+static gint64 atomic_get64(const gint64 *p) {
+    g_mutex_lock(&atomic64_lock);
+    gint64 v = *p;
+    g_mutex_unlock(&atomic64_lock);
+    return v;
+}
+#endif
+
+/* Order for the best-seller ranking: by sold, then by ID so ties are stable */
+/* It uses rank_sold, the sold the ranking last saw, so a sale can't move a */
+/* product under the sequence's feet - update_ranking catches it up */
+static gint compare_by_sold(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const Product *pa = a;
+    const Product *pb = b;
+    if (pa->rank_sold != pb->rank_sold) return pa->rank_sold < pb->rank_sold ? -1 : 1;
+    return strcmp(pa->id, pb->id);
+}
+
+/* This function adds one product's changes to the running totals, both the */
+/* overall ones and its category's. value/quantity/sold are the differences, */
+/* low is +1/-1 when the product goes below/back above LOW_STOCK_LIMIT */
+static void add_to_totals(Category *c, Money value, gint64 quantity, gint64 sold, int low) {
+    atomic_add64(&total_stock_value, value);
+    atomic_add64(&total_sold, sold);
+    atomic_add64(&c->stock_value, value);
+    atomic_add64(&c->quantity, quantity);
+    atomic_add64(&c->sold, sold);
+    if (low) g_atomic_int_add((gint *)&c->low_stock, low);
+}
+
+/* All of a product's numbers in (sign = 1) or out of (sign = -1) the totals */
+static void count_product(const Product *p, int sign) {
+    add_to_totals(p->cat, sign * p->price * p->quantity, sign * p->quantity, sign * p->sold,
+                  p->quantity < LOW_STOCK_LIMIT ? sign : 0);
+}
+
+/* The lock for one product's numbers */
+static guint id_shard(const char *id) {
+    return g_str_hash(id) % LOGIC_LOCK_SHARDS;
+}
+
+static guint shard_index(const Product *p) {
+    return id_shard(p->id);
+}
+
+static GMutex *shard_lock(const Product *p) {
+    return &shard_locks[shard_index(p)];
+}
+
+/* Queue a product for update_ranking - call with its shard lock held */
+static void queue_rank(Product *p) {
+    if (p->rank_queued) return;
+    GPtrArray **pending = &rank_pending[shard_index(p)];
+    if (!*pending) *pending = g_ptr_array_new();
+    g_ptr_array_add(*pending, p);
+    p->rank_queued = TRUE;
+}
+
+/* This function changes one product's quantity and sold, and everything counted */
+/* from them. Call it with the product's shard lock held - nothing else */
+/* Readers without that lock use g_atomic_int_get */
+static void change_numbers(Product *p, int quantity, int sold) {
+    gboolean was_low = p->quantity < LOW_STOCK_LIMIT;
+    gboolean is_low = quantity < LOW_STOCK_LIMIT;
+    add_to_totals(p->cat, p->price * (quantity - p->quantity), quantity - p->quantity,
+                  sold - p->sold, was_low == is_low ? 0 : is_low ? 1 : -1);
+    if (sold != p->sold) queue_rank(p);
+    g_atomic_int_set(&p->quantity, quantity);
+    g_atomic_int_set(&p->sold, sold);
+}
+
+/* Re-sort shard i's queued products in the ranking */
+/* Call with shard_locks[i] (or inventory_lock for writing) held */
+static void rank_shard(guint i) {
+    GPtrArray *pending = rank_pending[i];
+    if (!pending || pending->len == 0) return;
+    g_rw_lock_writer_lock(&totals_lock);
+    for (guint j = 0; j < pending->len; j++) {
+        Product *p = g_ptr_array_index(pending, j);
+        p->rank_queued = FALSE;
+        p->rank_sold = p->sold;
+        g_sequence_sort_changed(p->rank, compare_by_sold, NULL);
+    }
+    g_rw_lock_writer_unlock(&totals_lock);
+    g_ptr_array_set_size(pending, 0);
+}
+
+/* This function brings the ranking up to date with every sale so far */
+/* Sales only queue their product, so the sorting is done here, in one go, */
+/* by whoever wants to read the ranking. Call with inventory_lock held */
+static void update_ranking(void) {
+    for (guint i = 0; i < LOGIC_LOCK_SHARDS; i++) {
+        g_mutex_lock(&shard_locks[i]);
+        rank_shard(i);
+        g_mutex_unlock(&shard_locks[i]);
+    }
+}
+
+static void free_category(gpointer data) {
+    Category *c = data;
+    g_free(c->name);
+    g_ptr_array_free(c->members, TRUE);
+    g_free(c);
+}
+
+/* This function puts a product into its category, making the category if it's new */
+static void join_category(Product *p) {
+    if (!categories) {
+        /* The key is c->name, which free_category frees */
+        categories = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_category);
+    }
+    Category *c = g_hash_table_lookup(categories, p->category);
+    if (!c) {
+        c = g_new0(Category, 1);
+        c->name = g_strdup(p->category);
+        c->members = g_ptr_array_new();
+        g_hash_table_insert(categories, c->name, c);
+    }
+    p->cat = c;
+    p->cat_slot = c->members->len;
+    g_ptr_array_add(c->members, p);
+}
+
+/* This function takes a product out of its category (same swap trick as remove_product) */
+/* A category with no products left is thrown away */
+static void leave_category(Product *p) {
+    Category *c = p->cat;
+    guint slot = p->cat_slot;
+    g_ptr_array_remove_index_fast(c->members, slot);
+    if (slot < c->members->len) {
+        Product *moved = g_ptr_array_index(c->members, slot);
+        moved->cat_slot = slot;
+    }
+    p->cat = NULL;
+    if (c->members->len == 0) {
+        g_hash_table_remove(categories, c->name);  /* Frees c */
+    }
+}
+
+void logic_set_change_func(StockChangeFunc func, gpointer user_data) {
+    change_func = func;
+    change_data = user_data;
+}
+
+/* Remember that a product needs to go in the next checkpoint */
+/* Call with its shard lock (or inventory_lock for writing) held */
+static void mark_dirty(const char *id) {
+    GHashTable **set = &dirty_ids[id_shard(id)];
+    if (!*set) *set = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    if (!g_hash_table_contains(*set, id)) g_hash_table_add(*set, g_strdup(id));
+}
+
+static void notify_change(StockChange change, guint position, Product *p) {
+    if (change != STOCK_CHANGE_HISTORY_APPENDED) {
+        g_atomic_int_inc(&product_changes);
+        mark_dirty(p->id);
+    }
+    if (change_func) change_func(change, position, p, change_data);
+}
+
+/* The ID lookup itself - call with inventory_lock held */
+/* It asks the hash index, so it takes the same time for 100 or 1M products */
+static Product *lookup(const char *id) {
+    if (!id) return NULL;
+    return g_hash_table_lookup(product_index, id);  /* NULL if not found */
+}
 
 /* This function finds a product by looking for its ID */
-/* It loops through all products and checks each one */
 Product *find_product_by_id(const char *id) {
-    /* Go through every product in our list */
-    for (guint i = 0; i < products->len; i++) {
-        Product *p = g_ptr_array_index(products, i);
-        /* Compare IDs - if they match, we found it! */
-        if (g_strcmp0(p->id, id) == 0) {
-            return p;  /* Return the product we found */
-        }
+    g_rw_lock_reader_lock(&inventory_lock);
+    Product *p = lookup(id);
+    g_rw_lock_reader_unlock(&inventory_lock);
+    return p;
+}
+
+/* This function takes a product out of the index, the running totals, its */
+/* category, the search index and the list (the opposite of insert_locked) */
+/* Call with inventory_lock held for writing. Returns the slot it had */
+static guint unlink_locked(Product *p) {
+    /* Take it out of the index first - the key is p->id */
+    g_hash_table_remove(product_index, p->id);
+    /* And out of the running totals, its category and the ranking */
+    count_product(p, -1);
+    if (p->rank_queued) g_ptr_array_remove_fast(rank_pending[shard_index(p)], p);
+    g_rw_lock_writer_lock(&totals_lock);
+    leave_category(p);
+    g_sequence_remove(p->rank);
+    g_rw_lock_writer_unlock(&totals_lock);
+    search_remove(p);
+    /* Move the last product into this slot instead of shifting everything down */
+    guint slot = p->slot;
+    g_ptr_array_remove_index_fast(products, slot);
+    if (slot < products->len) {
+        Product *moved = g_ptr_array_index(products, slot);
+        moved->slot = slot;  /* Tell it where it lives now */
     }
-    return NULL;  /* Didn't find it */
+    return slot;
+}
+
+/* insert_product with inventory_lock already held for writing */
+static gboolean insert_locked(Product *p) {
+    /* Don't allow two products with the same ID */
+    if (g_hash_table_contains(product_index, p->id)) {
+        return FALSE;
+    }
+    p->slot = products->len;  /* It goes at the end of the list */
+    g_ptr_array_add(products, p);
+    g_hash_table_insert(product_index, p->id, p);
+    search_add(p);
+
+    /* Count it in its category and the running totals */
+    g_rw_lock_writer_lock(&totals_lock);
+    join_category(p);
+    if (!best_sellers) best_sellers = g_sequence_new(NULL);
+    p->rank_sold = p->sold;
+    p->rank_queued = FALSE;
+    p->rank = g_sequence_insert_sorted(best_sellers, p, compare_by_sold, NULL);
+    g_rw_lock_writer_unlock(&totals_lock);
+    count_product(p, 1);
+    return TRUE;
+}
+
+/* This function puts a product into the list and the index together */
+/* The index key points at p->id, so the product must stay alive while indexed */
+gboolean insert_product(Product *p) {
+    g_rw_lock_writer_lock(&inventory_lock);
+    gboolean ok = insert_locked(p);
+    g_rw_lock_writer_unlock(&inventory_lock);
+    return ok;
+}
+
+/* Like insert_product, but a product with the same ID is replaced */
+void replace_product(Product *p) {
+    g_rw_lock_writer_lock(&inventory_lock);
+    Product *old = lookup(p->id);
+    if (old) {
+        unlink_locked(old);
+        pool_free_product(old);
+    }
+    insert_locked(p);
+    g_rw_lock_writer_unlock(&inventory_lock);
+}
+
+gboolean drop_product(const char *id) {
+    g_rw_lock_writer_lock(&inventory_lock);
+    Product *p = lookup(id);
+    if (p) {
+        unlink_locked(p);
+        pool_free_product(p);
+    }
+    g_rw_lock_writer_unlock(&inventory_lock);
+    return p != NULL;
+}
+
+/* This function makes a history entry and adds it to the list */
+/* Call it with history_lock held - the journal is up to the caller */
+static HistoryEntry *append_history(HistoryOp op, const Product *p, int qty_change,
+                                    Money value_change, const char *description,
+                                    guint32 timestamp, guint32 txn) {
+    /* Create a new history entry */
+    HistoryEntry *h = pool_new_history();
+    h->timestamp = timestamp;
+    h->op = op;  /* Like HISTORY_OP_ADD or HISTORY_OP_SELL */
+    h->product = history_intern(p ? p->id : "");  /* Which product */
+    h->quantity_change = qty_change;  /* How much quantity changed */
+    h->value_change = value_change;  /* How much money changed */
+    h->description = history_intern(description);  /* A note about it */
+    h->txn = txn;
+    /* Add it to our history list */
+    history_list_append(history, h);
+    notify_change(STOCK_CHANGE_HISTORY_APPENDED, history->len - 1, NULL);
+    return h;
+}
+
+/* This function adds a history entry and queues it for history.csv, but */
+/* doesn't write it - the caller does storage_journal_commit() once it has */
+/* let go of its locks, so no lock is ever held while the disk is busy */
+static void queue_history(HistoryOp op, const Product *p, int qty_change,
+                          Money value_change, const char *description) {
+    guint32 now = (guint32)time(NULL);
+    /* One at a time, so history.csv gets the entries in the same order as the list */
+    g_mutex_lock(&history_lock);
+    HistoryEntry *h = append_history(op, p, qty_change, value_change, description, now, 0);
+    storage_journal_queue_batch((const HistoryEntry *const *)&h, 1);
+    g_mutex_unlock(&history_lock);
 }
 
 /* This function saves what we did to the history log */
 /* Every time we add, sell, or update something, we call this */
-void record_history(const char *operation,
+void record_history(HistoryOp op,
                     const Product *p,
                     int qty_change,
-                    double value_change,
+                    Money value_change,
                     const char *description) {
-    /* Create a new history entry */
-    HistoryEntry *h = g_new0(HistoryEntry, 1);
-    h->timestamp = time(NULL);  /* Save current time */
-    g_strlcpy(h->operation, operation, sizeof(h->operation));  /* Like "ADD" or "SELL" */
-    g_strlcpy(h->product_id, p ? p->id : "", sizeof(h->product_id));  /* Which product */
-    h->quantity_change = qty_change;  /* How much quantity changed */
-    h->value_change = value_change;  /* How much money changed */
-    g_strlcpy(h->description, description, sizeof(h->description));  /* A note about it */
-    /* Add it to our history list */
-    g_ptr_array_add(history, h);
+    queue_history(op, p, qty_change, value_change, description);
+    /* Written in batches, so this doesn't hit the disk every time */
+    storage_journal_commit();
+}
+
+/* Transaction numbers keep counting up from the newest one in history */
+/* History is in order, so that's the last entry with a number - it's only */
+/* looked for once. Call with history_lock held */
+static guint32 next_txn(void) {
+    if (!last_txn_known) {
+        for (guint i = history->len; i > 0; i--) {
+            const HistoryEntry *h = history_index(history, i - 1);
+            if (h->txn) {
+                last_txn = h->txn;
+                break;
+            }
+        }
+        last_txn_known = TRUE;
+    }
+    return ++last_txn;
 }
 
 /* This function adds a new product to our inventory */
 /* It checks if the ID already exists and if price/quantity are valid */
-gboolean add_product(const char *id,
-                     const char *name,
-                     const char *category,
-                     double price,
-                     int quantity,
-                     GError **error) {
+static gboolean do_add_product(const char *id,
+                               const char *name,
+                               const char *category,
+                               Money price,
+                               int quantity,
+                               GError **error) {
     /* First check: price and quantity must be positive numbers */
     if (price <= 0 || quantity <= 0) {
         g_set_error(error, g_quark_from_static_string("logic"), 1,
@@ -52,14 +415,16 @@ gboolean add_product(const char *id,
         return FALSE;  /* Can't add if invalid */
     }
     /* Second check: make sure this ID doesn't already exist */
-    if (find_product_by_id(id)) {
+    g_rw_lock_writer_lock(&inventory_lock);
+    if (lookup(id)) {
+        g_rw_lock_writer_unlock(&inventory_lock);
         g_set_error(error, g_quark_from_static_string("logic"), 2,
                     "Product with this ID already exists");
         return FALSE;  /* Can't have two products with same ID */
     }
 
     /* Create a new Product struct and fill it with data */
-    Product *p = g_new0(Product, 1);
+    Product *p = pool_new_product();
     g_strlcpy(p->id, id, sizeof(p->id));  /* Copy the ID string */
     g_strlcpy(p->name, name, sizeof(p->name));  /* Copy the name */
     g_strlcpy(p->category, category, sizeof(p->category));  /* Copy category */
@@ -67,16 +432,35 @@ gboolean add_product(const char *id,
     p->quantity = quantity;
     p->sold = 0;  /* Start with 0 sold */
 
-    /* Add it to our products list */
-    g_ptr_array_add(products, p);
+    /* Add it to our products list (and the ID index) */
+    insert_locked(p);
+    notify_change(STOCK_CHANGE_PRODUCT_ADDED, p->slot, p);
     /* Remember to log this in history */
-    record_history("ADD", p, quantity, price * quantity, "Added product");
+    queue_history(HISTORY_OP_ADD, p, quantity, price * quantity, "Added product");
+    g_rw_lock_writer_unlock(&inventory_lock);
+    storage_journal_commit();
+    CHECK_AGGREGATES();
     return TRUE;  /* Success! */
 }
 
+/* The public functions are thin wrappers that time and trace every call (metrics.h, trace.h) */
+gboolean add_product(const char *id,
+                     const char *name,
+                     const char *category,
+                     Money price,
+                     int quantity,
+                     GError **error) {
+    TRACE_BEGIN("add_product");
+    METRIC_START(start);
+    gboolean ok = do_add_product(id, name, category, price, quantity, error);
+    METRIC_STOP(METRIC_ADD_PRODUCT, start, ok);
+    TRACE_END("add_product");
+    return ok;
+}
+
 /* This function adds more stock to an existing product */
 /* Requirement: you can only add more than 5 at a time */
-gboolean update_stock(const char *id, int add_qty, GError **error) {
+static gboolean do_update_stock(const char *id, int add_qty, GError **error) {
     /* Check: must add more than 5 */
     if (add_qty <= 5) {
         g_set_error(error, g_quark_from_static_string("logic"), 3,
@@ -85,26 +469,45 @@ gboolean update_stock(const char *id, int add_qty, GError **error) {
     }
 
     /* Find the product first */
-    Product *p = find_product_by_id(id);
+    g_rw_lock_reader_lock(&inventory_lock);
+    Product *p = lookup(id);
     if (!p) {
+        g_rw_lock_reader_unlock(&inventory_lock);
         g_set_error(error, g_quark_from_static_string("logic"), 4,
                     "Product not found");
         return FALSE;  /* Can't update if product doesn't exist */
     }
 
     /* Add the quantity to what we already have */
-    p->quantity += add_qty;
-    /* Save this to history */
-    record_history("UPDATE", p, add_qty, p->price * add_qty, "Updated stock");
+    GMutex *lock = shard_lock(p);
+    g_mutex_lock(lock);
+    change_numbers(p, p->quantity + add_qty, p->sold);
+    notify_change(STOCK_CHANGE_PRODUCT_CHANGED, p->slot, p);
+    /* Save this to history (still holding the lock, so this product's */
+    /* entries are in the same order as its changes) */
+    queue_history(HISTORY_OP_UPDATE, p, add_qty, p->price * add_qty, "Updated stock");
+    g_mutex_unlock(lock);
+    g_rw_lock_reader_unlock(&inventory_lock);
+    storage_journal_commit();
+    CHECK_AGGREGATES();
     return TRUE;
 }
 
+gboolean update_stock(const char *id, int add_qty, GError **error) {
+    TRACE_BEGIN("update_stock");
+    METRIC_START(start);
+    gboolean ok = do_update_stock(id, add_qty, error);
+    METRIC_STOP(METRIC_UPDATE_STOCK, start, ok);
+    TRACE_END("update_stock");
+    return ok;
+}
+
 /* This function sells some products */
 /* It checks if we have enough stock, then reduces quantity and increases sold count */
-gboolean sell_product(const char *id,
-                      int qty,
-                      double *total,
-                      GError **error) {
+static gboolean do_sell_product(const char *id,
+                                int qty,
+                                Money *total,
+                                GError **error) {
     /* Check: must sell at least 1 */
     if (qty <= 0) {
         g_set_error(error, g_quark_from_static_string("logic"), 5,
@@ -113,86 +516,559 @@ gboolean sell_product(const char *id,
     }
 
     /* Find the product */
-    Product *p = find_product_by_id(id);
+    g_rw_lock_reader_lock(&inventory_lock);
+    Product *p = lookup(id);
     if (!p) {
+        g_rw_lock_reader_unlock(&inventory_lock);
         g_set_error(error, g_quark_from_static_string("logic"), 6,
                     "Product not found");
         return FALSE;
     }
 
-    /* Check if we have enough in stock */
+    /* Check if we have enough in stock - under the lock, so two sales */
+    /* can't both take the last one */
+    GMutex *lock = shard_lock(p);
+    g_mutex_lock(lock);
     if (p->quantity < qty) {
+        g_mutex_unlock(lock);
+        g_rw_lock_reader_unlock(&inventory_lock);
         g_set_error(error, g_quark_from_static_string("logic"), 7,
                     "Not enough stock");
         return FALSE;  /* Can't sell what we don't have */
     }
 
     /* Do the sale: reduce quantity, increase sold count */
-    p->quantity -= qty;  /* Take away from stock */
-    p->sold += qty;  /* Add to sold counter */
+    /* (this keeps the totals and the ranking in step too) */
+    change_numbers(p, p->quantity - qty, p->sold + qty);
+    notify_change(STOCK_CHANGE_PRODUCT_CHANGED, p->slot, p);
     /* Calculate how much money we made */
-    double value = p->price * qty;
+    Money value = p->price * qty;
     if (total) *total = value;  /* Return the total if they want it */
     /* Save to history */
-    record_history("SELL", p, -qty, value, "Sold product");
+    queue_history(HISTORY_OP_SELL, p, -qty, value, "Sold product");
+    g_mutex_unlock(lock);
+    g_rw_lock_reader_unlock(&inventory_lock);
+    storage_journal_commit();
+    CHECK_AGGREGATES();
     return TRUE;
 }
 
+gboolean sell_product(const char *id,
+                      int qty,
+                      Money *total,
+                      GError **error) {
+    TRACE_BEGIN("sell_product");
+    METRIC_START(start);
+    gboolean ok = do_sell_product(id, qty, total, error);
+    METRIC_STOP(METRIC_SELL_PRODUCT, start, ok);
+    TRACE_END("sell_product");
+    return ok;
+}
+
+/* Where run_transaction keeps track of one line */
+typedef struct {
+    Product *p;
+    guint first;   /* The first line with the same product */
+    int quantity;  /* First lines only: the product's numbers after the lines so far */
+    int sold;
+} TxnState;
+
+/* This function finds the first line for the same product as line i */
+/* seen (big baskets only) maps a product to its first line + 1 */
+static guint first_line_of(TxnState *st, guint i, GHashTable *seen) {
+    if (seen) {
+        guint first = GPOINTER_TO_UINT(g_hash_table_lookup(seen, st[i].p));
+        if (first) return first - 1;
+        g_hash_table_insert(seen, st[i].p, GUINT_TO_POINTER(i + 1));
+        return i;
+    }
+    for (guint j = 0; j < i; j++) {
+        if (st[j].p == st[i].p) return st[j].first;
+    }
+    return i;
+}
+
+/* Take (or give back) the shard locks in mask, always from the lowest up */
+static void lock_shards(guint64 mask) {
+    for (guint i = 0; i < LOGIC_LOCK_SHARDS; i++) {
+        if (mask & (G_GUINT64_CONSTANT(1) << i)) g_mutex_lock(&shard_locks[i]);
+    }
+}
+
+static void unlock_shards(guint64 mask) {
+    for (guint i = LOGIC_LOCK_SHARDS; i > 0; i--) {
+        if (mask & (G_GUINT64_CONSTANT(1) << (i - 1))) g_mutex_unlock(&shard_locks[i - 1]);
+    }
+}
+
+/* This function sells and restocks a whole basket at once */
+/* Every line is checked while all of the basket's products are locked, and */
+/* only if all of them are OK is anything changed */
+static gboolean do_run_transaction(const TxnLine *lines, guint n, Money *total, guint32 *txn,
+                                   GError **error) {
+    GQuark domain = g_quark_from_static_string("logic");
+    if (n == 0) {
+        g_set_error(error, domain, 13, "The transaction has no lines");
+        return FALSE;
+    }
+    /* Check the quantities first - that doesn't need any locks */
+    for (guint i = 0; i < n; i++) {
+        if (lines[i].op == HISTORY_OP_SELL) {
+            if (lines[i].qty <= 0) {
+                g_set_error(error, domain, 5, "Line %u: Quantity to sell must be > 0", i + 1);
+                return FALSE;
+            }
+        } else if (lines[i].op == HISTORY_OP_UPDATE) {
+            if (lines[i].qty <= 5) {
+                g_set_error(error, domain, 3, "Line %u: Quantity to add must be > 5", i + 1);
+                return FALSE;
+            }
+        } else {
+            g_set_error(error, domain, 14,
+                        "Line %u: Only sells and restocks can be in a transaction", i + 1);
+            return FALSE;
+        }
+    }
+
+    /* Find every product, then lock all their shards (in order, so two */
+    /* baskets with the same products can't wait on each other) */
+    TxnState *st = g_new(TxnState, n);
+    guint64 shards = 0;
+    g_rw_lock_reader_lock(&inventory_lock);
+    for (guint i = 0; i < n; i++) {
+        st[i].p = lookup(lines[i].id);
+        if (!st[i].p) {
+            g_rw_lock_reader_unlock(&inventory_lock);
+            g_free(st);
+            g_set_error(error, domain, 6, "Line %u: Product not found", i + 1);
+            return FALSE;
+        }
+        shards |= G_GUINT64_CONSTANT(1) << shard_index(st[i].p);
+    }
+    lock_shards(shards);
+
+    /* Work the lines out on the side - the same product can be in several */
+    GHashTable *seen = n > TXN_SMALL_BASKET ? g_hash_table_new(NULL, NULL) : NULL;
+    Money sold_value = 0;
+    gboolean ok = TRUE;
+    for (guint i = 0; i < n && ok; i++) {
+        st[i].first = first_line_of(st, i, seen);
+        TxnState *f = &st[st[i].first];
+        if (st[i].first == i) {
+            f->quantity = st[i].p->quantity;
+            f->sold = st[i].p->sold;
+        }
+        if (lines[i].op == HISTORY_OP_UPDATE) {
+            f->quantity += lines[i].qty;
+        } else if (f->quantity < lines[i].qty) {
+            g_set_error(error, domain, 7, "Line %u: Not enough stock", i + 1);
+            ok = FALSE;
+        } else {
+            f->quantity -= lines[i].qty;
+            f->sold += lines[i].qty;
+            sold_value += st[i].p->price * lines[i].qty;
+        }
+    }
+    if (seen) g_hash_table_destroy(seen);
+
+    if (ok) {
+        /* Everything checks out - change the products, once each */
+        for (guint i = 0; i < n; i++) {
+            if (st[i].first != i) continue;
+            change_numbers(st[i].p, st[i].quantity, st[i].sold);
+            notify_change(STOCK_CHANGE_PRODUCT_CHANGED, st[i].p->slot, st[i].p);
+        }
+
+        /* The history entries go in one after another with the same number, */
+        /* and to the journal as one batch */
+        const HistoryEntry **entries = g_new(const HistoryEntry *, n);
+        g_mutex_lock(&history_lock);
+        guint32 number = next_txn();
+        guint32 now = (guint32)time(NULL);
+        for (guint i = 0; i < n; i++) {
+            const Product *p = st[i].p;
+            int qty = lines[i].qty;
+            if (lines[i].op == HISTORY_OP_SELL) {
+                entries[i] = append_history(HISTORY_OP_SELL, p, -qty, p->price * qty,
+                                            "Sold product", now, number);
+            } else {
+                entries[i] = append_history(HISTORY_OP_UPDATE, p, qty, p->price * qty,
+                                            "Updated stock", now, number);
+            }
+        }
+        storage_journal_queue_batch(entries, n);
+        g_mutex_unlock(&history_lock);
+        g_free(entries);
+
+        if (total) *total = sold_value;
+        if (txn) *txn = number;
+    }
+
+    unlock_shards(shards);
+    g_rw_lock_reader_unlock(&inventory_lock);
+    g_free(st);
+    if (ok) {
+        storage_journal_commit();
+        CHECK_AGGREGATES();
+    }
+    return ok;
+}
+
+gboolean run_transaction(const TxnLine *lines, guint n, Money *total, guint32 *txn,
+                         GError **error) {
+    TRACE_BEGIN("run_transaction");
+    METRIC_START(start);
+    gboolean ok = do_run_transaction(lines, n, total, txn, error);
+    METRIC_STOP(METRIC_TRANSACTION, start, ok);
+    TRACE_END("run_transaction");
+    return ok;
+}
+
 /* This function deletes a product completely */
 /* It finds it, saves to history, then removes it from the list */
-gboolean remove_product(const char *id, GError **error) {
-    /* Look for the product */
-    for (guint i = 0; i < products->len; i++) {
-        Product *p = g_ptr_array_index(products, i);
-        if (g_strcmp0(p->id, id) == 0) {
-            /* Save to history before we delete it */
-            record_history("REMOVE", p, -p->quantity, 0.0, "Removed product");
-            /* Remove from list and free the memory */
-            g_ptr_array_remove_index(products, i);
-            g_free(p);  /* Free the memory so we don't leak */
-            return TRUE;  /* Success! */
-        }
+static gboolean do_remove_product(const char *id, GError **error) {
+    /* Look for the product - nobody else may touch the list while it goes */
+    g_rw_lock_writer_lock(&inventory_lock);
+    Product *p = lookup(id);
+    if (!p) {
+        /* Couldn't find it */
+        g_rw_lock_writer_unlock(&inventory_lock);
+        g_set_error(error, g_quark_from_static_string("logic"), 8,
+                    "Product not found");
+        return FALSE;
     }
-    /* Couldn't find it */
-    g_set_error(error, g_quark_from_static_string("logic"), 8,
-                "Product not found");
-    return FALSE;
+
+    /* Save to history before we delete it */
+    queue_history(HISTORY_OP_REMOVE, p, -p->quantity, 0, "Removed product");
+
+    guint slot = unlink_locked(p);
+    notify_change(STOCK_CHANGE_PRODUCT_REMOVED, slot, p);
+    pool_free_product(p);  /* Its memory goes back to the pool for the next product */
+    g_rw_lock_writer_unlock(&inventory_lock);
+    storage_journal_commit();
+    CHECK_AGGREGATES();
+    return TRUE;  /* Success! */
+}
+
+gboolean remove_product(const char *id, GError **error) {
+    TRACE_BEGIN("remove_product");
+    METRIC_START(start);
+    gboolean ok = do_remove_product(id, error);
+    METRIC_STOP(METRIC_REMOVE_PRODUCT, start, ok);
+    TRACE_END("remove_product");
+    return ok;
 }
 
 /* This function checks how many of a product we have in stock */
+/* Only a read lock, so lookups never wait for each other */
 int get_stock_level(const char *id, int *out_qty, GError **error) {
-    Product *p = find_product_by_id(id);
+    g_rw_lock_reader_lock(&inventory_lock);
+    Product *p = lookup(id);
     if (!p) {
+        g_rw_lock_reader_unlock(&inventory_lock);
         g_set_error(error, g_quark_from_static_string("logic"), 9,
                     "Product not found");
         return -1;  /* Return -1 if not found */
     }
     /* Return the quantity */
-    if (out_qty) *out_qty = p->quantity;
-    return p->quantity;
+    int qty = g_atomic_int_get(&p->quantity);
+    g_rw_lock_reader_unlock(&inventory_lock);
+    if (out_qty) *out_qty = qty;
+    return qty;
 }
 
-/* This function calculates total value of ALL our stock */
-/* It adds up (price * quantity) for every product */
-double compute_total_stock_value(void) {
-    double sum = 0.0;
-    /* Go through every product */
+/* This function copies one product, with quantity and sold from the same moment */
+gboolean lookup_product(const char *id, Product *copy, GError **error) {
+    g_rw_lock_reader_lock(&inventory_lock);
+    Product *p = lookup(id);
+    if (!p) {
+        g_rw_lock_reader_unlock(&inventory_lock);
+        g_set_error(error, g_quark_from_static_string("logic"), 9,
+                    "Product not found");
+        return FALSE;
+    }
+    GMutex *lock = shard_lock(p);
+    g_mutex_lock(lock);
+    *copy = *p;
+    g_mutex_unlock(lock);
+    g_rw_lock_reader_unlock(&inventory_lock);
+    return TRUE;
+}
+
+/* Every shard lock too: a sale changes the totals and adds its history entry */
+/* under its shard lock, so with all of them held no sale is half done */
+void logic_snapshot_begin(void) {
+    g_rw_lock_reader_lock(&inventory_lock);
+    lock_shards(G_MAXUINT64);
+    g_mutex_lock(&history_lock);
+}
+
+void logic_snapshot_end(void) {
+    g_mutex_unlock(&history_lock);
+    unlock_shards(G_MAXUINT64);
+    g_rw_lock_reader_unlock(&inventory_lock);
+}
+
+guint logic_change_count(void) {
+    return (guint)g_atomic_int_get(&product_changes);
+}
+
+/* This function copies every product at one moment */
+/* Every shard lock is held for the copy (in order, like a transaction), so */
+/* no sale or transaction is half in it. It's one memcpy per product, so */
+/* sales only wait for a few milliseconds even with a lot of products */
+Product *logic_copy_products(guint *n, guint *change_count, gboolean clear_changes) {
+    g_rw_lock_reader_lock(&inventory_lock);
+    for (guint i = 0; i < LOGIC_LOCK_SHARDS; i++) g_mutex_lock(&shard_locks[i]);
+
+    *n = products->len;
+    Product *copy = g_new(Product, MAX(products->len, 1));
+    for (guint i = 0; i < products->len; i++) {
+        copy[i] = *(Product *)g_ptr_array_index(products, i);
+    }
+    *change_count = logic_change_count();
+    if (clear_changes) {
+        for (guint i = 0; i < LOGIC_LOCK_SHARDS; i++) {
+            if (dirty_ids[i]) g_hash_table_remove_all(dirty_ids[i]);
+        }
+    }
+
+    for (guint i = LOGIC_LOCK_SHARDS; i > 0; i--) g_mutex_unlock(&shard_locks[i - 1]);
+    g_rw_lock_reader_unlock(&inventory_lock);
+    return copy;
+}
+
+/* This function hands over everything that changed since the last checkpoint */
+/* Same locks as logic_copy_products, but it only copies the changed products, */
+/* so it costs as much as there were changes, not as much as there are products */
+GArray *logic_take_changes(guint *change_count) {
+    GArray *rows = g_array_new(FALSE, FALSE, sizeof(ProductDelta));
+    g_rw_lock_reader_lock(&inventory_lock);
+    for (guint i = 0; i < LOGIC_LOCK_SHARDS; i++) g_mutex_lock(&shard_locks[i]);
+
+    for (guint i = 0; i < LOGIC_LOCK_SHARDS; i++) {
+        if (!dirty_ids[i] || g_hash_table_size(dirty_ids[i]) == 0) continue;
+        GHashTableIter iter;
+        gpointer key;
+        g_hash_table_iter_init(&iter, dirty_ids[i]);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+            ProductDelta d;
+            memset(&d, 0, sizeof(d));
+            Product *p = lookup(key);
+            if (p) {
+                d.product = *p;
+            } else {
+                /* Not there anymore - it was removed */
+                g_strlcpy(d.product.id, key, sizeof(d.product.id));
+                d.removed = TRUE;
+            }
+            g_array_append_val(rows, d);
+        }
+        g_hash_table_remove_all(dirty_ids[i]);
+    }
+    *change_count = logic_change_count();
+
+    for (guint i = LOGIC_LOCK_SHARDS; i > 0; i--) g_mutex_unlock(&shard_locks[i - 1]);
+    g_rw_lock_reader_unlock(&inventory_lock);
+    return rows;
+}
+
+/* A checkpoint couldn't be written - its products go in the next one instead */
+void logic_requeue_changes(GArray *rows) {
+    g_rw_lock_reader_lock(&inventory_lock);
+    for (guint i = 0; i < rows->len; i++) {
+        const char *id = g_array_index(rows, ProductDelta, i).product.id;
+        GMutex *lock = &shard_locks[id_shard(id)];
+        g_mutex_lock(lock);
+        mark_dirty(id);
+        g_mutex_unlock(lock);
+    }
+    g_rw_lock_reader_unlock(&inventory_lock);
+}
+
+/* This function returns the total value of ALL our stock */
+/* It's the running total of (price * quantity), so it doesn't loop over products */
+Money compute_total_stock_value(void) {
+    return atomic_get64(&total_stock_value);
+}
+
+/* This function returns how many units we've sold across all products */
+gint64 compute_total_sold(void) {
+    return atomic_get64(&total_sold);
+}
+
+/* This function fills out[] with the best sellers, best first */
+/* Once the queued sales are sorted in, this only walks max steps from the top */
+guint get_best_sellers(Product **out, guint max) {
+    guint n = 0;
+    g_rw_lock_reader_lock(&inventory_lock);
+    update_ranking();
+    g_rw_lock_reader_lock(&totals_lock);
+    if (best_sellers) {
+        GSequenceIter *it = g_sequence_get_end_iter(best_sellers);
+        while (n < max && !g_sequence_iter_is_begin(it)) {
+            it = g_sequence_iter_prev(it);
+            out[n++] = g_sequence_get(it);
+        }
+    }
+    g_rw_lock_reader_unlock(&totals_lock);
+    g_rw_lock_reader_unlock(&inventory_lock);
+    return n;
+}
+
+/* This function recounts everything the slow way and compares with the running totals */
+/* Only meant for debugging - it loops over every product */
+/* It takes the inventory lock for writing, so every change waits until it's done */
+gboolean verify_aggregates(void) {
+    g_rw_lock_writer_lock(&inventory_lock);
+    for (guint i = 0; i < LOGIC_LOCK_SHARDS; i++) rank_shard(i);
+    g_rw_lock_reader_lock(&totals_lock);
+    Money value = 0;
+    gint64 sold = 0;
+    gboolean ok = TRUE;
     for (guint i = 0; i < products->len; i++) {
         Product *p = g_ptr_array_index(products, i);
-        /* Add this product's value: price times how many we have */
-        sum += p->price * p->quantity;
+        value += p->price * p->quantity;
+        sold += p->sold;
+        if (p->rank_sold != p->sold || p->rank_queued) ok = FALSE;
+    }
+    /* Money is whole cents, so the totals have to match exactly */
+    guint ranked = best_sellers ? (guint)g_sequence_get_length(best_sellers) : 0;
+    ok = ok && value == total_stock_value && sold == total_sold && ranked == products->len;
+    /* And the ranking really is in order */
+    if (best_sellers) {
+        GSequenceIter *it = g_sequence_get_begin_iter(best_sellers);
+        Product *prev = NULL;
+        for (; !g_sequence_iter_is_end(it); it = g_sequence_iter_next(it)) {
+            Product *p = g_sequence_get(it);
+            if (p->rank != it || (prev && compare_by_sold(prev, p, NULL) >= 0)) ok = FALSE;
+            prev = p;
+        }
+    }
+
+    /* Every category against its own members */
+    guint in_categories = 0;
+    if (categories) {
+        GHashTableIter iter;
+        gpointer data;
+        g_hash_table_iter_init(&iter, categories);
+        while (g_hash_table_iter_next(&iter, NULL, &data)) {
+            Category *c = data;
+            Money c_value = 0;
+            gint64 c_quantity = 0, c_sold = 0;
+            guint c_low = 0;
+            for (guint i = 0; i < c->members->len; i++) {
+                Product *p = g_ptr_array_index(c->members, i);
+                if (p->cat != c || p->cat_slot != i || strcmp(p->category, c->name) != 0) ok = FALSE;
+                c_value += p->price * p->quantity;
+                c_quantity += p->quantity;
+                c_sold += p->sold;
+                if (p->quantity < LOW_STOCK_LIMIT) c_low++;
+            }
+            if (c_value != c->stock_value || c_quantity != c->quantity ||
+                c_sold != c->sold || c_low != c->low_stock) {
+                ok = FALSE;
+            }
+            in_categories += c->members->len;
+        }
     }
-    return sum;  /* Return the total */
+    ok = ok && in_categories == products->len;
+    g_rw_lock_reader_unlock(&totals_lock);
+    g_rw_lock_writer_unlock(&inventory_lock);
+    return ok;
+}
+
+/* This function finds a category by its name - NULL if no product has it */
+Category *find_category(const char *name) {
+    if (!name) return NULL;
+    g_rw_lock_reader_lock(&totals_lock);
+    Category *c = categories ? g_hash_table_lookup(categories, name) : NULL;
+    g_rw_lock_reader_unlock(&totals_lock);
+    return c;
+}
+
+static gint compare_category_names(gconstpointer a, gconstpointer b) {
+    const Category *ca = *(const Category *const *)a;
+    const Category *cb = *(const Category *const *)b;
+    return g_utf8_collate(ca->name, cb->name);
+}
+
+/* This function lists all categories sorted by name */
+/* It only looks at the categories, not at the products in them */
+GPtrArray *get_categories(void) {
+    GPtrArray *list = g_ptr_array_new();
+    g_rw_lock_reader_lock(&totals_lock);
+    if (categories) {
+        GHashTableIter iter;
+        gpointer data;
+        g_hash_table_iter_init(&iter, categories);
+        while (g_hash_table_iter_next(&iter, NULL, &data)) {
+            g_ptr_array_add(list, data);
+        }
+    }
+    g_rw_lock_reader_unlock(&totals_lock);
+    g_ptr_array_sort(list, compare_category_names);
+    return list;
+}
+
+/* This function fills out[] with the low-stock products of one category */
+/* It only walks that category's members */
+guint get_low_stock_in_category(const Category *c, Product **out, guint max) {
+    guint n = 0;
+    g_rw_lock_reader_lock(&totals_lock);
+    guint low = (guint)g_atomic_int_get((gint *)&c->low_stock);
+    for (guint i = 0; i < c->members->len && n < max && n < low; i++) {
+        Product *p = g_ptr_array_index(c->members, i);
+        if (g_atomic_int_get(&p->quantity) < LOW_STOCK_LIMIT) out[n++] = p;
+    }
+    g_rw_lock_reader_unlock(&totals_lock);
+    return n;
+}
+
+/* Sales add to these without any lock, so each one is read atomically */
+void get_category_totals(const Category *c, Money *stock_value, gint64 *quantity,
+                         gint64 *sold, guint *low_stock) {
+    *stock_value = atomic_get64(&c->stock_value);
+    *quantity = atomic_get64(&c->quantity);
+    *sold = atomic_get64(&c->sold);
+    *low_stock = (guint)g_atomic_int_get((gint *)&c->low_stock);
+}
+
+/* This function resets the running totals, e.g. before all products are freed */
+void clear_aggregates(void) {
+    g_rw_lock_writer_lock(&inventory_lock);
+    g_rw_lock_writer_lock(&totals_lock);
+    if (best_sellers) {
+        g_sequence_free(best_sellers);
+        best_sellers = NULL;
+    }
+    if (categories) {
+        g_hash_table_destroy(categories);
+        categories = NULL;
+    }
+    search_clear();
+    total_stock_value = 0;
+    total_sold = 0;
+    last_txn_known = FALSE;  /* History is about to go too */
+    for (guint i = 0; i < LOGIC_LOCK_SHARDS; i++) {
+        g_clear_pointer(&dirty_ids[i], g_hash_table_destroy);
+        if (rank_pending[i]) {
+            g_ptr_array_free(rank_pending[i], TRUE);
+            rank_pending[i] = NULL;
+        }
+    }
+    g_rw_lock_writer_unlock(&totals_lock);
+    g_rw_lock_writer_unlock(&inventory_lock);
 }
 
 /* This function applies a discount to a sale */
 /* Discount must be between 10% and 20% */
 /* It doesn't change the product's price, just calculates the discounted total */
-gboolean apply_discount(const char *id,
-                        int qty,
-                        double discount_percent,
-                        double *discounted_total,
-                        GError **error) {
+static gboolean do_apply_discount(const char *id,
+                                  int qty,
+                                  double discount_percent,
+                                  Money *discounted_total,
+                                  GError **error) {
     /* Check: discount must be 10-20% */
     if (discount_percent < 10.0 || discount_percent > 20.0) {
         g_set_error(error, g_quark_from_static_string("logic"), 10,
@@ -207,21 +1083,41 @@ gboolean apply_discount(const char *id,
     }
 
     /* Find the product */
-    Product *p = find_product_by_id(id);
+    g_rw_lock_reader_lock(&inventory_lock);
+    Product *p = lookup(id);
     if (!p) {
+        g_rw_lock_reader_unlock(&inventory_lock);
         g_set_error(error, g_quark_from_static_string("logic"), 12,
                     "Product not found");
         return FALSE;
     }
 
     /* Calculate: first get normal total, then apply discount */
-    double total = p->price * qty;  /* Normal price */
-    double final = total * (1.0 - discount_percent / 100.0);  /* With discount */
+    /* Work in hundredths of a percent so it stays whole numbers (12.5% = 1250) */
+    gint64 basis_points = (gint64)(discount_percent * 100.0 + 0.5);
+    Money total = p->price * qty;  /* Normal price */
+    Money off = (total * basis_points + 5000) / 10000;  /* Discount, rounded to the nearest cent */
+    Money final = total - off;  /* With discount */
     if (discounted_total) *discounted_total = final;  /* Return the discounted price */
 
     /* Save to history */
-    record_history("DISCOUNT", p, 0, final, "Applied discount");
+    queue_history(HISTORY_OP_DISCOUNT, p, 0, final, "Applied discount");
+    g_rw_lock_reader_unlock(&inventory_lock);
+    storage_journal_commit();
     return TRUE;
 }
 
+gboolean apply_discount(const char *id,
+                        int qty,
+                        double discount_percent,
+                        Money *discounted_total,
+                        GError **error) {
+    TRACE_BEGIN("apply_discount");
+    METRIC_START(start);
+    gboolean ok = do_apply_discount(id, qty, discount_percent, discounted_total, error);
+    METRIC_STOP(METRIC_APPLY_DISCOUNT, start, ok);
+    TRACE_END("apply_discount");
+    return ok;
+}
+
 
@@ -6,28 +6,105 @@
 
 /* This file has all the business logic - the actual work functions */
 /* Like adding products, selling, updating stock, etc. */
+/* */
+/* All of them can be called from several threads at once. Lookups only take */
+/* read locks, and changes to different products use different locks (see */
+/* logic.c). A Product pointer you get back stays valid until someone removes */
+/* that product - the app and the server only remove on the main thread. */
 
 /* Find a product by its ID */
 Product *find_product_by_id(const char *id);
 
+/* Put an already filled-in product into the list and the ID index */
+/* storage.c uses this when loading so the index never gets out of sync */
+gboolean insert_product(Product *p);
+/* Same, but a product with the same ID is replaced instead of refused */
+/* Loading products.delta uses these two (no history, nothing is marked changed) */
+void replace_product(Product *p);
+gboolean drop_product(const char *id);  /* FALSE if there was no such product */
+
 /* Functions to manage products */
 gboolean add_product(const char *id, const char *name, const char *category,
-                     double price, int quantity, GError **error);  /* Add a new product */
+                     Money price, int quantity, GError **error);  /* Add a new product */
 gboolean update_stock(const char *id, int add_qty, GError **error);  /* Add more stock (must be > 5) */
-gboolean sell_product(const char *id, int qty, double *total, GError **error);  /* Sell some products */
+gboolean sell_product(const char *id, int qty, Money *total, GError **error);  /* Sell some products */
 gboolean remove_product(const char *id, GError **error);  /* Delete a product */
 
+/* One line of a transaction: sell qty (HISTORY_OP_SELL) or add qty to the stock */
+/* (HISTORY_OP_UPDATE, must be > 5 like update_stock). An ID can be in several lines */
+typedef struct {
+    const char *id;
+    HistoryOp op;
+    int qty;
+} TxnLine;
+
+/* Sell/restock a whole basket: either every line goes through or none does */
+/* (the error says which line failed, with the same code as the single function) */
+/* The history entries are added together and share one transaction number */
+/* (HistoryEntry.txn), and reach history.csv in one write. total = what the */
+/* sold lines cost, txn = the transaction number - both can be NULL */
+gboolean run_transaction(const TxnLine *lines, guint n, Money *total, guint32 *txn,
+                         GError **error);
+
 /* Functions to check things */
 int get_stock_level(const char *id, int *out_qty, GError **error);  /* Check how many we have */
-double compute_total_stock_value(void);  /* Calculate total money value of all stock */
+gboolean lookup_product(const char *id, Product *copy, GError **error);  /* Copy one product */
+Money compute_total_stock_value(void);  /* Calculate total money value of all stock */
+
+/* Running totals - these are kept up to date by every change, so they cost nothing to read */
+gint64 compute_total_sold(void);  /* How many units we've sold in total */
+guint get_best_sellers(Product **out, guint max);  /* Top sellers, best first - returns how many */
+gboolean verify_aggregates(void);  /* Recount everything and compare (for debugging) */
+void clear_aggregates(void);  /* Forget the totals (call before freeing the products) */
+
+/* Category functions - each one only costs as much as the category is big */
+Category *find_category(const char *name);  /* NULL if no product has this category */
+GPtrArray *get_categories(void);  /* All categories by name - free with g_ptr_array_free(list, TRUE) */
+guint get_low_stock_in_category(const Category *c, Product **out, guint max);  /* Returns how many */
+/* A category's running totals (they change under sales, so don't read the fields) */
+void get_category_totals(const Category *c, Money *stock_value, gint64 *quantity,
+                         gint64 *sold, guint *low_stock);
 
 /* Discount function */
 gboolean apply_discount(const char *id, int qty, double discount_percent,
-                       double *discounted_total, GError **error);  /* Apply discount (10-20%) */
+                       Money *discounted_total, GError **error);  /* Apply discount (10-20%) */
+
+/* Change notifications, so the UI can update only the rows that changed */
+/* Only the functions above send them (on the main thread) - the loaders */
+/* don't, the UI refreshes everything once loading is done */
+typedef enum {
+    STOCK_CHANGE_PRODUCT_ADDED,    /* position = the new product's slot */
+    STOCK_CHANGE_PRODUCT_CHANGED,  /* position = slot of a product whose numbers changed */
+    STOCK_CHANGE_PRODUCT_REMOVED,  /* position = the slot it had - the last product was moved */
+                                   /* into it (p is still readable during the call) */
+    STOCK_CHANGE_HISTORY_APPENDED  /* position = index of the new entry in history, p = NULL */
+} StockChange;
+typedef void (*StockChangeFunc)(StockChange change, guint position, Product *p,
+                                gpointer user_data);
+void logic_set_change_func(StockChangeFunc func, gpointer user_data);  /* NULL to stop */
+
+/* Hold off adds, removes, sales and new history entries while copying a */
+/* consistent view of everything (report_new) - so keep it short */
+void logic_snapshot_begin(void);
+void logic_snapshot_end(void);
+
+/* How many times a product was added, changed or removed so far */
+/* If it's the same as last time, nothing needs saving (autosave.c) */
+guint logic_change_count(void);
+/* Copy all products at one moment, and the change count that goes with them */
+/* Free the copy with g_free. The copies' category pointers must not be used */
+/* clear_changes = the copy is going to be a full save, so start the list of */
+/* changed products (below) over */
+Product *logic_copy_products(guint *n, guint *change_count, gboolean clear_changes);
+/* Every product added, changed or removed since the last call, as it is now */
+/* (a ProductDelta array - free it with g_array_unref). The list starts over */
+GArray *logic_take_changes(guint *change_count);
+/* Put them back if they couldn't be written, so the next call has them again */
+void logic_requeue_changes(GArray *rows);
 
 /* History function */
-void record_history(const char *operation, const Product *p, int qty_change,
-                    double value_change, const char *description);  /* Save what we did to history */
+void record_history(HistoryOp op, const Product *p, int qty_change,
+                    Money value_change, const char *description);  /* Save what we did to history */
 
 #endif /* LOGIC_H */
 
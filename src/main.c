@@ -1,15 +1,24 @@
 #include <gtk/gtk.h>
 #include "model.h"
-#include "storage.h"
+#include "inventory.h"
 #include "ui_main_window.h"
+#include "metrics.h"
+#include "trace.h"
+#include "autosave.h"
+#ifdef G_OS_UNIX
+#include <signal.h>
+#include <glib-unix.h>
+#endif
 
 /* This is the main file - it starts everything */
 /* It loads data, shows the window, and saves data when closing */
 
-/* These are the global arrays that hold all our data */
-/* I put them here so every file can use them */
-GPtrArray *products = NULL;  /* List of all products */
-GPtrArray *history = NULL;   /* List of all history */
+/* How often the history journal is fsync'ed, in milliseconds */
+/* Can be changed with the STOCK_FSYNC_INTERVAL_MS environment variable (0 = every entry) */
+#define DEFAULT_FSYNC_INTERVAL_MS 1000
+
+/* Where the data files are (the lists themselves live in inventory.c) */
+#define DATA_DIR "data"
 
 /* This function sets up the colors and styling */
 /* CSS is like HTML styling - makes things look nice */
@@ -35,6 +44,9 @@ static void setup_css(void) {
         "label.section-title {"
         "  font-weight: bold;"
         "  padding: 4px 0;"
+        "}"
+        "label.low-stock {"
+        "  color: red;"
         "}";
 
     GtkCssProvider *provider = gtk_css_provider_new();
@@ -49,75 +61,164 @@ static void setup_css(void) {
     g_object_unref(provider);
 }
 
-/* This function runs when the app starts */
-/* It loads data from files and shows the window */
-static void on_activate(GtkApplication *app, gpointer user_data) {
-    /* Create empty lists for products and history */
-    products = g_ptr_array_new();
-    history = g_ptr_array_new();
+/* Loading happens on a worker thread in two steps: products, then history */
+/* The worker only touches the list it is loading, and the UI doesn't read that */
+/* list until the step is done (the buttons that need it are disabled) */
 
-    /* Set up the colors and styling */
-    setup_css();
+/* Worker thread: load products (touches only products and product_index) */
+static void load_products_thread(GTask *task, gpointer source_object,
+                                 gpointer task_data, GCancellable *cancellable) {
+    GError *err = NULL;
+    trace_set_thread_name("loader");
+    TRACE_BEGIN("load_products");
+    gboolean ok = inventory_load_products(DATA_DIR, &err);
+    TRACE_END("load_products");
+    if (!ok) {
+        g_task_return_error(task, err);
+        return;
+    }
+    g_task_return_boolean(task, TRUE);
+}
+
+/* Worker thread: load history (touches only history) */
+static void load_history_thread(GTask *task, gpointer source_object,
+                                gpointer task_data, GCancellable *cancellable) {
+    GError *err = NULL;
+    trace_set_thread_name("loader");
+    TRACE_BEGIN("load_history");
+    gboolean ok = inventory_load_history(DATA_DIR, &err);
+    TRACE_END("load_history");
+    if (!ok) {
+        g_task_return_error(task, err);
+        return;
+    }
+    g_task_return_boolean(task, TRUE);
+}
 
-    /* Try to load data from CSV files */
-    /* If files don't exist, that's OK - first time running */
-    /* Create data folder if it doesn't exist */
-    g_mkdir_with_parents("data", 0755);
-    
+/* Back on the main thread: history is in, so everything can be used now */
+static void on_history_loaded(GObject *source, GAsyncResult *res, gpointer user_data) {
+    GtkApplication *app = GTK_APPLICATION(user_data);
     GError *err = NULL;
-    storage_load_products("data/products.csv", &err);
-    if (err) {
+    if (!g_task_propagate_boolean(G_TASK(res), &err)) {
+        g_warning("Error loading history: %s", err->message);
+        g_clear_error(&err);
+    }
+
+    /* From now on every history entry is appended to history.csv as it happens */
+    guint fsync_ms = DEFAULT_FSYNC_INTERVAL_MS;
+    const char *env = g_getenv("STOCK_FSYNC_INTERVAL_MS");
+    if (env && *env) {
+        fsync_ms = (guint)g_ascii_strtoull(env, NULL, 10);
+    }
+    TRACE_BEGIN("open_journal");
+    if (!inventory_open_journal(DATA_DIR, fsync_ms, &err)) {
+        g_warning("Error opening history journal: %s", err->message);
+        g_clear_error(&err);
+    }
+    TRACE_END("open_journal");
+    /* Products get saved in the background too (STOCK_AUTOSAVE_INTERVAL_MS, 0 = off) */
+    autosave_start(DATA_DIR, autosave_interval_from_env());
+
+    ui_refresh_history_view();
+    ui_show_loading(NULL);
+    ui_set_actions_enabled(TRUE, TRUE);
+    TRACE_END("startup");  /* Began in on_activate */
+    g_application_release(G_APPLICATION(app));  /* Matches the hold in on_activate */
+}
+
+/* Back on the main thread: show the products, then start on history */
+static void on_products_loaded(GObject *source, GAsyncResult *res, gpointer user_data) {
+    GError *err = NULL;
+    if (!g_task_propagate_boolean(G_TASK(res), &err)) {
         g_warning("Error loading products: %s", err->message);
         g_clear_error(&err);
     }
-    storage_load_history("data/history.csv", &err);
-    if (err) {
-        g_warning("Error loading history: %s", err->message);
+
+    ui_refresh_products_table();
+    /* Looking at products is fine now, changing anything still has to wait */
+    ui_set_actions_enabled(TRUE, FALSE);
+    ui_show_loading("Loading history...");
+
+    GTask *task = g_task_new(NULL, NULL, on_history_loaded, user_data);
+    g_task_run_in_thread(task, load_history_thread);
+    g_object_unref(task);
+}
+
+/* Write the operation timings to data/metrics.txt (see metrics.h) */
+static void dump_metrics(void) {
+    char *path = g_build_filename(DATA_DIR, METRICS_FILE, NULL);
+    GError *err = NULL;
+    if (!metrics_dump(path, &err)) {
+        g_warning("%s", err->message);
         g_clear_error(&err);
     }
+    g_free(path);
+}
+
+#ifdef G_OS_UNIX
+/* kill -USR1 <pid> dumps the timings while the app keeps running */
+static gboolean on_dump_signal(gpointer user_data) {
+    dump_metrics();
+    return G_SOURCE_CONTINUE;
+}
+#endif
+
+/* This function runs when the app starts */
+/* It shows the window right away and loads the data in the background */
+static void on_activate(GtkApplication *app, gpointer user_data) {
+    TRACE_BEGIN("startup");
+    /* Create empty lists for products and history (and the data folder) */
+    inventory_init(DATA_DIR);
+
+    /* Set up the colors and styling */
+    TRACE_BEGIN("setup_css");
+    setup_css();
+    TRACE_END("setup_css");
+#ifdef G_OS_UNIX
+    g_unix_signal_add(SIGUSR1, on_dump_signal, NULL);
+#endif
 
-    /* Create the main window and show it */
+    /* Create the main window and show it - it starts out empty */
     GtkWidget *window = ui_create_main_window(app);
+    ui_set_actions_enabled(FALSE, FALSE);
+    ui_show_loading("Loading products...");
     gtk_window_present(GTK_WINDOW(window));
+
+    /* Keep the app alive until loading is done, even if the window gets closed, */
+    /* so on_shutdown never runs while a worker is still filling the lists */
+    g_application_hold(G_APPLICATION(app));
+
+    /* Try to load data from the files (if they don't exist, that's OK - first time running) */
+    GTask *task = g_task_new(NULL, NULL, on_products_loaded, app);
+    g_task_run_in_thread(task, load_products_thread);
+    g_object_unref(task);
 }
 
 /* This function runs when the app closes */
 /* It saves everything to files and frees memory */
 static void on_shutdown(GApplication *app, gpointer user_data) {
-    /* Save all data to CSV files so we don't lose it */
+    /* Save all data to files so we don't lose it */
     GError *err = NULL;
-    storage_save_products("data/products.csv", &err);
-    if (err) {
-        g_warning("Error saving products: %s", err->message);
-        g_clear_error(&err);
-    }
-
-    storage_save_history("data/history.csv", &err);
-    if (err) {
-        g_warning("Error saving history: %s", err->message);
+    TRACE_BEGIN("shutdown");
+    autosave_stop();  /* Waits if it's in the middle of a save */
+    TRACE_BEGIN("inventory_save");
+    if (!inventory_save(DATA_DIR, &err)) {
+        g_warning("%s", err->message);
         g_clear_error(&err);
     }
-
-    /* Free all the product memory */
-    if (products) {
-        for (guint i = 0; i < products->len; i++) {
-            g_free(g_ptr_array_index(products, i));  /* Free each product */
-        }
-        g_ptr_array_free(products, TRUE);  /* Free the array itself */
-        products = NULL;
-    }
-    /* Free all the history memory */
-    if (history) {
-        for (guint i = 0; i < history->len; i++) {
-            g_free(g_ptr_array_index(history, i));  /* Free each history entry */
-        }
-        g_ptr_array_free(history, TRUE);  /* Free the array itself */
-        history = NULL;
-    }
+    TRACE_END("inventory_save");
+    dump_metrics();  /* After saving, so the save times are in it */
+    TRACE_BEGIN("inventory_free");
+    inventory_free();
+    TRACE_END("inventory_free");
+    TRACE_END("shutdown");
 }
 
 /* This is where the program starts - the main function */
 int main(int argc, char **argv) {
+    /* STOCK_TRACE=trace.json records startup and shutdown for Perfetto (see trace.h) */
+    trace_start_from_env();
+
     /* Create the GTK application */
     GtkApplication *app = gtk_application_new("com.example.stockmanager",
                                               G_APPLICATION_FLAGS_NONE);
@@ -131,6 +232,11 @@ int main(int argc, char **argv) {
     int status = g_application_run(G_APPLICATION(app), argc, argv);
     /* Clean up */
     g_object_unref(app);
+    GError *err = NULL;
+    if (!trace_stop(&err)) {
+        g_warning("%s", err->message);
+        g_clear_error(&err);
+    }
     return status;  /* Return 0 if OK, non-zero if error */
 }
 
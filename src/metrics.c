@@ -0,0 +1,212 @@
+#include "metrics.h"
+#include <string.h>
+#include <time.h>
+#ifdef G_OS_WIN32
+#include <windows.h>
+#endif
+
+/* Bucket b < 16 holds exactly b nanoseconds. After that every doubling */
+/* (16-31, 32-63, ...) is split into 8 equal buckets, up to 2^63 ns */
+#define METRIC_EXACT_BUCKETS 16
+#define METRIC_SUB_BITS 3
+#define METRIC_BUCKETS (METRIC_EXACT_BUCKETS + (63 - 4) * (1 << METRIC_SUB_BITS))
+
+static const char *const metric_names[METRIC_COUNT] = {
+    [METRIC_ADD_PRODUCT] = "add_product",
+    [METRIC_UPDATE_STOCK] = "update_stock",
+    [METRIC_SELL_PRODUCT] = "sell_product",
+    [METRIC_REMOVE_PRODUCT] = "remove_product",
+    [METRIC_APPLY_DISCOUNT] = "apply_discount",
+    [METRIC_TRANSACTION] = "run_transaction",
+    [METRIC_LOAD_PRODUCTS] = "storage_load_products",
+    [METRIC_LOAD_HISTORY] = "storage_load_history",
+    [METRIC_SAVE_PRODUCTS] = "storage_save_products",
+    [METRIC_SAVE_HISTORY] = "storage_save_history",
+    [METRIC_LOAD_PRODUCT_DELTA] = "storage_load_delta",
+    [METRIC_SAVE_PRODUCT_DELTA] = "storage_append_delta",
+    [METRIC_JOURNAL_FLUSH] = "storage_journal_flush",
+    [METRIC_SNAPSHOT_LOAD_PRODUCTS] = "snapshot_load_products",
+    [METRIC_SNAPSHOT_LOAD_HISTORY] = "snapshot_load_history",
+    [METRIC_SNAPSHOT_SAVE_PRODUCTS] = "snapshot_save_products",
+    [METRIC_SNAPSHOT_SAVE_HISTORY] = "snapshot_save_history",
+    [METRIC_UI_PRODUCTS_REFRESH] = "ui_products_refresh",
+    [METRIC_UI_PRODUCTS_FLUSH] = "ui_products_flush",
+    [METRIC_UI_HISTORY_REFRESH] = "ui_history_refresh",
+    [METRIC_UI_HISTORY_FLUSH] = "ui_history_flush",
+};
+
+const char *metrics_name(MetricId id) {
+    return id < METRIC_COUNT ? metric_names[id] : "?";
+}
+
+gint64 metrics_now(void) {
+#ifdef G_OS_WIN32
+    static LARGE_INTEGER freq;  /* Ticks per second, never changes */
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (gint64)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+#ifndef STOCK_NO_METRICS
+
+typedef struct {
+    gint buckets[METRIC_BUCKETS];  /* Calls per time bucket */
+    gint failed;
+    gsize total_ns;    /* Pointer sized so g_atomic_pointer_add works on it */
+    gpointer max_ns;   /* A gsize really, kept in a pointer for the compare-and-swap */
+} Metric;
+
+static Metric metrics[METRIC_COUNT];
+
+/* Index of the highest set bit (v > 0) */
+static guint top_bit(guint64 v) {
+#ifdef __GNUC__
+    return 63 - (guint)__builtin_clzll(v);
+#else
+    guint bit = 0;
+    while (v >>= 1) bit++;
+    return bit;
+#endif
+}
+
+static guint bucket_of(gint64 ns) {
+    if (ns < METRIC_EXACT_BUCKETS) return ns < 0 ? 0 : (guint)ns;
+    guint bit = top_bit((guint64)ns);  /* At least 4 */
+    guint sub = (guint)((guint64)ns >> (bit - METRIC_SUB_BITS)) & ((1 << METRIC_SUB_BITS) - 1);
+    return METRIC_EXACT_BUCKETS + (bit - 4) * (1 << METRIC_SUB_BITS) + sub;
+}
+
+/* The largest time that lands in bucket b */
+static gint64 bucket_top(guint b) {
+    if (b < METRIC_EXACT_BUCKETS) return b;
+    guint bit = (b - METRIC_EXACT_BUCKETS) / (1 << METRIC_SUB_BITS) + 4;
+    guint sub = (b - METRIC_EXACT_BUCKETS) % (1 << METRIC_SUB_BITS);
+    guint64 width = G_GUINT64_CONSTANT(1) << (bit - METRIC_SUB_BITS);
+    return (gint64)(((1 << METRIC_SUB_BITS) + sub + 1) * width - 1);
+}
+
+void metrics_record(MetricId id, gint64 ns, gboolean ok) {
+    Metric *m = &metrics[id];
+    if (ns < 0) ns = 0;
+    g_atomic_int_inc(&m->buckets[bucket_of(ns)]);
+    if (!ok) g_atomic_int_inc(&m->failed);
+    g_atomic_pointer_add(&m->total_ns, (gssize)ns);
+    /* Only the rare new record pays for the compare-and-swap loop */
+    gpointer max = g_atomic_pointer_get(&m->max_ns);
+    while ((gsize)ns > GPOINTER_TO_SIZE(max)) {
+        if (g_atomic_pointer_compare_and_exchange(&m->max_ns, max, GSIZE_TO_POINTER(ns))) break;
+        max = g_atomic_pointer_get(&m->max_ns);
+    }
+}
+
+gboolean metrics_enabled(void) {
+    return TRUE;
+}
+
+void metrics_get(MetricId id, MetricStats *out) {
+    memset(out, 0, sizeof(*out));
+    if (id >= METRIC_COUNT) return;
+    Metric *m = &metrics[id];
+
+    /* Copy the buckets first: other threads may still be adding */
+    gint counts[METRIC_BUCKETS];
+    for (guint b = 0; b < METRIC_BUCKETS; b++) {
+        counts[b] = g_atomic_int_get(&m->buckets[b]);
+        out->count += (guint)counts[b];
+    }
+    out->failed = (guint)g_atomic_int_get(&m->failed);
+    out->total_ns = (gint64)(gsize)g_atomic_pointer_get(&m->total_ns);
+    out->max_ns = (gint64)GPOINTER_TO_SIZE(g_atomic_pointer_get(&m->max_ns));
+    if (out->count == 0) return;
+
+    /* Walk up the buckets until half (and then 99%) of the calls are behind us */
+    guint64 half = (out->count + 1) / 2, most = out->count - out->count / 100, seen = 0;
+    for (guint b = 0; b < METRIC_BUCKETS; b++) {
+        if (counts[b] == 0) continue;
+        seen += (guint)counts[b];
+        if (out->p50_ns == 0 && seen >= half) out->p50_ns = MIN(bucket_top(b), out->max_ns);
+        if (seen >= most) {
+            out->p99_ns = MIN(bucket_top(b), out->max_ns);
+            break;
+        }
+    }
+}
+
+void metrics_reset(void) {
+    for (guint id = 0; id < METRIC_COUNT; id++) {
+        Metric *m = &metrics[id];
+        for (guint b = 0; b < METRIC_BUCKETS; b++) g_atomic_int_set(&m->buckets[b], 0);
+        g_atomic_int_set(&m->failed, 0);
+        g_atomic_pointer_set(&m->total_ns, 0);
+        g_atomic_pointer_set(&m->max_ns, NULL);
+    }
+}
+
+/* 850 ns, 12.3 us, 4.56 ms, 1.20 s */
+static void append_duration(GString *out, gint64 ns) {
+    char buf[32];
+    if (ns < 1000) g_snprintf(buf, sizeof(buf), "%" G_GINT64_FORMAT " ns", ns);
+    else if (ns < 1000000) g_snprintf(buf, sizeof(buf), "%.1f us", ns / 1e3);
+    else if (ns < 1000000000) g_snprintf(buf, sizeof(buf), "%.2f ms", ns / 1e6);
+    else g_snprintf(buf, sizeof(buf), "%.2f s", ns / 1e9);
+    g_string_append_printf(out, " %10s", buf);
+}
+
+void metrics_format(GString *out) {
+    g_string_append_printf(out, "%-24s %10s %8s %10s %10s %10s %10s\n", "Operation", "Count",
+                           "Failed", "p50", "p99", "Max", "Total");
+    gboolean any = FALSE;
+    for (guint id = 0; id < METRIC_COUNT; id++) {
+        MetricStats s;
+        metrics_get(id, &s);
+        if (s.count == 0) continue;
+        any = TRUE;
+        g_string_append_printf(out, "%-24s %10" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT,
+                               metrics_name(id), s.count, s.failed);
+        append_duration(out, s.p50_ns);
+        append_duration(out, s.p99_ns);
+        append_duration(out, s.max_ns);
+        append_duration(out, s.total_ns);
+        g_string_append_c(out, '\n');
+    }
+    if (!any) g_string_append(out, "(nothing has run yet)\n");
+}
+
+#else /* STOCK_NO_METRICS */
+
+gboolean metrics_enabled(void) {
+    return FALSE;
+}
+
+void metrics_get(MetricId id, MetricStats *out) {
+    (void)id;
+    memset(out, 0, sizeof(*out));
+}
+
+void metrics_reset(void) {
+}
+
+void metrics_format(GString *out) {
+    g_string_append(out, "Metrics were left out of this build (NO_METRICS=1)\n");
+}
+
+#endif /* STOCK_NO_METRICS */
+
+gboolean metrics_dump(const char *path, GError **error) {
+    GString *out = g_string_new(NULL);
+    GDateTime *now = g_date_time_new_now_local();
+    char *when = g_date_time_format(now, "%Y-%m-%d %H:%M:%S");
+    g_string_append_printf(out, "Stock Manager metrics, %s\n\n", when);
+    metrics_format(out);
+    gboolean ok = g_file_set_contents(path, out->str, (gssize)out->len, error);
+    g_free(when);
+    g_date_time_unref(now);
+    g_string_free(out, TRUE);
+    return ok;
+}
@@ -0,0 +1,78 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <glib.h>
+
+/* This file counts how often the important operations run and how long they take */
+/* Every operation has a histogram of its times. The buckets get wider as the */
+/* times get longer (8 buckets per doubling, so each is at most 12.5% wide), */
+/* which is enough for p50/p99 and only needs a few atomic adds per call. */
+/* Any thread can record at the same time, there are no locks. */
+/* Build with make NO_METRICS=1 to compile the recording out completely. */
+
+typedef enum {
+    /* logic.c */
+    METRIC_ADD_PRODUCT,
+    METRIC_UPDATE_STOCK,
+    METRIC_SELL_PRODUCT,
+    METRIC_REMOVE_PRODUCT,
+    METRIC_APPLY_DISCOUNT,
+    METRIC_TRANSACTION,
+    /* storage.c and snapshot.c */
+    METRIC_LOAD_PRODUCTS,
+    METRIC_LOAD_HISTORY,
+    METRIC_SAVE_PRODUCTS,
+    METRIC_SAVE_HISTORY,
+    METRIC_LOAD_PRODUCT_DELTA,
+    METRIC_SAVE_PRODUCT_DELTA,
+    METRIC_JOURNAL_FLUSH,
+    METRIC_SNAPSHOT_LOAD_PRODUCTS,
+    METRIC_SNAPSHOT_LOAD_HISTORY,
+    METRIC_SNAPSHOT_SAVE_PRODUCTS,
+    METRIC_SNAPSHOT_SAVE_HISTORY,
+    /* The list models behind the main window */
+    METRIC_UI_PRODUCTS_REFRESH,
+    METRIC_UI_PRODUCTS_FLUSH,
+    METRIC_UI_HISTORY_REFRESH,
+    METRIC_UI_HISTORY_FLUSH,
+    METRIC_COUNT
+} MetricId;
+
+/* One operation's numbers, as returned by metrics_get */
+typedef struct {
+    guint64 count;     /* Calls */
+    guint64 failed;    /* Calls that returned an error */
+    gint64 p50_ns;     /* Half the calls were faster than this */
+    gint64 p99_ns;     /* 99% of the calls were faster than this */
+    gint64 max_ns;     /* The slowest call */
+    gint64 total_ns;   /* All calls together */
+} MetricStats;
+
+/* Nanoseconds from a clock that never goes backwards (trace.c uses it too) */
+gint64 metrics_now(void);
+
+#ifndef STOCK_NO_METRICS
+void metrics_record(MetricId id, gint64 ns, gboolean ok);
+
+/* Time a piece of code: */
+/*   METRIC_START(t); ...work...; METRIC_STOP(METRIC_SELL_PRODUCT, t, ok); */
+#define METRIC_START(t) gint64 t = metrics_now()
+#define METRIC_STOP(id, t, ok) metrics_record((id), metrics_now() - (t), (ok))
+#else
+#define METRIC_START(t) G_STMT_START { } G_STMT_END
+#define METRIC_STOP(id, t, ok) G_STMT_START { } G_STMT_END
+#endif
+
+/* These are always there (they report nothing with NO_METRICS) */
+gboolean metrics_enabled(void);
+const char *metrics_name(MetricId id);
+void metrics_get(MetricId id, MetricStats *out);
+void metrics_reset(void);
+/* Append a table of every operation that ran at least once */
+void metrics_format(GString *out);
+/* Write the table to a file (overwrites it) */
+/* The app and "stock_cli serve" write DIR/metrics.txt on SIGUSR1 and when they stop */
+#define METRICS_FILE "metrics.txt"
+gboolean metrics_dump(const char *path, GError **error);
+
+#endif /* METRICS_H */
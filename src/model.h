@@ -3,6 +3,12 @@
 
 #include <glib.h>
 #include <time.h>
+#include "money.h"
+
+/* Products with less than this in stock count as low on stock */
+#define LOW_STOCK_LIMIT 5
+
+typedef struct Category Category;
 
 /* This is the Product struct - basically holds all info about one product */
 /* I made it a struct so I can store multiple products easily */
@@ -10,26 +16,83 @@ typedef struct {
     char id[32];        /* Product ID like "P001" - max 31 characters */
     char name[64];      /* Product name like "Laptop" - max 63 characters */
     char category[32];  /* Category like "Electronics" - max 31 characters */
-    double price;       /* How much one unit costs (like 99.99) */
+    Money price;        /* How much one unit costs, in cents (9999 = 99.99) */
     int quantity;       /* How many we have in stock right now */
     int sold;           /* How many we've sold total (keeps counting up) */
+    guint slot;         /* Where this product sits in the products array (for fast removal) */
+    GSequenceIter *rank;  /* Where this product sits in the best-seller ranking */
+    int rank_sold;      /* sold when the ranking last sorted it (see update_ranking) */
+    gboolean rank_queued;  /* Waiting for update_ranking */
+    Category *cat;      /* The category this product is in (same name as category) */
+    guint cat_slot;     /* Where this product sits in cat->members */
 } Product;
 
+/* One row of a delta checkpoint (products.delta): a product as it is now, */
+/* or just its ID if it was removed (see logic_take_changes) */
+typedef struct {
+    Product product;
+    gboolean removed;
+} ProductDelta;
+
+/* All products with the same category text, plus running totals for just them */
+/* logic.c keeps these up to date, so asking about one category never */
+/* looks at the products in other categories */
+struct Category {
+    char *name;           /* The category text */
+    GPtrArray *members;   /* The products in it (Product.cat_slot says where) */
+    Money stock_value;    /* Sum of price * quantity, in cents */
+    gint64 quantity;      /* Sum of quantity */
+    gint64 sold;          /* Sum of sold */
+    guint low_stock;      /* How many members have quantity < LOW_STOCK_LIMIT */
+};
+
+/* The operations the app itself writes to history */
+/* Any other operation name found in history.csv gets its own number after these */
+typedef enum {
+    HISTORY_OP_ADD = 1,
+    HISTORY_OP_UPDATE,
+    HISTORY_OP_SELL,
+    HISTORY_OP_REMOVE,
+    HISTORY_OP_DISCOUNT,
+    HISTORY_N_OPS  /* First number for the other operation names */
+} HistoryOp;
+
 /* This struct stores history of what we did - like a log file */
 /* Every time we add, sell, or update something, we save it here */
+/* History never stops growing, so it's kept small (32 bytes): the texts are */
+/* numbers into the table in history.c - use history_op_name() and friends */
 typedef struct {
-    time_t timestamp;        /* When this happened (like a date/time) */
-    char operation[16];      /* What we did: "ADD", "SELL", "UPDATE", etc */
-    char product_id[32];     /* Which product was affected */
-    int quantity_change;     /* How much quantity changed (+10 or -5) */
-    double value_change;     /* How much money changed */
-    char description[128];   /* A note about what happened */
+    Money value_change;      /* How much money changed, in cents */
+    guint32 timestamp;       /* When this happened (seconds since 1970 like time_t, */
+                             /* unsigned so it's good until 2106) */
+    gint32 quantity_change;  /* How much quantity changed (+10 or -5) */
+    guint32 op;              /* What we did: a HistoryOp or another operation's number */
+    guint32 product;         /* Which product was affected (its ID's number) */
+    guint32 description;     /* A note about what happened (its number) */
+    guint32 txn;             /* The transaction it was part of (0 = done on its own) */
 } HistoryEntry;
 
+/* History is kept in blocks of HISTORY_BLOCK_SIZE entry pointers instead of */
+/* one GPtrArray. A block never moves once it's made (a GPtrArray gets copied */
+/* somewhere else when it grows), so another thread can read the first n */
+/* entries without a lock while new ones are appended after them (report.c) */
+#define HISTORY_BLOCK_BITS 16
+#define HISTORY_BLOCK_SIZE (1u << HISTORY_BLOCK_BITS)
+#define HISTORY_MAX_BLOCKS (1u << (32 - HISTORY_BLOCK_BITS))
+typedef struct {
+    guint len;  /* How many entries */
+    HistoryEntry **blocks[HISTORY_MAX_BLOCKS];  /* Only made when they're needed */
+} HistoryList;
+
+/* Entry i of a HistoryList (like g_ptr_array_index) */
+#define history_index(list, i) \
+    ((list)->blocks[(guint)(i) >> HISTORY_BLOCK_BITS][(guint)(i) & (HISTORY_BLOCK_SIZE - 1)])
+
 /* These are global arrays - they hold ALL our products and history */
 /* I put them here so every file can access them */
 extern GPtrArray *products;  /* List of all products */
-extern GPtrArray *history;   /* List of all history entries */
+extern HistoryList *history; /* List of all history entries */
+extern GHashTable *product_index;  /* Product ID -> Product, so lookups don't scan the list */
 
 #endif /* MODEL_H */
 
@@ -0,0 +1,65 @@
+#include "money.h"
+#include <string.h>
+
+/* This function reads an amount of money exactly - no doubles involved */
+/* "12.5" -> 1250 cents. More than 2 decimals is an error, not rounded */
+gboolean money_parse(const char *s, gssize len, Money *out) {
+    if (!s) return FALSE;
+    const char *p = s;
+    const char *end = s + (len < 0 ? (gssize)strlen(s) : len);
+
+    /* Skip spaces around the number */
+    while (p < end && g_ascii_isspace(*p)) p++;
+    while (end > p && g_ascii_isspace(end[-1])) end--;
+
+    gboolean negative = FALSE;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    /* Whole units */
+    gint64 units = 0;
+    gboolean any_digits = FALSE;
+    while (p < end && g_ascii_isdigit(*p)) {
+        gint digit = *p - '0';
+        if (units > (G_MAXINT64 / MONEY_SCALE - digit) / 10) return FALSE;  /* Too big */
+        units = units * 10 + digit;
+        any_digits = TRUE;
+        p++;
+    }
+
+    /* Cents - 0, 1 or 2 digits after the point */
+    gint64 cents = 0;
+    if (p < end && *p == '.') {
+        p++;
+        gint places = 0;
+        while (p < end && g_ascii_isdigit(*p)) {
+            if (places == 2) return FALSE;  /* 1.999 isn't a price */
+            cents = cents * 10 + (*p - '0');
+            places++;
+            any_digits = TRUE;
+            p++;
+        }
+        if (places == 1) cents *= 10;  /* "1.5" means 1.50 */
+    }
+
+    if (!any_digits || p != end) return FALSE;  /* Empty, or junk after the number */
+    /* The check above only kept the units in range - with the cents added */
+    /* "92233720368547758.99" would still go past G_MAXINT64 */
+    if (units > (G_MAXINT64 - cents) / MONEY_SCALE) return FALSE;  /* Too big */
+
+    Money value = units * MONEY_SCALE + cents;
+    *out = negative ? -value : value;
+    return TRUE;
+}
+
+/* This function prints cents as units with exactly 2 decimals, like "-3.05" */
+const char *money_format(Money m, char *buf, gsize size) {
+    guint64 abs_value = m < 0 ? (guint64)0 - (guint64)m : (guint64)m;
+    g_snprintf(buf, size, "%s%" G_GUINT64_FORMAT ".%02u",
+               m < 0 ? "-" : "",
+               abs_value / MONEY_SCALE,
+               (guint)(abs_value % MONEY_SCALE));
+    return buf;
+}
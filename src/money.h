@@ -0,0 +1,20 @@
+#ifndef MONEY_H
+#define MONEY_H
+
+#include <glib.h>
+
+/* Money is stored as a whole number of cents, never as a double */
+/* 12.34 is stored as 1234, so adding and saving never loses a cent */
+typedef gint64 Money;
+
+#define MONEY_SCALE 100     /* Cents per unit */
+#define MONEY_BUF_SIZE 32   /* Big enough for any formatted Money */
+
+/* Read an amount like "12", "12.5" or "-0.05" (at most 2 decimals) */
+/* len can be -1 for a normal NUL-terminated string. Returns FALSE if it's not an amount */
+gboolean money_parse(const char *s, gssize len, Money *out);
+
+/* Write an amount as "12.50" into buf and return buf */
+const char *money_format(Money m, char *buf, gsize size);
+
+#endif /* MONEY_H */
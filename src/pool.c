@@ -0,0 +1,116 @@
+#include "pool.h"
+#include <string.h>
+
+/* Records per slab. A history slab is about 1.6 MB, a product slab about 160 KB */
+#define HISTORY_SLAB_ENTRIES 8192
+#define PRODUCT_SLAB_ENTRIES 1024
+
+typedef struct {
+    HistoryEntry *entries;
+    gsize used;      /* Entries handed out so far */
+    gsize capacity;  /* Entries the slab has room for */
+} HistorySlab;
+
+/* A free Product's memory is reused to point at the next free one */
+typedef union ProductCell {
+    Product product;
+    union ProductCell *next_free;
+} ProductCell;
+
+static GArray *history_slabs = NULL;     /* HistorySlab, the last one is being filled */
+static GPtrArray *product_slabs = NULL;  /* ProductCell[PRODUCT_SLAB_ENTRIES] each */
+static gsize product_slab_used = 0;      /* Cells handed out from the last product slab */
+static ProductCell *free_products = NULL;
+
+/* This function cuts count entries out of the last slab, starting a new one if they don't fit */
+HistoryEntry *pool_new_history_block(guint count) {
+    if (!history_slabs) history_slabs = g_array_new(FALSE, FALSE, sizeof(HistorySlab));
+
+    HistorySlab *slab = history_slabs->len > 0
+        ? &g_array_index(history_slabs, HistorySlab, history_slabs->len - 1)
+        : NULL;
+    if (!slab || slab->capacity - slab->used < count) {
+        /* A big snapshot chunk gets a slab of its own size */
+        HistorySlab fresh;
+        fresh.capacity = MAX(count, HISTORY_SLAB_ENTRIES);
+        fresh.entries = g_new(HistoryEntry, fresh.capacity);
+        fresh.used = 0;
+        g_array_append_val(history_slabs, fresh);
+        slab = &g_array_index(history_slabs, HistorySlab, history_slabs->len - 1);
+    }
+
+    HistoryEntry *block = slab->entries + slab->used;
+    slab->used += count;
+    return block;
+}
+
+HistoryEntry *pool_new_history(void) {
+    HistoryEntry *h = pool_new_history_block(1);
+    memset(h, 0, sizeof(*h));
+    return h;
+}
+
+PoolMark pool_history_mark(void) {
+    PoolMark mark = { 0, 0 };
+    if (history_slabs && history_slabs->len > 0) {
+        mark.slabs = history_slabs->len;
+        mark.used = g_array_index(history_slabs, HistorySlab, history_slabs->len - 1).used;
+    }
+    return mark;
+}
+
+/* This function frees the slabs made after the mark and empties the last one back to it */
+void pool_history_rewind(PoolMark mark) {
+    if (!history_slabs) return;
+    for (guint i = mark.slabs; i < history_slabs->len; i++) {
+        g_free(g_array_index(history_slabs, HistorySlab, i).entries);
+    }
+    if (mark.slabs < history_slabs->len) g_array_set_size(history_slabs, mark.slabs);
+    if (mark.slabs > 0) {
+        g_array_index(history_slabs, HistorySlab, mark.slabs - 1).used = mark.used;
+    }
+}
+
+/* This function reuses a freed product if there is one, otherwise takes the next cell */
+Product *pool_new_product(void) {
+    ProductCell *cell = free_products;
+    if (cell) {
+        free_products = cell->next_free;
+    } else {
+        if (!product_slabs) product_slabs = g_ptr_array_new_with_free_func(g_free);
+        if (product_slabs->len == 0 || product_slab_used == PRODUCT_SLAB_ENTRIES) {
+            g_ptr_array_add(product_slabs, g_new(ProductCell, PRODUCT_SLAB_ENTRIES));
+            product_slab_used = 0;
+        }
+        ProductCell *slab = g_ptr_array_index(product_slabs, product_slabs->len - 1);
+        cell = &slab[product_slab_used++];
+    }
+    memset(cell, 0, sizeof(*cell));
+    return &cell->product;
+}
+
+void pool_free_product(Product *p) {
+    if (!p) return;
+    ProductCell *cell = (ProductCell *)p;
+#ifdef STOCK_DEBUG
+    memset(cell, 0xdd, sizeof(*cell));  /* Make use-after-free easy to spot */
+#endif
+    cell->next_free = free_products;
+    free_products = cell;
+}
+
+void pool_free_all(void) {
+    if (history_slabs) {
+        for (guint i = 0; i < history_slabs->len; i++) {
+            g_free(g_array_index(history_slabs, HistorySlab, i).entries);
+        }
+        g_array_free(history_slabs, TRUE);
+        history_slabs = NULL;
+    }
+    if (product_slabs) {
+        g_ptr_array_free(product_slabs, TRUE);
+        product_slabs = NULL;
+    }
+    product_slab_used = 0;
+    free_products = NULL;
+}
@@ -0,0 +1,38 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "model.h"
+
+/* This file hands out the memory for Products and HistoryEntries */
+/* Instead of one malloc per record, records are cut out of big slabs, so */
+/* loading a million history lines is a few hundred mallocs, the records sit */
+/* next to each other in memory, and shutdown frees everything in one go. */
+/* The pools have no locks of their own: logic.c only uses the product pool */
+/* with its inventory lock held for writing and the history pool with its */
+/* history lock held (the loaders run before anything else). */
+
+/* A new zero-filled HistoryEntry. History only grows, so there is no free */
+HistoryEntry *pool_new_history(void);
+
+/* count entries right next to each other (for copying a snapshot chunk in */
+/* with one memcpy). They are NOT zero-filled */
+HistoryEntry *pool_new_history_block(guint count);
+
+/* Remember how much history memory is in use, and later give back */
+/* everything allocated after that point (used when a snapshot turns out bad) */
+typedef struct {
+    guint slabs;  /* How many slabs existed */
+    gsize used;   /* How full the last one was */
+} PoolMark;
+PoolMark pool_history_mark(void);
+void pool_history_rewind(PoolMark mark);
+
+/* A new zero-filled Product. Freed products are reused by the next new one */
+Product *pool_new_product(void);
+void pool_free_product(Product *p);
+
+/* Free every Product and HistoryEntry at once (at shutdown) */
+/* All pointers handed out before are invalid afterwards */
+void pool_free_all(void);
+
+#endif /* POOL_H */
@@ -0,0 +1,113 @@
+#include "report.h"
+#include "logic.h"
+#include <string.h>
+
+extern GPtrArray *products;
+extern HistoryList *history;
+
+/* report_run looks at the cancel button (and updates progress) this often */
+#define REPORT_CHECK_EVERY 65536
+
+static void clear_category(gpointer data) {
+    ReportCategory *c = data;
+    g_free(c->name);
+}
+
+Report *report_new(void) {
+    Report *r = g_new0(Report, 1);
+
+    /* Before the snapshot - the ranking takes the shard locks itself, and the */
+    /* snapshot holds all of them. Products are only removed on this thread, */
+    /* so the pointers are still good below */
+    Product *top[REPORT_TOP_SELLERS];
+    r->n_top = get_best_sellers(top, G_N_ELEMENTS(top));
+
+    logic_snapshot_begin();
+
+    /* All running totals, so copying them doesn't look at any products */
+    /* No sale is half done while the snapshot is held, so they match history_len */
+    r->total_products = products->len;
+    r->stock_value = compute_total_stock_value();
+    r->total_sold = compute_total_sold();
+
+    for (guint i = 0; i < r->n_top; i++) {
+        g_strlcpy(r->top[i].id, top[i]->id, sizeof(r->top[i].id));
+        g_strlcpy(r->top[i].name, top[i]->name, sizeof(r->top[i].name));
+        r->top[i].sold = g_atomic_int_get(&top[i]->sold);
+    }
+
+    GPtrArray *cats = get_categories();
+    r->categories = g_array_sized_new(FALSE, FALSE, sizeof(ReportCategory), cats->len);
+    g_array_set_clear_func(r->categories, clear_category);
+    for (guint i = 0; i < cats->len; i++) {
+        Category *c = g_ptr_array_index(cats, i);
+        ReportCategory rc;
+        rc.name = g_strdup(c->name);
+        rc.products = c->members->len;
+        get_category_totals(c, &rc.stock_value, &rc.quantity, &rc.sold, &rc.low_stock);
+        g_array_append_val(r->categories, rc);
+    }
+    g_ptr_array_free(cats, TRUE);
+
+    /* Only how long history is - its blocks never move, so report_run can */
+    /* read the first history_len entries while more are appended */
+    r->history_len = history->len;
+    logic_snapshot_end();
+
+    r->ops = g_array_new(FALSE, TRUE, sizeof(ReportOp));
+    return r;
+}
+
+static gint compare_ops(gconstpointer a, gconstpointer b) {
+    const ReportOp *oa = a;
+    const ReportOp *ob = b;
+    return oa->op < ob->op ? -1 : oa->op > ob->op ? 1 : 0;
+}
+
+/* This function adds up the history per operation */
+/* Only numbers are used here - the string table belongs to the main thread */
+gboolean report_run(Report *r, GCancellable *cancellable) {
+    GHashTable *slot_of = g_hash_table_new(g_direct_hash, g_direct_equal);  /* op -> index + 1 */
+
+    for (guint i = 0; i < r->history_len; i++) {
+        if (i % REPORT_CHECK_EVERY == 0) {
+            g_atomic_int_set(&r->progress, (gint)i);
+            if (g_cancellable_is_cancelled(cancellable)) {
+                g_hash_table_destroy(slot_of);
+                return FALSE;
+            }
+        }
+        const HistoryEntry *h = history_index(history, i);
+        guint slot = GPOINTER_TO_UINT(g_hash_table_lookup(slot_of, GUINT_TO_POINTER(h->op)));
+        if (slot == 0) {
+            ReportOp op = { h->op, 0, 0, 0 };
+            g_array_append_val(r->ops, op);
+            slot = r->ops->len;
+            g_hash_table_insert(slot_of, GUINT_TO_POINTER(h->op), GUINT_TO_POINTER(slot));
+        }
+        ReportOp *op = &g_array_index(r->ops, ReportOp, slot - 1);
+        op->entries++;
+        op->quantity += h->quantity_change;
+        op->value += h->value_change;
+
+        if (r->first_time == 0 || h->timestamp < r->first_time) r->first_time = h->timestamp;
+        if (h->timestamp > r->last_time) r->last_time = h->timestamp;
+    }
+    g_atomic_int_set(&r->progress, (gint)r->history_len);
+    g_hash_table_destroy(slot_of);
+
+    g_array_sort(r->ops, compare_ops);
+    return TRUE;
+}
+
+double report_progress(Report *r) {
+    if (r->history_len == 0) return 1.0;
+    return (double)g_atomic_int_get(&r->progress) / r->history_len;
+}
+
+void report_free(Report *r) {
+    if (!r) return;
+    g_array_free(r->categories, TRUE);
+    g_array_free(r->ops, TRUE);
+    g_free(r);
+}
@@ -0,0 +1,69 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include "model.h"
+#include <gio/gio.h>
+
+/* This file works out the numbers for the stock report */
+/* report_new takes a snapshot on the main thread: the running totals, best */
+/* sellers and categories are copied (they're small), and for history only */
+/* its length is remembered (entries never change once written, and the */
+/* history blocks never move). report_run then does the slow part on a worker */
+/* thread, only looking at the snapshot, so products and history can keep */
+/* changing meanwhile. */
+
+/* How many best sellers the report lists */
+#define REPORT_TOP_SELLERS 5
+
+typedef struct {
+    char id[32];
+    char name[64];
+    int sold;
+} ReportSeller;
+
+typedef struct {
+    char *name;
+    guint products;
+    gint64 quantity;
+    Money stock_value;
+    gint64 sold;
+    guint low_stock;
+} ReportCategory;
+
+/* History totals for one operation */
+typedef struct {
+    guint32 op;         /* Its string number - history_string(op) is the name */
+    guint64 entries;
+    gint64 quantity;    /* Sum of quantity_change */
+    Money value;        /* Sum of value_change */
+} ReportOp;
+
+typedef struct {
+    /* Copied by report_new */
+    guint total_products;
+    Money stock_value;
+    gint64 total_sold;
+    ReportSeller top[REPORT_TOP_SELLERS];
+    guint n_top;
+    GArray *categories;      /* ReportCategory, by name */
+    guint history_len;       /* The history entries that existed at snapshot time */
+
+    /* Filled in by report_run */
+    GArray *ops;             /* ReportOp, by op number */
+    gint64 first_time;       /* Oldest and newest history timestamps (0 if no history) */
+    gint64 last_time;
+    gint progress;           /* Entries looked at so far - read with report_progress */
+} Report;
+
+/* Main thread: take the snapshot (history must be fully loaded) */
+Report *report_new(void);
+
+/* Any thread: go through the history. Returns FALSE if cancelled */
+gboolean report_run(Report *r, GCancellable *cancellable);
+
+/* 0.0 - 1.0, safe to call while report_run is going */
+double report_progress(Report *r);
+
+void report_free(Report *r);
+
+#endif /* REPORT_H */
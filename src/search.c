@@ -0,0 +1,188 @@
+#include "search.h"
+#include "logic.h"
+#include <string.h>
+
+/* Names are indexed by trigrams: every 3 letters in a row ("lap", "apt", */
+/* "pto", ... for "Laptop"). A name contains the search text only if it has */
+/* all of the text's trigrams, so we take the shortest list among them and */
+/* check just those products. IDs and names are also kept sorted, so a */
+/* "starts with" search is a jump to the first match plus a short walk */
+static GHashTable *trigrams = NULL;  /* Trigram -> GPtrArray of products whose name has it */
+static GSequence *by_id = NULL;      /* All products by ID (case ignored) */
+static GSequence *by_name = NULL;    /* All products by name (case ignored), then ID */
+
+/* Trigrams are 3 lower-case bytes packed into a number */
+#define TRIGRAM(s) ((guint)(guchar)g_ascii_tolower((s)[0]) << 16 | \
+                    (guint)(guchar)g_ascii_tolower((s)[1]) << 8 | \
+                    (guint)(guchar)g_ascii_tolower((s)[2]))
+
+/* Search keys are passed to the sorted lists as a fake product (see */
+/* find_first). On a tie the key goes first, so the search lands on the */
+/* first real match */
+static gint compare_ids(gconstpointer a, gconstpointer b, gpointer key) {
+    const Product *pa = a;
+    const Product *pb = b;
+    int r = g_ascii_strcasecmp(pa->id, pb->id);
+    if (r != 0) return r;
+    if (a == key) return -1;
+    if (b == key) return 1;
+    return strcmp(pa->id, pb->id);
+}
+
+static gint compare_names(gconstpointer a, gconstpointer b, gpointer key) {
+    const Product *pa = a;
+    const Product *pb = b;
+    int r = g_ascii_strcasecmp(pa->name, pb->name);
+    if (r != 0) return r;
+    if (a == key) return -1;
+    if (b == key) return 1;
+    return strcmp(pa->id, pb->id);
+}
+
+/* Case-insensitive strstr */
+static gboolean contains_text(const char *haystack, const char *needle, size_t len) {
+    for (const char *s = haystack; *s; s++) {
+        if (g_ascii_strncasecmp(s, needle, len) == 0) return TRUE;
+    }
+    return len == 0;
+}
+
+static void free_posting(gpointer data) {
+    g_ptr_array_free(data, TRUE);
+}
+
+static void ensure_indexes(void) {
+    if (trigrams) return;
+    trigrams = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_posting);
+    by_id = g_sequence_new(NULL);
+    by_name = g_sequence_new(NULL);
+}
+
+void search_add(Product *p) {
+    ensure_indexes();
+    g_sequence_insert_sorted(by_id, p, compare_ids, NULL);
+    g_sequence_insert_sorted(by_name, p, compare_names, NULL);
+
+    size_t len = strlen(p->name);
+    for (size_t i = 0; i + 3 <= len; i++) {
+        gpointer key = GUINT_TO_POINTER(TRIGRAM(p->name + i));
+        GPtrArray *list = g_hash_table_lookup(trigrams, key);
+        if (!list) {
+            list = g_ptr_array_new();
+            g_hash_table_insert(trigrams, key, list);
+        }
+        /* A trigram twice in one name ("banana") is listed once */
+        if (list->len == 0 || g_ptr_array_index(list, list->len - 1) != p) {
+            g_ptr_array_add(list, p);
+        }
+    }
+}
+
+/* Removing is rare (the product is deleted), so a walk down each of its */
+/* trigram lists is fine here */
+void search_remove(Product *p) {
+    if (!trigrams) return;
+    g_sequence_remove(g_sequence_lookup(by_id, p, compare_ids, NULL));
+    g_sequence_remove(g_sequence_lookup(by_name, p, compare_names, NULL));
+
+    size_t len = strlen(p->name);
+    for (size_t i = 0; i + 3 <= len; i++) {
+        gpointer key = GUINT_TO_POINTER(TRIGRAM(p->name + i));
+        GPtrArray *list = g_hash_table_lookup(trigrams, key);
+        if (!list || !g_ptr_array_remove_fast(list, p)) continue;  /* Repeated trigram */
+        if (list->len == 0) g_hash_table_remove(trigrams, key);
+    }
+}
+
+void search_clear(void) {
+    if (!trigrams) return;
+    g_hash_table_destroy(trigrams);
+    g_sequence_free(by_id);
+    g_sequence_free(by_name);
+    trigrams = NULL;
+    by_id = NULL;
+    by_name = NULL;
+}
+
+gboolean search_matches(const Product *p, const char *text) {
+    size_t len = strlen(text);
+    if (g_ascii_strncasecmp(p->id, text, len) == 0) return TRUE;
+    if (len < 3) {
+        if (g_ascii_strncasecmp(p->name, text, len) == 0) return TRUE;
+    } else if (contains_text(p->name, text, len)) {
+        return TRUE;
+    }
+    return contains_text(p->category, text, len);
+}
+
+/* This function walks a sorted list from the first entry starting with */
+/* text, adding every product until one doesn't start with it anymore */
+static void add_prefix_matches(GSequence *seq, GCompareDataFunc cmp, gboolean by_ids,
+                               const char *text, GHashTable *found) {
+    Product key;
+    size_t field = by_ids ? sizeof(key.id) : sizeof(key.name);
+    size_t len = strlen(text);
+    if (len >= field) return;  /* Longer than any value can be */
+
+    memset(&key, 0, sizeof(key));
+    g_strlcpy(by_ids ? key.id : key.name, text, field);
+    GSequenceIter *it = g_sequence_search(seq, &key, cmp, &key);
+    for (; !g_sequence_iter_is_end(it); it = g_sequence_iter_next(it)) {
+        Product *p = g_sequence_get(it);
+        if (g_ascii_strncasecmp(by_ids ? p->id : p->name, text, len) != 0) break;
+        g_hash_table_add(found, p);
+    }
+}
+
+/* This function checks the products in the shortest trigram list of text */
+static void add_name_matches(const char *text, GHashTable *found) {
+    size_t len = strlen(text);
+    GPtrArray *best = NULL;
+    for (size_t i = 0; i + 3 <= len; i++) {
+        GPtrArray *list = g_hash_table_lookup(trigrams, GUINT_TO_POINTER(TRIGRAM(text + i)));
+        if (!list) return;  /* No name has this trigram, so no name has the text */
+        if (!best || list->len < best->len) best = list;
+    }
+    for (guint i = 0; i < best->len; i++) {
+        Product *p = g_ptr_array_index(best, i);
+        if (contains_text(p->name, text, len)) g_hash_table_add(found, p);
+    }
+}
+
+/* Categories are few compared to products, so checking all their names is cheap */
+static void add_category_matches(const char *text, GHashTable *found) {
+    size_t len = strlen(text);
+    GPtrArray *cats = get_categories();
+    for (guint i = 0; i < cats->len; i++) {
+        Category *c = g_ptr_array_index(cats, i);
+        if (!contains_text(c->name, text, len)) continue;
+        for (guint j = 0; j < c->members->len; j++) {
+            g_hash_table_add(found, g_ptr_array_index(c->members, j));
+        }
+    }
+    g_ptr_array_free(cats, TRUE);
+}
+
+GPtrArray *search_products(const char *text) {
+    GPtrArray *result = g_ptr_array_new();
+    if (!trigrams || !text[0]) return result;
+
+    /* A product can match in more than one way - the set keeps it once */
+    GHashTable *found = g_hash_table_new(g_direct_hash, g_direct_equal);
+    add_prefix_matches(by_id, compare_ids, TRUE, text, found);
+    if (strlen(text) < 3) {
+        add_prefix_matches(by_name, compare_names, FALSE, text, found);
+    } else {
+        add_name_matches(text, found);
+    }
+    add_category_matches(text, found);
+
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, found);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        g_ptr_array_add(result, key);
+    }
+    g_hash_table_destroy(found);
+    return result;
+}
@@ -0,0 +1,26 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "model.h"
+#include <glib.h>
+
+/* This file finds products by text, for the search bar */
+/* A product matches if (ignoring upper/lower case): */
+/* - its ID starts with the text, or */
+/* - its name contains the text (1-2 letters: starts with it), or */
+/* - its category contains the text */
+/* The indexes are kept up to date by logic.c, so a search only looks at */
+/* products that can match instead of all of them */
+
+void search_add(Product *p);     /* logic.c calls this for every new product */
+void search_remove(Product *p);  /* ...and this before a product goes away */
+void search_clear(void);         /* Forget everything (with clear_aggregates) */
+
+/* Does one product match? (same rules as search_products) */
+gboolean search_matches(const Product *p, const char *text);
+
+/* All products that match, in no special order */
+/* Free with g_ptr_array_free(list, TRUE) */
+GPtrArray *search_products(const char *text);
+
+#endif /* SEARCH_H */
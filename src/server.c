@@ -0,0 +1,288 @@
+#include "server.h"
+#include "logic.h"
+#include "metrics.h"
+#include <string.h>
+#include <signal.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#ifdef G_OS_UNIX
+#include <gio/gunixsocketaddress.h>
+#include <glib-unix.h>
+#endif
+
+/* How much we read from a client at once */
+#define SERVER_READ_SIZE (64 * 1024)
+/* A line longer than this can't be a real request - drop the client */
+#define SERVER_MAX_LINE 1024
+/* Most items in one basket (B) request - more can't fit in a line anyway */
+#define SERVER_MAX_BASKET 64
+
+#ifdef G_OS_UNIX
+
+/* One connected client */
+/* Only one read or one write is going on at a time: read whatever arrived, */
+/* answer all of it with one write, then read again */
+typedef struct {
+    GSocketConnection *conn;
+    GString *in;   /* Received bytes that aren't a full line yet */
+    GString *out;  /* Answers for the requests we just read */
+    char buf[SERVER_READ_SIZE];
+} Client;
+
+/* Every connected client, so server_run can close them when it stops */
+static GHashTable *clients = NULL;
+/* Cancelled when the server stops - every read and write uses it */
+static GCancellable *server_cancel = NULL;
+
+static void read_more(Client *c);
+
+static void client_free(Client *c) {
+    g_hash_table_remove(clients, c);
+    g_io_stream_close(G_IO_STREAM(c->conn), NULL, NULL);
+    g_object_unref(c->conn);
+    g_string_free(c->in, TRUE);
+    g_string_free(c->out, TRUE);
+    g_free(c);
+}
+
+/* Cut the next space-separated word out of *s (NULL if there's none) */
+static char *next_word(char **s) {
+    char *p = *s;
+    while (*p == ' ') p++;
+    if (!*p) return NULL;
+    char *start = p;
+    while (*p && *p != ' ') p++;
+    if (*p) *p++ = '\0';
+    *s = p;
+    return start;
+}
+
+/* Parse a whole word as a number */
+static gboolean parse_qty(const char *word, int *out) {
+    gint64 v;
+    if (!word || !g_ascii_string_to_signed(word, 10, G_MININT, G_MAXINT, &v, NULL)) {
+        return FALSE;
+    }
+    *out = (int)v;
+    return TRUE;
+}
+
+static void reply_error(GString *out, GError *err) {
+    g_string_append_printf(out, "ERR %d %s\n", err->code, err->message);
+    g_error_free(err);
+}
+
+/* This function runs one request and appends its answer to out */
+/* line has no newline at the end */
+static void handle_request(char *line, GString *out) {
+    GError *err = NULL;
+    char money_buf[MONEY_BUF_SIZE];
+    char *rest = line;
+    char *op = next_word(&rest);
+    char *id = next_word(&rest);
+    int qty = 0;
+
+    if (!op || op[1] != '\0' || !id) {
+        g_string_append(out, "ERR 0 Bad request\n");
+        return;
+    }
+
+    switch (op[0]) {
+    case 'S': {
+        Money total;
+        if (!parse_qty(next_word(&rest), &qty)) break;
+        if (sell_product(id, qty, &total, &err)) {
+            g_string_append_printf(out, "OK %s\n", money_format(total, money_buf,
+                                                                sizeof(money_buf)));
+        } else {
+            reply_error(out, err);
+        }
+        return;
+    }
+    case 'B': {
+        /* A basket: id qty id qty ... - sold together or not at all */
+        TxnLine lines[SERVER_MAX_BASKET];
+        guint n = 0;
+        char *word = id;
+        while (word && n < SERVER_MAX_BASKET) {
+            lines[n].id = word;
+            lines[n].op = HISTORY_OP_SELL;
+            if (!parse_qty(next_word(&rest), &lines[n].qty)) break;
+            n++;
+            word = next_word(&rest);
+        }
+        if (word) break;  /* A missing quantity, or too many items */
+        Money total;
+        guint32 txn;
+        if (run_transaction(lines, n, &total, &txn, &err)) {
+            g_string_append_printf(out, "OK %s %u\n",
+                                   money_format(total, money_buf, sizeof(money_buf)), txn);
+        } else {
+            reply_error(out, err);
+        }
+        return;
+    }
+    case 'R':
+        if (!parse_qty(next_word(&rest), &qty)) break;
+        if (update_stock(id, qty, &err) && get_stock_level(id, &qty, &err) >= 0) {
+            g_string_append_printf(out, "OK %d\n", qty);
+        } else {
+            reply_error(out, err);
+        }
+        return;
+    case 'Q':
+        if (get_stock_level(id, &qty, &err) >= 0) {
+            g_string_append_printf(out, "OK %d\n", qty);
+        } else {
+            reply_error(out, err);
+        }
+        return;
+    case 'L': {
+        Product p;
+        if (lookup_product(id, &p, &err)) {
+            g_string_append_printf(out, "OK %d %s %d %s\n", p.quantity,
+                                   money_format(p.price, money_buf, sizeof(money_buf)),
+                                   p.sold, p.name);
+        } else {
+            reply_error(out, err);
+        }
+        return;
+    }
+    default:
+        break;
+    }
+    g_string_append(out, "ERR 0 Bad request\n");
+}
+
+static void on_written(GObject *source, GAsyncResult *res, gpointer user_data) {
+    Client *c = user_data;
+    if (!g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), res, NULL, NULL)) {
+        client_free(c);  /* The client went away */
+        return;
+    }
+    g_string_truncate(c->out, 0);
+    read_more(c);
+}
+
+static void on_read(GObject *source, GAsyncResult *res, gpointer user_data) {
+    Client *c = user_data;
+    gssize n = g_input_stream_read_finish(G_INPUT_STREAM(source), res, NULL);
+    if (n <= 0) {
+        client_free(c);  /* Closed (or broken) connection */
+        return;
+    }
+    g_string_append_len(c->in, c->buf, n);
+
+    /* Answer every full line we have - a pipelining client sends many at once */
+    gsize start = 0;
+    char *nl;
+    while ((nl = memchr(c->in->str + start, '\n', c->in->len - start)) != NULL) {
+        *nl = '\0';
+        if (nl > c->in->str + start && nl[-1] == '\r') nl[-1] = '\0';
+        handle_request(c->in->str + start, c->out);
+        start = (gsize)(nl - c->in->str) + 1;
+    }
+    g_string_erase(c->in, 0, (gssize)start);
+    if (c->in->len > SERVER_MAX_LINE) {
+        client_free(c);
+        return;
+    }
+
+    if (c->out->len == 0) {
+        read_more(c);  /* Only half a line so far */
+        return;
+    }
+    GOutputStream *out = g_io_stream_get_output_stream(G_IO_STREAM(c->conn));
+    g_output_stream_write_all_async(out, c->out->str, c->out->len, G_PRIORITY_DEFAULT,
+                                    server_cancel, on_written, c);
+}
+
+static void read_more(Client *c) {
+    GInputStream *in = g_io_stream_get_input_stream(G_IO_STREAM(c->conn));
+    g_input_stream_read_async(in, c->buf, sizeof(c->buf), G_PRIORITY_DEFAULT, server_cancel,
+                              on_read, c);
+}
+
+static gboolean on_incoming(GSocketService *service, GSocketConnection *conn,
+                            GObject *source_object, gpointer user_data) {
+    Client *c = g_new0(Client, 1);
+    c->conn = g_object_ref(conn);
+    c->in = g_string_sized_new(SERVER_READ_SIZE);
+    c->out = g_string_sized_new(SERVER_READ_SIZE);
+    g_hash_table_add(clients, c);
+    read_more(c);
+    return TRUE;
+}
+
+static gboolean on_quit_signal(gpointer user_data) {
+    g_main_loop_quit(user_data);
+    return G_SOURCE_CONTINUE;  /* Removed below, after the loop */
+}
+
+/* kill -USR1 <pid> writes the timings so far, without stopping anything */
+static gboolean on_dump_signal(gpointer user_data) {
+    const char *path = user_data;
+    GError *err = NULL;
+    if (!metrics_dump(path, &err)) {
+        g_warning("%s", err->message);
+        g_clear_error(&err);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/* Requests are all handled on this one thread. logic.c has its own locks */
+/* (autosave's worker thread reads the products while we sell), so the */
+/* server doesn't need any */
+gboolean server_run(const char *socket_path, const char *metrics_path, GError **error) {
+    g_unlink(socket_path);  /* Left over from a server that didn't stop cleanly */
+
+    GSocketService *service = g_socket_service_new();
+    GSocketAddress *address = g_unix_socket_address_new(socket_path);
+    gboolean ok = g_socket_listener_add_address(G_SOCKET_LISTENER(service), address,
+                                                G_SOCKET_TYPE_STREAM,
+                                                G_SOCKET_PROTOCOL_DEFAULT,
+                                                NULL, NULL, error);
+    g_object_unref(address);
+    if (!ok) {
+        g_object_unref(service);
+        return FALSE;
+    }
+
+    clients = g_hash_table_new(NULL, NULL);
+    server_cancel = g_cancellable_new();
+    GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+    guint sigint = g_unix_signal_add(SIGINT, on_quit_signal, loop);
+    guint sigterm = g_unix_signal_add(SIGTERM, on_quit_signal, loop);
+    guint sigusr1 = metrics_path ?
+        g_unix_signal_add(SIGUSR1, on_dump_signal, (gpointer)metrics_path) : 0;
+    g_signal_connect(service, "incoming", G_CALLBACK(on_incoming), NULL);
+    g_socket_service_start(service);
+
+    g_main_loop_run(loop);
+
+    g_socket_service_stop(service);
+    g_socket_listener_close(G_SOCKET_LISTENER(service));
+    g_object_unref(service);
+    /* Cancel every client's read or write. Their callbacks free them, so */
+    /* run the loop a bit more until they all have */
+    g_cancellable_cancel(server_cancel);
+    while (g_hash_table_size(clients) > 0) g_main_context_iteration(NULL, TRUE);
+    g_clear_pointer(&clients, g_hash_table_destroy);
+    g_clear_object(&server_cancel);
+    g_source_remove(sigint);
+    g_source_remove(sigterm);
+    if (sigusr1) g_source_remove(sigusr1);
+    g_main_loop_unref(loop);
+    g_unlink(socket_path);
+    return TRUE;
+}
+
+#else
+
+gboolean server_run(const char *socket_path, const char *metrics_path, GError **error) {
+    g_set_error(error, g_quark_from_static_string("server"), 1,
+                "Unix domain sockets are not supported on this system");
+    return FALSE;
+}
+
+#endif /* G_OS_UNIX */
@@ -0,0 +1,26 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <glib.h>
+
+/* This file is the socket server behind "stock_cli serve", so several */
+/* checkout stations can sell from the same store at once. */
+/* */
+/* Clients connect to a Unix domain socket and send one request per line: */
+/*   S <id> <qty>   sell         -> OK <total price>                     */
+/*   R <id> <qty>   restock      -> OK <new quantity>                    */
+/*   Q <id>         stock level  -> OK <quantity>                        */
+/*   L <id>         lookup       -> OK <quantity> <price> <sold> <name>  */
+/*   B <id> <qty> [<id> <qty> ...]  sell a basket, all or nothing           */
+/*                                -> OK <total price> <transaction number>  */
+/* A failed request gets ERR <code> <message>, with the same code as the */
+/* GError from logic.c. Answers come back in the same order as the */
+/* requests, so a client can send many requests without waiting (pipelining). */
+/* Everything that arrived together is answered with a single write. */
+
+/* Listen on socket_path until SIGINT/SIGTERM, then return */
+/* SIGUSR1 writes the operation timings (metrics.h) to metrics_path, if given */
+/* The data must be loaded (and the journal open) before calling this */
+gboolean server_run(const char *socket_path, const char *metrics_path, GError **error);
+
+#endif /* SERVER_H */
@@ -0,0 +1,565 @@
+#include "snapshot.h"
+#include "storage.h"
+#include "logic.h"
+#include "pool.h"
+#include "history.h"
+#include "metrics.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+/* These are the global arrays from main.c */
+extern GPtrArray *products;
+extern HistoryList *history;
+
+/* A snapshot file looks like this:                                          */
+/*   SnapshotHeader                                                          */
+/*   SnapshotChunk + count records                                           */
+/*   SnapshotChunk + count records   (history only - new chunks get appended) */
+/*   ...                                                                     */
+/* History chunks come in pairs: first a strings chunk (record_size 1) with  */
+/* the texts added to the history.c table since the last pair, then the      */
+/* entries, whose numbers point into that table.                             */
+/* Every chunk has its own checksum, so a half-written chunk at the end is   */
+/* simply ignored. Bump SNAPSHOT_VERSION whenever a record layout changes.   */
+
+#define SNAPSHOT_MAGIC "STKSNAP"  /* 7 letters + the NUL = 8 bytes */
+#define SNAPSHOT_VERSION 6  /* 3: compact history entries + strings chunks, 4: txn, 5: csv_tail, */
+                            /* 6: csv_mtime_nsec */
+#define SNAPSHOT_KIND_PRODUCTS 1
+#define SNAPSHOT_KIND_HISTORY 2
+
+/* After this many appended chunks the history snapshot is rewritten as one */
+#define SNAPSHOT_MAX_CHUNKS 32
+
+/* History chunks remember a checksum of this much of history.csv, right */
+/* before the point they cover up to */
+#define SNAPSHOT_TAIL_BYTES 4096
+
+/* FNV-1a constants for the checksum */
+#define CHECKSUM_OFFSET 14695981039346656037ULL
+#define CHECKSUM_PRIME 1099511628211ULL
+
+typedef struct {
+    char magic[8];     /* Always SNAPSHOT_MAGIC */
+    guint32 version;   /* SNAPSHOT_VERSION when it was written */
+    guint32 kind;      /* SNAPSHOT_KIND_PRODUCTS or SNAPSHOT_KIND_HISTORY */
+} SnapshotHeader;
+
+typedef struct {
+    guint32 record_size;  /* sizeof one record - catches layout changes */
+    guint32 reserved;     /* Strings chunks: table number of the first string */
+    guint64 count;        /* How many records follow */
+    gint64 csv_size;      /* Size of the CSV file this chunk matches */
+    gint64 csv_mtime;     /* Modification time of that CSV file */
+    gint64 csv_mtime_nsec;  /* And the part of a second (see storage_file_stamp) */
+    guint64 csv_tail;     /* History: checksum of the CSV bytes just before csv_size */
+    guint64 checksum;     /* Checksum of the fields above + the records */
+} SnapshotChunk;
+
+/* Products are stored without the runtime-only fields (like slot) */
+typedef struct {
+    char id[32];
+    char name[64];
+    char category[32];
+    gint64 price;  /* Money */
+    gint32 quantity;
+    gint32 sold;
+} ProductRecord;
+
+/* Records are copied straight out of the file, so they must keep 8-byte alignment */
+G_STATIC_ASSERT(sizeof(SnapshotHeader) % 8 == 0);
+G_STATIC_ASSERT(sizeof(SnapshotChunk) % 8 == 0);
+G_STATIC_ASSERT(sizeof(ProductRecord) % 8 == 0);
+G_STATIC_ASSERT(sizeof(HistoryEntry) % 8 == 0);
+
+/* What we know about the history snapshot on disk */
+static guint history_snap_entries = 0;   /* How many history entries it holds */
+static gint64 history_snap_csv_size = 0; /* How much of history.csv it covers */
+static gint64 history_snap_end = 0;      /* Where its last good chunk ends */
+static guint history_snap_chunks = 0;    /* How many chunk pairs it has */
+static guint history_snap_strings = 0;   /* How many history.c strings it holds */
+
+/* FNV-1a, but eating 8 bytes at a time so it runs at memory speed */
+static guint64 checksum_bytes(guint64 h, const void *data, gsize len) {
+    const guint8 *p = data;
+    while (len >= 8) {
+        guint64 w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * CHECKSUM_PRIME;
+        p += 8;
+        len -= 8;
+    }
+    while (len > 0) {
+        h = (h ^ *p) * CHECKSUM_PRIME;
+        p++;
+        len--;
+    }
+    return h;
+}
+
+/* The checksum starts with the chunk's own fields so a bad count or size is caught too */
+static guint64 chunk_checksum_start(const SnapshotChunk *chunk) {
+    return checksum_bytes(CHECKSUM_OFFSET, chunk, G_STRUCT_OFFSET(SnapshotChunk, checksum));
+}
+
+/* Map a snapshot file and check its header - returns NULL if it's not usable */
+static GMappedFile *open_snapshot(const char *path, guint32 kind,
+                                  const guint8 **data, gsize *len) {
+    GMappedFile *map = g_mapped_file_new(path, FALSE, NULL);
+    if (!map) return NULL;  /* No snapshot yet */
+
+    *data = (const guint8 *)g_mapped_file_get_contents(map);
+    *len = g_mapped_file_get_length(map);
+
+    SnapshotHeader hdr;
+    if (*len < sizeof(hdr)) {
+        g_mapped_file_unref(map);
+        return NULL;
+    }
+    memcpy(&hdr, *data, sizeof(hdr));
+    if (memcmp(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != SNAPSHOT_VERSION || hdr.kind != kind) {
+        /* Not ours, or written by an older/newer version */
+        g_mapped_file_unref(map);
+        return NULL;
+    }
+    return map;
+}
+
+/* Check the chunk at *pos and return a pointer to its records */
+/* Returns NULL at the end of the file or if the chunk is damaged */
+static const guint8 *next_chunk(const guint8 *data, gsize len, gsize *pos,
+                                guint32 record_size, SnapshotChunk *chunk) {
+    if (len - *pos < sizeof(SnapshotChunk)) return NULL;
+    memcpy(chunk, data + *pos, sizeof(*chunk));
+    if (chunk->record_size != record_size) return NULL;
+
+    /* Make sure the records are really there before touching them */
+    gsize avail = len - *pos - sizeof(SnapshotChunk);
+    if (chunk->count > avail / record_size) return NULL;
+    gsize bytes = (gsize)chunk->count * record_size;
+
+    const guint8 *records = data + *pos + sizeof(SnapshotChunk);
+    if (checksum_bytes(chunk_checksum_start(chunk), records, bytes) != chunk->checksum) {
+        return NULL;
+    }
+    *pos += sizeof(SnapshotChunk) + bytes;
+    return records;
+}
+
+/* Turns item i (of products or history) into its on-disk record */
+typedef void (*FillRecordFunc)(void *record, guint i);
+
+static void fill_product_record(void *record, guint i) {
+    const Product *p = g_ptr_array_index(products, i);
+    ProductRecord *rec = record;
+    memset(rec, 0, sizeof(*rec));
+    memcpy(rec->id, p->id, sizeof(rec->id));
+    memcpy(rec->name, p->name, sizeof(rec->name));
+    memcpy(rec->category, p->category, sizeof(rec->category));
+    rec->price = p->price;
+    rec->quantity = p->quantity;
+    rec->sold = p->sold;
+}
+
+static void fill_history_record(void *record, guint i) {
+    memcpy(record, history_index(history, i), sizeof(HistoryEntry));  /* Same layout on disk */
+}
+
+/* Write one chunk holding items [from..len) at the end of f */
+/* The checksum is only known at the end, so the chunk header is written twice */
+static gboolean write_chunk(FILE *f, SnapshotChunk *chunk, guint from, guint len,
+                            FillRecordFunc fill) {
+    fpos_t chunk_pos;
+    if (fgetpos(f, &chunk_pos) != 0) return FALSE;
+
+    chunk->count = len - from;
+    chunk->checksum = 0;
+    fwrite(chunk, sizeof(*chunk), 1, f);
+
+    guint64 h = chunk_checksum_start(chunk);
+    void *rec = g_malloc(chunk->record_size);
+    for (guint i = from; i < len; i++) {
+        fill(rec, i);
+        h = checksum_bytes(h, rec, chunk->record_size);
+        fwrite(rec, chunk->record_size, 1, f);
+    }
+    g_free(rec);
+
+    chunk->checksum = h;
+    if (fsetpos(f, &chunk_pos) != 0) return FALSE;
+    fwrite(chunk, sizeof(*chunk), 1, f);
+    if (fseek(f, 0, SEEK_END) != 0) return FALSE;
+    return !ferror(f);
+}
+
+/* Write the history strings from number from_string on, then the entries from from_entry on */
+static gboolean write_history_chunks(FILE *f, const SnapshotChunk *chunk,
+                                     guint from_entry, guint from_string) {
+    /* The strings chunk is just the texts one after another, each ending in a NUL */
+    GString *texts = g_string_new(NULL);
+    guint n_strings = history_strings_count();
+    for (guint i = from_string; i < n_strings; i++) {
+        const char *s = history_string(i);
+        g_string_append_len(texts, s, (gssize)strlen(s) + 1);
+    }
+    SnapshotChunk strings_chunk = *chunk;
+    strings_chunk.record_size = 1;
+    strings_chunk.reserved = from_string;
+    strings_chunk.count = texts->len;
+    strings_chunk.checksum = checksum_bytes(chunk_checksum_start(&strings_chunk),
+                                            texts->str, texts->len);
+    fwrite(&strings_chunk, sizeof(strings_chunk), 1, f);
+    fwrite(texts->str, 1, texts->len, f);
+    g_string_free(texts, TRUE);
+
+    SnapshotChunk entries_chunk = *chunk;
+    return write_chunk(f, &entries_chunk, from_entry, history->len, fill_history_record);
+}
+
+/* Add the texts of a strings chunk to the history.c table */
+/* They must get exactly the numbers they had when saved, otherwise the */
+/* entries would point at the wrong text - then the chunk counts as damaged */
+static gboolean load_history_strings(const guint8 *texts, const SnapshotChunk *chunk) {
+    guint before = history_strings_count();
+    if (chunk->reserved != before) return FALSE;
+    if (chunk->count == 0) return TRUE;
+    if (texts[chunk->count - 1] != '\0') return FALSE;  /* Last text doesn't end */
+
+    const char *p = (const char *)texts;
+    const char *end = p + chunk->count;
+    guint expected = before;
+    while (p < end) {
+        if (history_intern(p) != expected) {
+            history_strings_truncate(before);  /* Same text twice - not our file */
+            return FALSE;
+        }
+        expected++;
+        p += strlen(p) + 1;
+    }
+    return TRUE;
+}
+
+/* Flush, fsync and close - returns FALSE if anything went wrong on the way */
+static gboolean finish_file(FILE *f) {
+    gboolean ok = !ferror(f) && fflush(f) == 0 && g_fsync(fileno(f)) == 0;
+    if (fclose(f) != 0) ok = FALSE;
+    return ok;
+}
+
+/* Writes the chunks of a whole new snapshot file (everything after the header) */
+typedef gboolean (*WriteBodyFunc)(FILE *f, SnapshotChunk *chunk);
+
+static gboolean write_products_body(FILE *f, SnapshotChunk *chunk) {
+    return write_chunk(f, chunk, 0, products->len, fill_product_record);
+}
+
+static gboolean write_history_body(FILE *f, SnapshotChunk *chunk) {
+    return write_history_chunks(f, chunk, 0, HISTORY_N_OPS);  /* The built-ins are always there */
+}
+
+/* Write a whole new snapshot (header + chunks) next to the old one, then */
+/* rename it over, so a crash never leaves a half-written snapshot behind */
+static gboolean write_snapshot_file(const char *snap_path, guint32 kind,
+                                    SnapshotChunk *chunk, WriteBodyFunc body,
+                                    GError **error) {
+    char *tmp_path = g_strconcat(snap_path, ".tmp", NULL);
+    FILE *f = g_fopen(tmp_path, "wb");
+    if (!f) {
+        g_set_error(error, g_quark_from_static_string("snapshot"),
+                    1, "Failed to open %s for writing", tmp_path);
+        g_free(tmp_path);
+        return FALSE;
+    }
+
+    SnapshotHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.kind = kind;
+    fwrite(&hdr, sizeof(hdr), 1, f);
+
+    gboolean ok = body(f, chunk);
+    if (!finish_file(f)) ok = FALSE;
+    if (ok && g_rename(tmp_path, snap_path) != 0) ok = FALSE;
+    if (!ok) {
+        g_set_error(error, g_quark_from_static_string("snapshot"),
+                    2, "Failed to write %s", snap_path);
+        g_remove(tmp_path);
+    }
+    g_free(tmp_path);
+    return ok;
+}
+
+/* This function loads products from products.snap */
+/* It only trusts the snapshot if products.csv is exactly the file it was made from */
+static gboolean do_snapshot_load_products(const char *snap_path, const char *csv_path) {
+    gint64 csv_size, csv_mtime, csv_nsec;
+    if (!storage_file_stamp(csv_path, &csv_size, &csv_mtime, &csv_nsec)) {
+        return FALSE;  /* No CSV - nothing to match against */
+    }
+
+    const guint8 *data;
+    gsize len;
+    GMappedFile *map = open_snapshot(snap_path, SNAPSHOT_KIND_PRODUCTS, &data, &len);
+    if (!map) return FALSE;
+
+    gsize pos = sizeof(SnapshotHeader);
+    SnapshotChunk chunk;
+    const guint8 *records = next_chunk(data, len, &pos, sizeof(ProductRecord), &chunk);
+    if (!records || chunk.csv_size != csv_size || chunk.csv_mtime != csv_mtime ||
+        chunk.csv_mtime_nsec != csv_nsec) {
+        g_message("%s is stale or damaged, loading %s instead", snap_path, csv_path);
+        g_mapped_file_unref(map);
+        return FALSE;
+    }
+
+    /* No parsing here - each record is copied field by field */
+    for (guint64 i = 0; i < chunk.count; i++) {
+        ProductRecord rec;
+        memcpy(&rec, records + i * sizeof(rec), sizeof(rec));
+
+        Product *p = pool_new_product();
+        memcpy(p->id, rec.id, sizeof(p->id));
+        memcpy(p->name, rec.name, sizeof(p->name));
+        memcpy(p->category, rec.category, sizeof(p->category));
+        /* Make sure the strings end, even if the file lied to us */
+        p->id[sizeof(p->id) - 1] = '\0';
+        p->name[sizeof(p->name) - 1] = '\0';
+        p->category[sizeof(p->category) - 1] = '\0';
+        p->price = rec.price;
+        p->quantity = rec.quantity;
+        p->sold = rec.sold;
+
+        if (!insert_product(p)) {
+            pool_free_product(p);  /* Duplicate ID - keep the first one like the CSV loader */
+        }
+    }
+
+    g_mapped_file_unref(map);
+    return TRUE;
+}
+
+/* Timed and traced wrapper - a load that "fails" is one where the snapshot couldn't be used */
+gboolean snapshot_load_products(const char *snap_path, const char *csv_path) {
+    TRACE_BEGIN("snapshot_load_products");
+    METRIC_START(start);
+    gboolean ok = do_snapshot_load_products(snap_path, csv_path);
+    METRIC_STOP(METRIC_SNAPSHOT_LOAD_PRODUCTS, start, ok);
+    TRACE_END("snapshot_load_products");
+    return ok;
+}
+
+/* This function writes products.snap */
+/* Call it right after storage_save_products so the CSV stats match */
+static gboolean do_snapshot_save_products(const char *snap_path, const char *csv_path,
+                                          GError **error) {
+    SnapshotChunk chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    if (!storage_file_stamp(csv_path, &chunk.csv_size, &chunk.csv_mtime, &chunk.csv_mtime_nsec)) {
+        g_set_error(error, g_quark_from_static_string("snapshot"),
+                    3, "Can't snapshot %s - it doesn't exist", csv_path);
+        return FALSE;
+    }
+    chunk.record_size = sizeof(ProductRecord);
+    return write_snapshot_file(snap_path, SNAPSHOT_KIND_PRODUCTS, &chunk,
+                               write_products_body, error);
+}
+
+gboolean snapshot_save_products(const char *snap_path, const char *csv_path, GError **error) {
+    TRACE_BEGIN("snapshot_save_products");
+    METRIC_START(start);
+    gboolean ok = do_snapshot_save_products(snap_path, csv_path, error);
+    METRIC_STOP(METRIC_SNAPSHOT_SAVE_PRODUCTS, start, ok);
+    TRACE_END("snapshot_save_products");
+    return ok;
+}
+
+/* Checksum the SNAPSHOT_TAIL_BYTES of history.csv that end at offset */
+/* FALSE if they can't be read or don't end with a line break - then the */
+/* snapshot doesn't line up with the file anymore */
+static gboolean csv_tail_checksum(FILE *f, gint64 offset, guint64 *out) {
+    *out = CHECKSUM_OFFSET;
+    if (offset == 0) return TRUE;
+    guint8 buf[SNAPSHOT_TAIL_BYTES];
+    gint64 start = MAX(0, offset - SNAPSHOT_TAIL_BYTES);
+    gsize len = (gsize)(offset - start);
+#ifdef G_OS_WIN32
+    if (_fseeki64(f, start, SEEK_SET) != 0) return FALSE;
+#else
+    if (fseeko(f, (off_t)start, SEEK_SET) != 0) return FALSE;
+#endif
+    if (fread(buf, 1, len, f) != len || buf[len - 1] != '\n') return FALSE;
+    *out = checksum_bytes(CHECKSUM_OFFSET, buf, len);
+    return TRUE;
+}
+
+/* This function loads history from history.snap */
+/* Every good chunk is copied into history with one memcpy - no parsing at all */
+/* (only the strings chunks are walked, and those are short) */
+static gboolean do_snapshot_load_history(const char *snap_path, const char *csv_path,
+                                         gint64 *csv_offset) {
+    *csv_offset = 0;
+    history_snap_entries = 0;
+    history_snap_csv_size = 0;
+    history_snap_end = 0;
+    history_snap_chunks = 0;
+    history_snap_strings = 0;
+
+    gint64 csv_size, csv_mtime, csv_nsec;
+    if (!storage_file_stamp(csv_path, &csv_size, &csv_mtime, &csv_nsec)) return FALSE;
+
+    const guint8 *data;
+    gsize len;
+    GMappedFile *map = open_snapshot(snap_path, SNAPSHOT_KIND_HISTORY, &data, &len);
+    if (!map) return FALSE;
+    FILE *csv = g_fopen(csv_path, "rb");
+    if (!csv) {
+        g_mapped_file_unref(map);
+        return FALSE;
+    }
+
+    PoolMark mark = pool_history_mark();
+    guint first = history->len;
+    guint first_string = history_strings_count();
+    gboolean stale = FALSE;
+    gint64 covered = 0, covered_mtime = 0, covered_nsec = 0;
+    gsize pos = sizeof(SnapshotHeader);
+    SnapshotChunk strings_chunk, chunk;
+    const guint8 *texts, *records;
+
+    /* Stop at the first damaged pair - everything before it is still good */
+    while ((texts = next_chunk(data, len, &pos, 1, &strings_chunk))) {
+        guint strings_before = history_strings_count();
+        if (!load_history_strings(texts, &strings_chunk)) break;
+        records = next_chunk(data, len, &pos, sizeof(HistoryEntry), &chunk);
+        if (!records) {
+            history_strings_truncate(strings_before);  /* Half a pair */
+            break;
+        }
+        /* The file may only have grown since, and the part this chunk */
+        /* covers must still be the same bytes */
+        guint64 tail;
+        if (chunk.csv_size > csv_size || chunk.csv_size < covered ||
+            !csv_tail_checksum(csv, chunk.csv_size, &tail) || tail != chunk.csv_tail) {
+            stale = TRUE;  /* history.csv got shorter, was edited or was replaced */
+            break;
+        }
+        if (chunk.count > 0) {
+            HistoryEntry *block = pool_new_history_block((guint)chunk.count);
+            memcpy(block, records, (gsize)chunk.count * sizeof(HistoryEntry));
+
+            for (guint64 i = 0; i < chunk.count; i++) {
+                history_list_append(history, &block[i]);
+            }
+        }
+        covered = chunk.csv_size;
+        covered_mtime = chunk.csv_mtime;
+        covered_nsec = chunk.csv_mtime_nsec;
+        history_snap_end = (gint64)pos;
+        history_snap_chunks++;
+    }
+    g_mapped_file_unref(map);
+    fclose(csv);
+
+    /* Nothing was appended since, so the file shouldn't have been touched at all */
+    if (covered == csv_size && covered > 0 &&
+        (covered_mtime != csv_mtime || covered_nsec != csv_nsec)) {
+        stale = TRUE;
+    }
+
+    if (stale) {
+        /* Throw it all away and let the caller read the whole CSV */
+        g_message("%s doesn't match %s, loading the CSV instead", snap_path, csv_path);
+        history_list_truncate(history, first);
+        pool_history_rewind(mark);
+        history_strings_truncate(first_string);
+        history_snap_end = 0;
+        history_snap_chunks = 0;
+        return FALSE;
+    }
+
+    history_snap_entries = history->len - first;
+    history_snap_strings = history_strings_count();
+    history_snap_csv_size = covered;
+    *csv_offset = covered;
+    return history_snap_chunks > 0;
+}
+
+gboolean snapshot_load_history(const char *snap_path, const char *csv_path, gint64 *csv_offset) {
+    TRACE_BEGIN("snapshot_load_history");
+    METRIC_START(start);
+    gboolean ok = do_snapshot_load_history(snap_path, csv_path, csv_offset);
+    METRIC_STOP(METRIC_SNAPSHOT_LOAD_HISTORY, start, ok);
+    TRACE_END("snapshot_load_history");
+    return ok;
+}
+
+/* This function brings history.snap up to date */
+/* Normally it just appends one chunk with the entries added this session */
+static gboolean do_snapshot_save_history(const char *snap_path, const char *csv_path,
+                                         GError **error) {
+    SnapshotChunk chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    if (!storage_file_stamp(csv_path, &chunk.csv_size, &chunk.csv_mtime, &chunk.csv_mtime_nsec)) {
+        return TRUE;  /* No history.csv - nothing to snapshot */
+    }
+    chunk.record_size = sizeof(HistoryEntry);
+    FILE *csv = g_fopen(csv_path, "rb");
+    if (csv) {
+        /* If this fails the chunk won't match on load, and the CSV gets parsed */
+        csv_tail_checksum(csv, chunk.csv_size, &chunk.csv_tail);
+        fclose(csv);
+    }
+
+    /* Nothing happened since the last snapshot */
+    if (history_snap_entries == history->len && history_snap_csv_size == chunk.csv_size &&
+        history_snap_chunks > 0) {
+        return TRUE;
+    }
+
+    /* Can we append? Only if the file on disk ends exactly where we think it does */
+    gint64 snap_size = 0, snap_mtime = 0, snap_nsec = 0;
+    gboolean append = history_snap_chunks > 0 &&
+                      history_snap_chunks < SNAPSHOT_MAX_CHUNKS &&
+                      storage_file_stamp(snap_path, &snap_size, &snap_mtime, &snap_nsec) &&
+                      snap_size == history_snap_end;
+
+    gboolean ok;
+    if (append) {
+        FILE *f = g_fopen(snap_path, "r+b");
+        ok = f && fseek(f, 0, SEEK_END) == 0 &&
+             write_history_chunks(f, &chunk, history_snap_entries, history_snap_strings);
+        if (f && !finish_file(f)) ok = FALSE;
+        if (!ok) {
+            g_set_error(error, g_quark_from_static_string("snapshot"),
+                        2, "Failed to write %s", snap_path);
+        }
+        history_snap_chunks++;
+    } else {
+        ok = write_snapshot_file(snap_path, SNAPSHOT_KIND_HISTORY, &chunk,
+                                 write_history_body, error);
+        history_snap_chunks = 1;
+    }
+    if (!ok) {
+        history_snap_chunks = 0;  /* Don't trust the file - rewrite it next time */
+        return FALSE;
+    }
+
+    history_snap_entries = history->len;
+    history_snap_strings = history_strings_count();
+    history_snap_csv_size = chunk.csv_size;
+    storage_file_stamp(snap_path, &history_snap_end, &snap_mtime, &snap_nsec);
+    return TRUE;
+}
+
+gboolean snapshot_save_history(const char *snap_path, const char *csv_path, GError **error) {
+    TRACE_BEGIN("snapshot_save_history");
+    METRIC_START(start);
+    gboolean ok = do_snapshot_save_history(snap_path, csv_path, error);
+    METRIC_STOP(METRIC_SNAPSHOT_SAVE_HISTORY, start, ok);
+    TRACE_END("snapshot_save_history");
+    return ok;
+}
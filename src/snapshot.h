@@ -0,0 +1,27 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "model.h"
+
+/* This file handles the binary snapshot files (products.snap, history.snap) */
+/* They hold the same data as the CSV files but in a form we can just mmap and */
+/* copy, so startup doesn't have to parse millions of lines. The CSV files are */
+/* still the real data - a snapshot is only used when it matches its CSV file. */
+
+/* Load products from the snapshot if it is valid and matches csv_path */
+/* Returns FALSE if there is no usable snapshot - then load the CSV instead */
+gboolean snapshot_load_products(const char *snap_path, const char *csv_path);
+
+/* Write a snapshot of all products (call right after saving csv_path) */
+gboolean snapshot_save_products(const char *snap_path, const char *csv_path, GError **error);
+
+/* Load history from the snapshot. *csv_offset is set to how many bytes of */
+/* csv_path the snapshot already covers, so only the rest has to be parsed */
+/* (0 if the snapshot was missing, stale or corrupt) */
+gboolean snapshot_load_history(const char *snap_path, const char *csv_path, gint64 *csv_offset);
+
+/* Bring the history snapshot up to date with csv_path */
+/* Only entries added since the last snapshot are appended */
+gboolean snapshot_save_history(const char *snap_path, const char *csv_path, GError **error);
+
+#endif /* SNAPSHOT_H */
@@ -1,147 +1,712 @@
 #include "storage.h"
+#include "logic.h"
+#include "csv.h"
+#include "pool.h"
+#include "history.h"
+#include "metrics.h"
+#include "trace.h"
 #include <stdio.h>
 #include <string.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#ifdef G_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+/* Write the journal once this much is waiting, even if the timer hasn't fired */
+#define JOURNAL_BATCH_BYTES (64 * 1024)
 
 /* These are the global arrays from main.c */
 extern GPtrArray *products;
-extern GPtrArray *history;
+extern HistoryList *history;
+
+/* Malformed lines found by the loaders since the app started */
+static guint64 malformed_lines = 0;
+
+/* Open a CSV file for one of the loaders */
+/* Returns NULL with no error if the file just doesn't exist yet */
+static CsvReader *open_csv(const char *path, gint64 offset, GError **error) {
+    GError *err = NULL;
+    CsvReader *r = csv_reader_open(path, offset, &err);
+    if (!r) {
+        if (g_error_matches(err, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            g_error_free(err);  /* First time running - that's OK */
+        } else {
+            g_propagate_error(error, err);
+        }
+    }
+    return r;
+}
+
+/* Close the reader and say how many lines we had to skip */
+static void close_csv(CsvReader *r, const char *path) {
+    guint64 bad = csv_reader_malformed(r);
+    if (bad > 0) {
+        g_warning("Skipped %" G_GUINT64_FORMAT " malformed line(s) in %s", bad, path);
+        malformed_lines += bad;
+    }
+    csv_reader_close(r);
+}
 
-/* Helper function to remove the \n (newline) at the end of a string */
-/* When we read from file, each line ends with \n, we need to remove it */
-static void trim_newline(char *s) {
-    if (!s) return;  /* Safety check - make sure string exists */
-    char *p = strchr(s, '\n');  /* Find where the newline is */
-    if (p) *p = '\0';  /* Replace it with null terminator (end of string) */
+/* How many malformed lines the loaders have skipped so far */
+guint64 storage_malformed_lines(void) {
+    return malformed_lines;
+}
+
+/* Saving never writes over the real file. It writes path.tmp, fsyncs it and */
+/* renames it over path, so after a crash or power cut the file on disk is */
+/* either the old one or the new one, never half of each */
+static FILE *open_temp(const char *path, char **tmp_path, int code, GError **error) {
+    *tmp_path = g_strconcat(path, ".tmp", NULL);
+    FILE *f = g_fopen(*tmp_path, "w");
+    if (!f) {
+        g_set_error(error, g_quark_from_static_string("storage"),
+                    code, "Failed to open %s for writing", *tmp_path);
+        g_free(*tmp_path);
+        *tmp_path = NULL;
+    }
+    return f;
+}
+
+/* Finish the temp file from open_temp and put it in place (frees tmp_path) */
+static gboolean replace_with_temp(FILE *f, char *tmp_path, const char *path, GError **error) {
+    gboolean ok = !ferror(f) && fflush(f) == 0 && g_fsync(fileno(f)) == 0;
+    if (fclose(f) != 0) ok = FALSE;
+    if (ok && g_rename(tmp_path, path) != 0) ok = FALSE;
+    if (!ok) {
+        g_set_error(error, g_quark_from_static_string("storage"),
+                    6, "Failed to write %s", path);
+        g_remove(tmp_path);
+    }
+#ifdef G_OS_UNIX
+    /* The rename is only safe on disk once the folder is synced too */
+    if (ok) {
+        char *dir = g_path_get_dirname(path);
+        int fd = open(dir, O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+        g_free(dir);
+    }
+#endif
+    g_free(tmp_path);
+    return ok;
 }
 
 /* This function reads products from a CSV file and puts them in memory */
 /* CSV format is: id,name,category,price,quantity,sold */
 /* Example line: P001,Laptop,Electronics,999.99,10,5 */
-gboolean storage_load_products(const char *path, GError **error) {
-    FILE *f = fopen(path, "r");  /* Open file for reading */
-    if (!f) {
-        /* If file doesn't exist, that's OK - maybe first time running */
-        return TRUE;
+static gboolean do_storage_load_products(const char *path, GError **error) {
+    GError *err = NULL;
+    CsvReader *r = open_csv(path, 0, &err);
+    if (!r) {
+        if (!err) return TRUE;  /* No file yet */
+        g_propagate_error(error, err);
+        return FALSE;
     }
 
-    char line[512];  /* Buffer to hold one line from file */
-    /* Read file line by line */
-    while (fgets(line, sizeof(line), f)) {
-        trim_newline(line);  /* Remove the \n at the end */
-        if (line[0] == '\0') continue;  /* Skip empty lines */
-
-        /* Create a new Product struct in memory */
-        Product *p = g_new0(Product, 1);
-        char price_str[64], qty_str[64], sold_str[64];  /* Temporary strings for numbers */
-
-        /* Parse the CSV line - split by commas */
-        /* sscanf reads: id, name, category, price, quantity, sold */
-        if (sscanf(line, "%31[^,],%63[^,],%31[^,],%63[^,],%63[^,],%63s",
-                   p->id, p->name, p->category,
-                   price_str, qty_str, sold_str) != 6) {
-            /* If we couldn't read 6 things, the line is broken - skip it */
-            g_free(p);
+    CsvField *fields;
+    guint n;
+    /* Read the file record by record */
+    while (csv_reader_next(r, &fields, &n)) {
+        /* Check the line first: 6 fields, an ID, and real numbers */
+        Money price;
+        int quantity, sold;
+        if (n != 6 || fields[0].len == 0 ||
+            !money_parse(fields[3].str, (gssize)fields[3].len, &price) ||
+            !csv_field_to_int(&fields[4], &quantity) ||
+            !csv_field_to_int(&fields[5], &sold)) {
+            csv_reader_reject(r);  /* Broken line - count it and skip it */
             continue;
         }
 
-        /* Convert strings to numbers (price is double, quantity and sold are int) */
-        p->price = g_ascii_strtod(price_str, NULL);  /* "99.99" -> 99.99 */
-        p->quantity = (int)g_ascii_strtoll(qty_str, NULL, 10);  /* "10" -> 10 */
-        p->sold = (int)g_ascii_strtoll(sold_str, NULL, 10);  /* "5" -> 5 */
+        /* Create a new Product struct in memory */
+        Product *p = pool_new_product();
+        g_strlcpy(p->id, fields[0].str, sizeof(p->id));
+        g_strlcpy(p->name, fields[1].str, sizeof(p->name));
+        g_strlcpy(p->category, fields[2].str, sizeof(p->category));
+        p->price = price;
+        p->quantity = quantity;
+        p->sold = sold;
 
-        /* Add this product to our global list */
-        g_ptr_array_add(products, p);
+        /* Add this product to our global list (and the ID index) */
+        if (!insert_product(p)) {
+            /* Same ID twice in the file - keep the first one */
+            g_warning("Skipping duplicate product ID %s in %s", p->id, path);
+            pool_free_product(p);
+        }
     }
 
-    fclose(f);  /* Always close the file when done */
+    close_csv(r, path);  /* Always close the file when done */
     return TRUE;
 }
 
-/* This function saves all products from memory to a CSV file */
+/* Timed (metrics.h) and traced (trace.h) wrapper */
+gboolean storage_load_products(const char *path, GError **error) {
+    TRACE_BEGIN("storage_load_products");
+    METRIC_START(start);
+    gboolean ok = do_storage_load_products(path, error);
+    METRIC_STOP(METRIC_LOAD_PRODUCTS, start, ok);
+    TRACE_END("storage_load_products");
+    return ok;
+}
+
+/* This function saves products to a CSV file */
 /* It writes each product as one line in the file */
+static gboolean do_storage_save_product_list(const char *path, GPtrArray *list,
+                                             GError **error) {
+    char *tmp_path;
+    FILE *f = open_temp(path, &tmp_path, 1, error);
+    if (!f) return FALSE;  /* Couldn't open file - maybe no permission? */
+
+    /* Loop through all products and write each one */
+    GString *line = g_string_new(NULL);
+    char price_buf[MONEY_BUF_SIZE];
+    for (guint i = 0; i < list->len; i++) {
+        const Product *p = g_ptr_array_index(list, i);
+        /* Write one line: id,name,category,price,quantity,sold */
+        /* Text fields get quoted if they contain a comma or a quote */
+        g_string_truncate(line, 0);
+        csv_append_field(line, p->id);
+        g_string_append_c(line, ',');
+        csv_append_field(line, p->name);
+        g_string_append_c(line, ',');
+        csv_append_field(line, p->category);
+        g_string_append_printf(line, ",%s,%d,%d\n",
+                               money_format(p->price, price_buf, sizeof(price_buf)),
+                               p->quantity, p->sold);
+        fwrite(line->str, 1, line->len, f);
+    }
+    g_string_free(line, TRUE);
+
+    return replace_with_temp(f, tmp_path, path, error);
+}
+
+gboolean storage_save_product_list(const char *path, GPtrArray *list, GError **error) {
+    TRACE_BEGIN("storage_save_products");
+    METRIC_START(start);
+    gboolean ok = do_storage_save_product_list(path, list, error);
+    METRIC_STOP(METRIC_SAVE_PRODUCTS, start, ok);
+    TRACE_END("storage_save_products");
+    return ok;
+}
+
 gboolean storage_save_products(const char *path, GError **error) {
-    FILE *f = fopen(path, "w");  /* Open file for writing (creates new file) */
+    return storage_save_product_list(path, products, error);
+}
+
+/* The delta file (products.delta) holds the changes made since products.csv */
+/* was last written, so a checkpoint only writes what changed: */
+/*   B,<size of products.csv>,<its mtime>,<mtime nanoseconds>   first line - */
+/*                                          which base it goes with */
+/*   K                                      a checkpoint starts */
+/*   U,id,name,category,price,quantity,sold a product as it is now */
+/*   D,id                                   a product that was removed */
+/*   C,<rows>                               the checkpoint is complete */
+/* A checkpoint without its C line (the app died while writing it) is ignored */
+/* Older delta files have no nanoseconds in the B line - only seconds are compared */
+
+/* This function gets a file's size and mtime, all zeros (and FALSE) if it's missing */
+/* Whole seconds aren't enough: a file can be saved again in the same second */
+/* with the same size (1.50 -> 1.60), and then what was made from the old one */
+/* would still look current. snapshot.c uses this too, for the same reason */
+gboolean storage_file_stamp(const char *path, gint64 *size, gint64 *mtime, gint64 *nsec) {
+    *size = 0;
+    *mtime = 0;
+    *nsec = 0;
+    GFile *file = g_file_new_for_path(path);
+    GFileInfo *info = g_file_query_info(file, "standard::size,time::modified,"
+                                        "time::modified-usec,time::modified-nsec",
+                                        G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    gboolean found = info != NULL;
+    if (info) {
+        *size = g_file_info_get_size(info);
+        *mtime = (gint64)g_file_info_get_attribute_uint64(info, "time::modified");
+        /* Not every GLib or file system has nanoseconds - then use microseconds */
+        if (g_file_info_has_attribute(info, "time::modified-nsec")) {
+            *nsec = g_file_info_get_attribute_uint32(info, "time::modified-nsec");
+        } else {
+            *nsec = (gint64)g_file_info_get_attribute_uint32(info, "time::modified-usec") * 1000;
+        }
+        g_object_unref(info);
+    }
+    g_object_unref(file);
+    return found;
+}
+
+static gboolean do_storage_append_product_delta(const char *path, const char *base_path,
+                                                GArray *rows, GError **error) {
+    GStatBuf st;
+    gboolean is_new = g_stat(path, &st) != 0 || st.st_size == 0;
+    FILE *f = g_fopen(path, "ab");
     if (!f) {
-        /* Couldn't open file - maybe no permission? */
         g_set_error(error, g_quark_from_static_string("storage"),
-                    1, "Failed to open %s for writing", path);
+                    7, "Failed to open %s for appending", path);
         return FALSE;
     }
 
-    /* Loop through all products and write each one */
-    for (guint i = 0; i < products->len; i++) {
-        Product *p = g_ptr_array_index(products, i);
-        /* Write one line: id,name,category,price,quantity,sold */
-        fprintf(f, "%s,%s,%s,%.2f,%d,%d\n",
-                p->id, p->name, p->category,
-                p->price, p->quantity, p->sold);
+    GString *out = g_string_new(NULL);
+    if (is_new) {
+        gint64 size, mtime, nsec;
+        storage_file_stamp(base_path, &size, &mtime, &nsec);
+        g_string_append_printf(out, "B,%" G_GINT64_FORMAT ",%" G_GINT64_FORMAT ",%"
+                               G_GINT64_FORMAT "\n", size, mtime, nsec);
+    } else {
+        /* Same as the journal: finish a line a crash cut off */
+        FILE *check = g_fopen(path, "rb");
+        if (check) {
+            if (fseek(check, -1, SEEK_END) == 0 && fgetc(check) != '\n') {
+                g_string_append_c(out, '\n');
+            }
+            fclose(check);
+        }
+    }
+
+    g_string_append(out, "K\n");
+    char price_buf[MONEY_BUF_SIZE];
+    for (guint i = 0; i < rows->len; i++) {
+        const ProductDelta *d = &g_array_index(rows, ProductDelta, i);
+        g_string_append(out, d->removed ? "D," : "U,");
+        csv_append_field(out, d->product.id);
+        if (!d->removed) {
+            g_string_append_c(out, ',');
+            csv_append_field(out, d->product.name);
+            g_string_append_c(out, ',');
+            csv_append_field(out, d->product.category);
+            g_string_append_printf(out, ",%s,%d,%d",
+                                   money_format(d->product.price, price_buf, sizeof(price_buf)),
+                                   d->product.quantity, d->product.sold);
+        }
+        g_string_append_c(out, '\n');
+    }
+    g_string_append_printf(out, "C,%u\n", rows->len);
+
+    gboolean ok = fwrite(out->str, 1, out->len, f) == out->len &&
+                  fflush(f) == 0 && g_fsync(fileno(f)) == 0;
+    if (fclose(f) != 0) ok = FALSE;
+    if (!ok) {
+        g_set_error(error, g_quark_from_static_string("storage"),
+                    7, "Failed to append to %s", path);
+    }
+    g_string_free(out, TRUE);
+    return ok;
+}
+
+gboolean storage_append_product_delta(const char *path, const char *base_path,
+                                      GArray *rows, GError **error) {
+    TRACE_BEGIN("storage_append_delta");
+    METRIC_START(start);
+    gboolean ok = do_storage_append_product_delta(path, base_path, rows, error);
+    METRIC_STOP(METRIC_SAVE_PRODUCT_DELTA, start, ok);
+    TRACE_END("storage_append_delta");
+    return ok;
+}
+
+/* Put one finished checkpoint into memory */
+static void apply_delta_rows(GArray *rows) {
+    for (guint i = 0; i < rows->len; i++) {
+        ProductDelta *d = &g_array_index(rows, ProductDelta, i);
+        if (d->removed) {
+            drop_product(d->product.id);
+        } else {
+            Product *p = pool_new_product();
+            *p = d->product;
+            replace_product(p);
+        }
+    }
+}
+
+static gboolean do_storage_load_product_delta(const char *path, const char *base_path,
+                                              gboolean *stale, GError **error) {
+    *stale = FALSE;
+    GError *err = NULL;
+    CsvReader *r = open_csv(path, 0, &err);
+    if (!r) {
+        if (!err) return TRUE;  /* No changes since products.csv was written */
+        g_propagate_error(error, err);
+        return FALSE;
+    }
+
+    CsvField *fields;
+    guint n;
+    gboolean have_base = FALSE;
+    gboolean in_checkpoint = FALSE;
+    GArray *rows = g_array_new(FALSE, FALSE, sizeof(ProductDelta));
+    while (csv_reader_next(r, &fields, &n)) {
+        char kind = fields[0].len == 1 ? fields[0].str[0] : '?';
+
+        if (!have_base) {
+            /* The first line says which products.csv these changes go on top of */
+            gint64 size, mtime, nsec = 0, base_size, base_mtime, base_nsec;
+            storage_file_stamp(base_path, &base_size, &base_mtime, &base_nsec);
+            if (n == 3) base_nsec = 0;  /* Written before the B line had nanoseconds */
+            if (kind != 'B' || (n != 3 && n != 4) || !csv_field_to_int64(&fields[1], &size) ||
+                !csv_field_to_int64(&fields[2], &mtime) ||
+                (n == 4 && !csv_field_to_int64(&fields[3], &nsec)) ||
+                size != base_size || mtime != base_mtime || nsec != base_nsec) {
+                *stale = TRUE;  /* products.csv was saved after this was written */
+                break;
+            }
+            have_base = TRUE;
+            continue;
+        }
+
+        ProductDelta d;
+        memset(&d, 0, sizeof(d));
+        int count;
+        if (kind == 'K' && n == 1) {
+            g_array_set_size(rows, 0);  /* Drop a checkpoint that was never finished */
+            in_checkpoint = TRUE;
+        } else if (kind == 'C' && n == 2 && in_checkpoint &&
+                   csv_field_to_int(&fields[1], &count) && (guint)count == rows->len) {
+            apply_delta_rows(rows);
+            g_array_set_size(rows, 0);
+            in_checkpoint = FALSE;
+        } else if (kind == 'D' && n == 2 && in_checkpoint && fields[1].len > 0) {
+            g_strlcpy(d.product.id, fields[1].str, sizeof(d.product.id));
+            d.removed = TRUE;
+            g_array_append_val(rows, d);
+        } else if (kind == 'U' && n == 7 && in_checkpoint && fields[1].len > 0 &&
+                   money_parse(fields[4].str, (gssize)fields[4].len, &d.product.price) &&
+                   csv_field_to_int(&fields[5], &d.product.quantity) &&
+                   csv_field_to_int(&fields[6], &d.product.sold)) {
+            g_strlcpy(d.product.id, fields[1].str, sizeof(d.product.id));
+            g_strlcpy(d.product.name, fields[2].str, sizeof(d.product.name));
+            g_strlcpy(d.product.category, fields[3].str, sizeof(d.product.category));
+            g_array_append_val(rows, d);
+        } else {
+            csv_reader_reject(r);  /* Broken line - count it and skip it */
+        }
     }
+    /* Rows left over belong to a checkpoint that has no C line - not applied */
 
-    fclose(f);  /* Close file when done */
+    g_array_unref(rows);
+    close_csv(r, path);
     return TRUE;
 }
 
+gboolean storage_load_product_delta(const char *path, const char *base_path,
+                                    gboolean *stale, GError **error) {
+    TRACE_BEGIN("storage_load_delta");
+    METRIC_START(start);
+    gboolean ok = do_storage_load_product_delta(path, base_path, stale, error);
+    METRIC_STOP(METRIC_LOAD_PRODUCT_DELTA, start, ok);
+    TRACE_END("storage_load_delta");
+    return ok;
+}
+
 /* This function reads history from a CSV file */
 /* History is like a log of everything we did */
 gboolean storage_load_history(const char *path, GError **error) {
-    FILE *f = fopen(path, "r");
-    if (!f) {
-        /* File doesn't exist - that's OK, maybe first time */
-        return TRUE;
-    }
+    return storage_load_history_from(path, 0, error);
+}
 
-    char line[512];
-    /* Read each line */
-    while (fgets(line, sizeof(line), f)) {
-        trim_newline(line);
-        if (line[0] == '\0') continue;  /* Skip empty lines */
+/* Same as storage_load_history, but starts reading at a byte offset */
+/* The history snapshot uses this to read only the lines it doesn't have yet */
+static gboolean do_storage_load_history_from(const char *path, gint64 offset, GError **error) {
+    GError *err = NULL;
+    CsvReader *r = open_csv(path, offset, &err);
+    if (!r) {
+        if (!err) return TRUE;  /* File doesn't exist - that's OK, maybe first time */
+        g_propagate_error(error, err);
+        return FALSE;
+    }
 
-        /* Create a new HistoryEntry */
-        HistoryEntry *h = g_new0(HistoryEntry, 1);
-        char ts_str[64], qty_str[64], val_str[64];  /* Temp strings for numbers */
-
-        /* Parse the line: timestamp,operation,product_id,quantity_change,value_change,description */
-        if (sscanf(line, "%63[^,],%15[^,],%31[^,],%63[^,],%63[^,],%127[^\n]",
-                   ts_str, h->operation, h->product_id,
-                   qty_str, val_str, h->description) != 6) {
-            /* Bad line - skip it */
-            g_free(h);
+    CsvField *fields;
+    guint n;
+    /* Read each record: timestamp,operation,product_id,quantity_change,value_change,description */
+    /* plus a transaction number for entries that were part of one */
+    while (csv_reader_next(r, &fields, &n)) {
+        gint64 ts, txn = 0;
+        int qty;
+        Money value;
+        if ((n != 6 && n != 7) || fields[1].len == 0 ||
+            !csv_field_to_int64(&fields[0], &ts) || ts < 0 || ts > G_MAXUINT32 ||
+            !csv_field_to_int(&fields[3], &qty) ||
+            !money_parse(fields[4].str, (gssize)fields[4].len, &value) ||
+            (n == 7 && (!csv_field_to_int64(&fields[6], &txn) || txn < 0 || txn > G_MAXUINT32))) {
+            csv_reader_reject(r);  /* Bad line - count it and skip it */
             continue;
         }
 
-        /* Convert strings to numbers */
-        h->timestamp = (time_t)g_ascii_strtoll(ts_str, NULL, 10);
-        h->quantity_change = (int)g_ascii_strtoll(qty_str, NULL, 10);
-        h->value_change = g_ascii_strtod(val_str, NULL);
+        /* Create a new HistoryEntry */
+        HistoryEntry *h = pool_new_history();
+        h->timestamp = (guint32)ts;
+        h->txn = (guint32)txn;
+        h->op = history_intern(fields[1].str);  /* "ADD" etc. come out as their HistoryOp */
+        h->product = history_intern(fields[2].str);
+        h->quantity_change = qty;
+        h->value_change = value;
+        h->description = history_intern(fields[5].str);
 
         /* Add to history list */
-        g_ptr_array_add(history, h);
+        history_list_append(history, h);
     }
 
-    fclose(f);
+    close_csv(r, path);
     return TRUE;
 }
 
+gboolean storage_load_history_from(const char *path, gint64 offset, GError **error) {
+    TRACE_BEGIN("storage_load_history_from");
+    METRIC_START(start);
+    gboolean ok = do_storage_load_history_from(path, offset, error);
+    METRIC_STOP(METRIC_LOAD_HISTORY, start, ok);
+    TRACE_END("storage_load_history_from");
+    return ok;
+}
+
+/* Turn one history entry into one CSV line (used by save and by the journal) */
+/* The transaction column is only written for entries that have one, so */
+/* everything else looks exactly like before */
+static void append_history_line(GString *out, const HistoryEntry *h) {
+    char value_buf[MONEY_BUF_SIZE];
+    g_string_append_printf(out, "%u,", h->timestamp);
+    csv_append_field(out, history_op_name(h));
+    g_string_append_c(out, ',');
+    csv_append_field(out, history_product_id(h));
+    g_string_append_printf(out, ",%d,%s,", h->quantity_change,
+                           money_format(h->value_change, value_buf, sizeof(value_buf)));
+    csv_append_field(out, history_description(h));
+    if (h->txn) g_string_append_printf(out, ",%u", h->txn);
+    g_string_append_c(out, '\n');
+}
+
 /* This function saves all history to a CSV file */
 /* Same idea as saving products, but for history entries */
+/* The app doesn't need this at shutdown anymore (the journal keeps history.csv */
+/* up to date), but it's still handy for exporting history somewhere else */
+static gboolean do_storage_save_history(const char *path, GError **error) {
+    char *tmp_path;
+    FILE *f = open_temp(path, &tmp_path, 2, error);
+    if (!f) return FALSE;
+
+    /* Write each history entry as one line */
+    GString *line = g_string_new(NULL);
+    for (guint i = 0; i < history->len; i++) {
+        HistoryEntry *h = history_index(history, i);
+        g_string_truncate(line, 0);
+        append_history_line(line, h);
+        fwrite(line->str, 1, line->len, f);
+    }
+    g_string_free(line, TRUE);
+
+    return replace_with_temp(f, tmp_path, path, error);
+}
+
 gboolean storage_save_history(const char *path, GError **error) {
-    FILE *f = fopen(path, "w");
+    TRACE_BEGIN("storage_save_history");
+    METRIC_START(start);
+    gboolean ok = do_storage_save_history(path, error);
+    METRIC_STOP(METRIC_SAVE_HISTORY, start, ok);
+    TRACE_END("storage_save_history");
+    return ok;
+}
+
+/* The journal state - only one journal is open at a time */
+static FILE *journal_file = NULL;      /* history.csv opened for appending */
+static char *journal_path = NULL;      /* For error messages */
+static GString *journal_buf = NULL;    /* Entries waiting to be written */
+static guint journal_timer = 0;        /* Timer that does the periodic commit */
+static guint journal_interval_ms = 0;  /* How often we fsync */
+static gboolean journal_unsynced = FALSE;  /* Written but not fsync'ed yet */
+static gint64 journal_size = 0;        /* Bytes in the file so far (where a failed write is cut back to) */
+/* Entries can be appended from any thread, so there are two locks: */
+/* journal_lock for the buffer (held only for a memcpy), and write_lock for */
+/* the file, so a slow fsync doesn't hold up the threads appending entries */
+static GMutex journal_lock;
+static GMutex write_lock;
+static GString *journal_spare = NULL;  /* Swapped with journal_buf while writing */
+
+/* Timer callback - commit whatever piled up since last time */
+static gboolean journal_timer_cb(gpointer user_data) {
+    GError *err = NULL;
+    if (!storage_journal_flush(TRUE, &err)) {
+        g_warning("Error writing history journal: %s", err->message);
+        g_clear_error(&err);
+    }
+    return G_SOURCE_CONTINUE;  /* Keep the timer running */
+}
+
+/* This function opens the history journal */
+/* Call it after storage_load_history so old entries aren't appended twice */
+gboolean storage_journal_open(const char *path, guint fsync_interval_ms, GError **error) {
+    storage_journal_close();  /* Only one journal at a time */
+
+    FILE *f = fopen(path, "ab");  /* Append mode - never truncates */
     if (!f) {
         g_set_error(error, g_quark_from_static_string("storage"),
-                    2, "Failed to open %s for writing", path);
+                    3, "Failed to open %s for appending", path);
         return FALSE;
     }
 
-    /* Write each history entry as one line */
-    for (guint i = 0; i < history->len; i++) {
-        HistoryEntry *h = g_ptr_array_index(history, i);
-        fprintf(f, "%lld,%s,%s,%d,%.2f,%s\n",
-                (long long)h->timestamp, h->operation, h->product_id,
-                h->quantity_change, h->value_change, h->description);
+    /* If we crashed in the middle of a line last time, finish that line */
+    /* first so the next entry doesn't get glued onto the broken one */
+    FILE *check = fopen(path, "rb");
+    if (check) {
+        if (fseek(check, -1, SEEK_END) == 0 && fgetc(check) != '\n') {
+            fputc('\n', f);
+        }
+        fclose(check);
     }
+    /* Batches are already collected in journal_buf - no stdio buffer on top, */
+    /* so a failed write never leaves bytes behind that go out later */
+    fflush(f);
+    setvbuf(f, NULL, _IONBF, 0);
+    fseek(f, 0, SEEK_END);
 
-    fclose(f);
+    journal_file = f;
+    journal_size = ftell(f);
+    journal_path = g_strdup(path);
+    journal_buf = g_string_sized_new(JOURNAL_BATCH_BYTES);
+    journal_spare = g_string_sized_new(JOURNAL_BATCH_BYTES);
+    journal_interval_ms = fsync_interval_ms;
+    journal_unsynced = FALSE;
+    if (fsync_interval_ms > 0) {
+        journal_timer = g_timeout_add(fsync_interval_ms, journal_timer_cb, NULL);
+    }
     return TRUE;
 }
 
+/* This function queues one history entry for the journal */
+/* It's cheap: the line goes into a memory buffer and is written in a batch */
+void storage_journal_append(const HistoryEntry *h) {
+    storage_journal_append_batch(&h, 1);
+}
+
+void storage_journal_append_batch(const HistoryEntry *const *entries, guint n) {
+    storage_journal_queue_batch(entries, n);
+    storage_journal_commit();
+}
+
+/* All the lines go into the buffer under one lock, and a flush always writes */
+/* the whole buffer, so a batch is never split over two writes */
+/* This never touches the file, so it's fine to call with other locks held */
+void storage_journal_queue_batch(const HistoryEntry *const *entries, guint n) {
+    if (!journal_file) return;  /* No journal open (e.g. while loading) */
+
+    g_mutex_lock(&journal_lock);
+    for (guint i = 0; i < n; i++) {
+        append_history_line(journal_buf, entries[i]);
+    }
+    g_mutex_unlock(&journal_lock);
+}
+
+/* This function writes the queued entries if it's time to: right away when */
+/* every entry is synced, or when the buffer is full. Otherwise the timer does it */
+void storage_journal_commit(void) {
+    if (!journal_file) return;
+
+    g_mutex_lock(&journal_lock);
+    gboolean full = journal_buf->len >= JOURNAL_BATCH_BYTES;
+    g_mutex_unlock(&journal_lock);
+
+    GError *err = NULL;
+    gboolean ok = TRUE;
+    if (journal_interval_ms == 0) {
+        ok = storage_journal_flush(TRUE, &err);  /* Every entry is synced right away */
+    } else if (full) {
+        ok = storage_journal_flush(FALSE, &err);  /* Big batch - write it, sync on the timer */
+    }
+    if (!ok) {
+        g_warning("Error writing history journal: %s", err->message);
+        g_clear_error(&err);
+    }
+}
+
+/* Shrink the journal back to size bytes (after a failed write) */
+static gboolean journal_truncate(gint64 size) {
+#ifdef G_OS_UNIX
+    return ftruncate(fileno(journal_file), (off_t)size) == 0;
+#else
+    return _chsize_s(_fileno(journal_file), size) == 0;
+#endif
+}
+
+/* This function writes all queued entries in one go */
+/* If sync is TRUE it also fsyncs, so the entries survive a power cut */
+gboolean storage_journal_flush(gboolean sync, GError **error) {
+    if (!journal_file) return TRUE;
+
+    METRIC_START(start);
+    g_mutex_lock(&write_lock);
+    /* Take the queued entries and leave an empty buffer for new ones */
+    g_mutex_lock(&journal_lock);
+    GString *batch = journal_buf;
+    journal_buf = journal_spare;
+    journal_spare = batch;
+    g_mutex_unlock(&journal_lock);
+
+    gboolean ok = TRUE;
+    /* Only flushes that had something to do are timed (most timer ticks don't) */
+    gboolean busy = batch->len > 0 || (sync && journal_unsynced);
+    if (busy) TRACE_BEGIN("storage_journal_flush");
+    if (batch->len > 0) {
+        size_t written = fwrite(batch->str, 1, batch->len, journal_file);
+        if (written != batch->len) {
+            g_set_error(error, g_quark_from_static_string("storage"),
+                        4, "Failed to append to %s", journal_path);
+            /* Cut off the part that did get written, or the retry would write */
+            /* those lines twice. If that fails too, only retry the rest */
+            clearerr(journal_file);
+            gsize keep = written;
+            if (journal_truncate(journal_size)) keep = 0;
+            else journal_size += (gint64)written;
+            /* Put the entries back in front of the new ones to try again next time */
+            g_mutex_lock(&journal_lock);
+            g_string_prepend_len(journal_buf, batch->str + keep, (gssize)(batch->len - keep));
+            g_mutex_unlock(&journal_lock);
+            ok = FALSE;
+        } else {
+            journal_size += (gint64)batch->len;
+            journal_unsynced = TRUE;
+        }
+        g_string_truncate(batch, 0);
+    }
+
+    if (ok && sync && journal_unsynced) {
+        if (g_fsync(fileno(journal_file)) != 0) {
+            g_set_error(error, g_quark_from_static_string("storage"),
+                        5, "Failed to sync %s", journal_path);
+            ok = FALSE;
+        } else {
+            journal_unsynced = FALSE;
+        }
+    }
+    g_mutex_unlock(&write_lock);
+    if (busy) {
+        METRIC_STOP(METRIC_JOURNAL_FLUSH, start, ok);
+        TRACE_END("storage_journal_flush");
+    }
+    return ok;
+}
+
+/* This function closes the journal at shutdown */
+/* It only writes what's still queued, so it's fast no matter how big history is */
+void storage_journal_close(void) {
+    if (!journal_file) return;
+
+    GError *err = NULL;
+    if (!storage_journal_flush(TRUE, &err)) {
+        g_warning("Error writing history journal: %s", err->message);
+        g_clear_error(&err);
+    }
+    if (journal_timer) {
+        g_source_remove(journal_timer);
+        journal_timer = 0;
+    }
+    fclose(journal_file);
+    journal_file = NULL;
+    g_free(journal_path);
+    journal_path = NULL;
+    g_string_free(journal_buf, TRUE);
+    journal_buf = NULL;
+    g_string_free(journal_spare, TRUE);
+    journal_spare = NULL;
+}
+
 
@@ -9,11 +9,48 @@
 /* Functions to work with products */
 gboolean storage_load_products(const char *path, GError **error);  /* Read products from file */
 gboolean storage_save_products(const char *path, GError **error); /* Write products to file */
+/* Same, but for any list of products (autosave.c passes a copy) */
+gboolean storage_save_product_list(const char *path, GPtrArray *list, GError **error);
+/* Saving writes path.tmp, fsyncs it and renames it over path, so a crash */
+/* never leaves a half-written file behind */
+
+/* Delta checkpoints - the products that changed since base_path (products.csv) */
+/* was written, appended to path (products.delta) as ProductDelta rows */
+gboolean storage_append_product_delta(const char *path, const char *base_path,
+                                      GArray *rows, GError **error);
+/* Apply the finished checkpoints in path on top of the loaded products */
+/* stale = TRUE if path belongs to an older base_path (nothing is applied) */
+gboolean storage_load_product_delta(const char *path, const char *base_path,
+                                    gboolean *stale, GError **error);
+
+/* Size and mtime (whole seconds + nanoseconds) of a file - what products.delta */
+/* and the snapshots remember to tell whether their CSV file changed since */
+/* FALSE (and all zeros) if the file doesn't exist */
+gboolean storage_file_stamp(const char *path, gint64 *size, gint64 *mtime, gint64 *nsec);
 
 /* Functions to work with history */
 gboolean storage_load_history(const char *path, GError **error);  /* Read history from file */
+gboolean storage_load_history_from(const char *path, gint64 offset, GError **error);  /* Read from byte offset on */
+
+/* Broken lines are skipped while loading - this counts them */
+guint64 storage_malformed_lines(void);
 gboolean storage_save_history(const char *path, GError **error);  /* Write history to file */
 
+/* History journal - history.csv is kept open and new entries are appended to it */
+/* Entries are batched in memory and written together (group commit), and the */
+/* file is fsync'ed every fsync_interval_ms (0 = after every entry) */
+gboolean storage_journal_open(const char *path, guint fsync_interval_ms, GError **error);
+void storage_journal_append(const HistoryEntry *h);  /* Queue one entry for writing */
+/* Queue several entries that belong together (a transaction) - they always */
+/* go to the file in the same write, and are synced together */
+void storage_journal_append_batch(const HistoryEntry *const *entries, guint n);
+/* The two halves of append_batch: queue only fills the buffer (cheap, fine */
+/* under a lock), commit writes it if it's time - call it with no locks held */
+void storage_journal_queue_batch(const HistoryEntry *const *entries, guint n);
+void storage_journal_commit(void);
+gboolean storage_journal_flush(gboolean sync, GError **error);  /* Write queued entries now */
+void storage_journal_close(void);  /* Flush, fsync and close the journal */
+
 #endif /* STORAGE_H */
 
 
@@ -0,0 +1,108 @@
+#include "trace.h"
+#include "metrics.h"
+
+/* Events kept per thread - 24 bytes each, so a buffer is 768 KB */
+#define TRACE_RING_EVENTS 32768
+
+typedef struct {
+    const char *name;
+    gint64 ns;   /* metrics_now() */
+    char phase;  /* 'B' = begin, 'E' = end */
+} TraceEvent;
+
+/* One thread's events. Only that thread writes to it */
+typedef struct {
+    guint tid;                /* 1, 2, 3... in the order threads first traced something */
+    const char *thread_name;  /* NULL = "thread <tid>" */
+    guint64 written;          /* Events ever written - the next one goes in written % size */
+    TraceEvent events[TRACE_RING_EVENTS];
+} TraceBuffer;
+
+gint trace_active = 0;
+static gint64 trace_origin = 0;      /* Timestamps in the file count from here */
+static char *trace_path = NULL;
+static GMutex buffers_lock;          /* Only taken the first time a thread traces */
+static GPtrArray *buffers = NULL;    /* Every thread's TraceBuffer */
+static GPrivate current_buffer = G_PRIVATE_INIT(NULL);
+
+/* The calling thread's buffer, made the first time it's needed */
+static TraceBuffer *thread_buffer(void) {
+    TraceBuffer *b = g_private_get(&current_buffer);
+    if (b) return b;
+    b = g_new0(TraceBuffer, 1);
+    g_mutex_lock(&buffers_lock);
+    g_ptr_array_add(buffers, b);
+    b->tid = buffers->len;
+    g_mutex_unlock(&buffers_lock);
+    g_private_set(&current_buffer, b);
+    return b;
+}
+
+void trace_event(const char *name, char phase) {
+    TraceBuffer *b = thread_buffer();
+    TraceEvent *e = &b->events[b->written % TRACE_RING_EVENTS];
+    e->name = name;
+    e->ns = metrics_now();
+    e->phase = phase;
+    b->written++;
+}
+
+void trace_start(const char *path) {
+    if (buffers) return;  /* Only once per run */
+    trace_path = g_strdup(path);
+    buffers = g_ptr_array_new();
+    trace_origin = metrics_now();
+    g_atomic_int_set(&trace_active, 1);
+    trace_set_thread_name("main");
+}
+
+void trace_start_from_env(void) {
+    const char *path = g_getenv("STOCK_TRACE");
+    if (path && *path) trace_start(path);
+}
+
+void trace_set_thread_name(const char *name) {
+    if (!trace_active) return;
+    thread_buffer()->thread_name = name;
+}
+
+static void append_event(GString *out, guint tid, const TraceEvent *e) {
+    g_string_append_printf(out, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+                           "\"pid\":1,\"tid\":%u}",
+                           e->name, e->phase, (double)(e->ns - trace_origin) / 1000.0, tid);
+}
+
+gboolean trace_stop(GError **error) {
+    if (!trace_active) return TRUE;
+    g_atomic_int_set(&trace_active, 0);
+
+    /* Chrome's format: begin/end pairs per thread, times in microseconds */
+    GString *out = g_string_new("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    g_string_append_printf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                           "\"args\":{\"name\":\"%s\"}}",
+                           g_get_prgname() ? g_get_prgname() : "stock");
+    g_mutex_lock(&buffers_lock);
+    for (guint i = 0; i < buffers->len; i++) {
+        TraceBuffer *b = g_ptr_array_index(buffers, i);
+        g_string_append_printf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                               "\"tid\":%u,\"args\":{\"name\":\"", b->tid);
+        if (b->thread_name) g_string_append(out, b->thread_name);
+        else g_string_append_printf(out, "thread %u", b->tid);
+        g_string_append(out, "\"}}");
+
+        /* If the ring went round, the oldest events are gone - start at the oldest left */
+        guint64 first = b->written > TRACE_RING_EVENTS ? b->written - TRACE_RING_EVENTS : 0;
+        for (guint64 n = first; n < b->written; n++) {
+            append_event(out, b->tid, &b->events[n % TRACE_RING_EVENTS]);
+        }
+    }
+    g_mutex_unlock(&buffers_lock);
+    g_string_append(out, "\n]}\n");
+
+    gboolean ok = g_file_set_contents(trace_path, out->str, (gssize)out->len, error);
+    g_string_free(out, TRUE);
+    g_clear_pointer(&trace_path, g_free);
+    /* The buffers stay until the program ends: a thread that started an event */
+    /* just before tracing was turned off could still be writing to its buffer */
+    return ok;
+}
@@ -0,0 +1,38 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <glib.h>
+
+/* This file records when the big steps (loading, saving, refreshing...) */
+/* start and end, on every thread, and writes them as a Chrome trace JSON */
+/* file. Open it in https://ui.perfetto.dev or chrome://tracing to see */
+/* which step of startup or shutdown is slow. */
+/* */
+/* It's off unless trace_start is called (the app and stock_cli do that when */
+/* STOCK_TRACE=file.json is set). While it's off TRACE_BEGIN/END only read */
+/* one int. While it's on, every thread writes to its own ring buffer */
+/* without any locks, so tracing hardly changes the timings. When a buffer */
+/* is full the oldest events are overwritten. */
+
+/* Don't read this directly, it's here for the macros */
+extern gint trace_active;
+
+/* Span names must be string literals (only the pointer is kept) */
+#define TRACE_BEGIN(name) \
+    G_STMT_START { if (G_UNLIKELY(trace_active)) trace_event((name), 'B'); } G_STMT_END
+#define TRACE_END(name) \
+    G_STMT_START { if (G_UNLIKELY(trace_active)) trace_event((name), 'E'); } G_STMT_END
+
+void trace_event(const char *name, char phase);
+
+/* Start recording - the file is written by trace_stop (once per run) */
+void trace_start(const char *path);
+/* Start recording if STOCK_TRACE is set (to the file to write) */
+void trace_start_from_env(void);
+/* Give the calling thread a name in the trace (a literal, like "loader") */
+void trace_set_thread_name(const char *name);
+/* Stop recording and write the file */
+/* Call it when the other threads are done, they aren't waited for */
+gboolean trace_stop(GError **error);
+
+#endif /* TRACE_H */
@@ -1,82 +1,79 @@
 #include "ui_dialogs.h"
 #include "logic.h"
+#include "history.h"
+#include "report.h"
+#include "metrics.h"
 #include "ui_main_window.h"
+#include "ui_history_model.h"
 
 /* This file has all the dialog windows - like popup boxes for user input */
 /* Each function shows a different dialog for different operations */
 
-/* GTK4 doesn't have gtk_dialog_run anymore, so I made my own version */
-/* This makes the dialog wait for the user to click OK or Cancel */
-
-/* This gets called when user clicks OK or Cancel */
-static void on_dialog_response(GtkDialog *dialog,
-                               int response_id,
-                               gpointer user_data) {
-    int *resp = (int *)user_data;
-    *resp = response_id;  /* Save which button they clicked */
-}
-
-/* This function makes a dialog wait for user input */
-/* It's like gtk_dialog_run but works in GTK4 */
-static int run_dialog_blocking(GtkDialog *dialog) {
-    int response = GTK_RESPONSE_NONE;
-    /* Connect the signal so we know when user clicks */
-    g_signal_connect(dialog, "response",
-                     G_CALLBACK(on_dialog_response), &response);
-    gtk_widget_show(GTK_WIDGET(dialog));
-    /* Wait in a loop until user clicks something */
-    while (response == GTK_RESPONSE_NONE) {
-        while (g_main_context_pending(NULL)) {
-            g_main_context_iteration(NULL, TRUE);
-        }
-        g_main_context_iteration(NULL, TRUE);
-    }
-    return response;  /* Return which button they clicked */
+/* None of these dialogs wait for the user. Showing a dialog just connects */
+/* its "response" signal and returns, and the response function does the */
+/* work when a button is clicked. (Spinning the main loop until a button */
+/* was clicked kept the CPU busy and ran other events in the middle of ours) */
+
+/* This shows a dialog and calls on_response when the user clicks a button */
+static void show_dialog(GtkWidget *dialog, GCallback on_response) {
+    g_signal_connect(dialog, "response", on_response, NULL);
+    gtk_window_present(GTK_WINDOW(dialog));
 }
 
-/* Show an error message popup */
-static void show_error(GtkWindow *parent, const char *msg) {
+/* Message popups only have OK, so clicking it just closes them */
+static void on_message_response(GtkDialog *dialog, int response_id, gpointer user_data) {
+    gtk_window_destroy(GTK_WINDOW(dialog));
+}
+
+/* Show a message popup - returns right away, the popup closes itself */
+static void show_message(GtkWindow *parent, GtkMessageType type, const char *msg) {
     GtkWidget *d = gtk_message_dialog_new(parent,
                                           GTK_DIALOG_MODAL,
-                                          GTK_MESSAGE_ERROR,
+                                          type,
                                           GTK_BUTTONS_OK,
                                           "%s", msg);
-    run_dialog_blocking(GTK_DIALOG(d));  /* Wait for user to click OK */
-    gtk_window_destroy(GTK_WINDOW(d));
+    show_dialog(d, G_CALLBACK(on_message_response));
+}
+
+/* Show an error message popup */
+static void show_error(GtkWindow *parent, const char *msg) {
+    show_message(parent, GTK_MESSAGE_ERROR, msg);
 }
 
 /* Show an info message popup */
 static void show_info(GtkWindow *parent, const char *msg) {
-    GtkWidget *d = gtk_message_dialog_new(parent,
-                                          GTK_DIALOG_MODAL,
-                                          GTK_MESSAGE_INFO,
-                                          GTK_BUTTONS_OK,
-                                          "%s", msg);
-    run_dialog_blocking(GTK_DIALOG(d));
-    gtk_window_destroy(GTK_WINDOW(d));
+    show_message(parent, GTK_MESSAGE_INFO, msg);
+}
+
+/* The entries are stored on the dialog by name, so the response function */
+/* can read them later */
+static const char *get_entry_text(GtkDialog *dialog, const char *name) {
+    return gtk_editable_get_text(GTK_EDITABLE(g_object_get_data(G_OBJECT(dialog), name)));
 }
 
 /* Helper function to make a label + text box together */
 /* I use this a lot so I made it a function */
-static GtkWidget *add_labeled_entry(GtkWidget *box, const char *label, GtkWidget **entry_out) {
+/* The entry is stored on the dialog under name (see get_entry_text) */
+static GtkWidget *add_labeled_entry(GtkWidget *dialog, GtkWidget *box, const char *label,
+                                    const char *name) {
     GtkWidget *h = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);  /* Horizontal box */
     GtkWidget *lbl = gtk_label_new(label);  /* The label text */
     GtkWidget *entry = gtk_entry_new();  /* The text input box */
     gtk_box_append(GTK_BOX(h), lbl);  /* Put label in box */
     gtk_box_append(GTK_BOX(h), entry);  /* Put entry in box */
     gtk_box_append(GTK_BOX(box), h);  /* Put the whole thing in parent box */
-    if (entry_out) *entry_out = entry;  /* Return the entry so I can use it later */
+    g_object_set_data(G_OBJECT(dialog), name, entry);  /* So I can find it later */
     return entry;
 }
 
-/* This shows the dialog to add a new product */
-/* User enters ID, name, category, price, and quantity */
-void ui_show_add_product_dialog(GtkWindow *parent) {
-    GtkWidget *dialog = gtk_dialog_new_with_buttons("Add Product",
+/* This makes a dialog with Cancel + ok_label buttons and an empty box for the entries */
+static GtkWidget *new_form_dialog(GtkWindow *parent, const char *title, const char *ok_label,
+                                  GtkWidget **vbox_out) {
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(title,
                                                     parent,
                                                     GTK_DIALOG_MODAL,
                                                     "_Cancel", GTK_RESPONSE_CANCEL,
-                                                    "_Add", GTK_RESPONSE_OK,
+                                                    ok_label, GTK_RESPONSE_OK,
                                                     NULL);
     GtkWidget *content = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
     GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
@@ -85,66 +82,55 @@ void ui_show_add_product_dialog(GtkWindow *parent) {
     gtk_widget_set_margin_start(vbox, 8);
     gtk_widget_set_margin_end(vbox, 8);
     gtk_box_append(GTK_BOX(content), vbox);
+    *vbox_out = vbox;
+    return dialog;
+}
 
-    GtkWidget *entry_id, *entry_name, *entry_cat, *entry_price, *entry_qty;
-    add_labeled_entry(vbox, "ID:", &entry_id);
-    add_labeled_entry(vbox, "Name:", &entry_name);
-    add_labeled_entry(vbox, "Category:", &entry_cat);
-    add_labeled_entry(vbox, "Price:", &entry_price);
-    add_labeled_entry(vbox, "Quantity:", &entry_qty);
-
-    int resp = run_dialog_blocking(GTK_DIALOG(dialog));
-    if (resp == GTK_RESPONSE_OK) {
-        const char *id = gtk_editable_get_text(GTK_EDITABLE(entry_id));
-        const char *name = gtk_editable_get_text(GTK_EDITABLE(entry_name));
-        const char *cat = gtk_editable_get_text(GTK_EDITABLE(entry_cat));
-        const char *price_str = gtk_editable_get_text(GTK_EDITABLE(entry_price));
-        const char *qty_str = gtk_editable_get_text(GTK_EDITABLE(entry_qty));
+/* This runs when the user clicks Add or Cancel */
+static void on_add_product_response(GtkDialog *dialog, int response_id, gpointer user_data) {
+    GtkWindow *parent = gtk_window_get_transient_for(GTK_WINDOW(dialog));
+    if (response_id == GTK_RESPONSE_OK) {
+        const char *id = get_entry_text(dialog, "id");
+        const char *name = get_entry_text(dialog, "name");
+        const char *cat = get_entry_text(dialog, "category");
+        const char *price_str = get_entry_text(dialog, "price");
+        const char *qty_str = get_entry_text(dialog, "quantity");
 
         GError *err = NULL;
-        double price = g_ascii_strtod(price_str, NULL);
+        Money price = 0;
         int qty = (int)g_ascii_strtoll(qty_str, NULL, 10);
 
-        if (!add_product(id, name, cat, price, qty, &err)) {
+        if (!money_parse(price_str, -1, &price)) {
+            show_error(parent, "Price must be a number with at most 2 decimals");
+        } else if (!add_product(id, name, cat, price, qty, &err)) {
             show_error(parent, err->message);
             g_clear_error(&err);
         } else {
             show_info(parent, "Product added successfully.");
-            ui_refresh_products_table();
-            ui_refresh_history_view();
         }
     }
 
     gtk_window_destroy(GTK_WINDOW(dialog));
 }
 
-/**
- * Show dialog to update stock for an existing product.
- * Collects product ID and quantity to add (must be > 5).
- */
-void ui_show_update_stock_dialog(GtkWindow *parent) {
-    GtkWidget *dialog = gtk_dialog_new_with_buttons("Update Stock",
-                                                    parent,
-                                                    GTK_DIALOG_MODAL,
-                                                    "_Cancel", GTK_RESPONSE_CANCEL,
-                                                    "_Update", GTK_RESPONSE_OK,
-                                                    NULL);
-    GtkWidget *content = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
-    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
-    gtk_widget_set_margin_top(vbox, 8);
-    gtk_widget_set_margin_bottom(vbox, 8);
-    gtk_widget_set_margin_start(vbox, 8);
-    gtk_widget_set_margin_end(vbox, 8);
-    gtk_box_append(GTK_BOX(content), vbox);
-
-    GtkWidget *entry_id, *entry_qty;
-    add_labeled_entry(vbox, "Product ID:", &entry_id);
-    add_labeled_entry(vbox, "Quantity to add:", &entry_qty);
+/* This shows the dialog to add a new product */
+/* User enters ID, name, category, price, and quantity */
+void ui_show_add_product_dialog(GtkWindow *parent) {
+    GtkWidget *vbox;
+    GtkWidget *dialog = new_form_dialog(parent, "Add Product", "_Add", &vbox);
+    add_labeled_entry(dialog, vbox, "ID:", "id");
+    add_labeled_entry(dialog, vbox, "Name:", "name");
+    add_labeled_entry(dialog, vbox, "Category:", "category");
+    add_labeled_entry(dialog, vbox, "Price:", "price");
+    add_labeled_entry(dialog, vbox, "Quantity:", "quantity");
+    show_dialog(dialog, G_CALLBACK(on_add_product_response));
+}
 
-    int resp = run_dialog_blocking(GTK_DIALOG(dialog));
-    if (resp == GTK_RESPONSE_OK) {
-        const char *id = gtk_editable_get_text(GTK_EDITABLE(entry_id));
-        const char *qty_str = gtk_editable_get_text(GTK_EDITABLE(entry_qty));
+static void on_update_stock_response(GtkDialog *dialog, int response_id, gpointer user_data) {
+    GtkWindow *parent = gtk_window_get_transient_for(GTK_WINDOW(dialog));
+    if (response_id == GTK_RESPONSE_OK) {
+        const char *id = get_entry_text(dialog, "id");
+        const char *qty_str = get_entry_text(dialog, "quantity");
         int qty = (int)g_ascii_strtoll(qty_str, NULL, 10);
 
         GError *err = NULL;
@@ -153,8 +139,6 @@ void ui_show_update_stock_dialog(GtkWindow *parent) {
             g_clear_error(&err);
         } else {
             show_info(parent, "Stock updated successfully.");
-            ui_refresh_products_table();
-            ui_refresh_history_view();
         }
     }
 
@@ -162,46 +146,35 @@ void ui_show_update_stock_dialog(GtkWindow *parent) {
 }
 
 /**
- * Show dialog to sell a product.
- * Collects product ID and quantity to sell, validates stock availability,
- * and displays total sale value on success.
+ * Show dialog to update stock for an existing product.
+ * Collects product ID and quantity to add (must be > 5).
  */
-void ui_show_sell_product_dialog(GtkWindow *parent) {
-    GtkWidget *dialog = gtk_dialog_new_with_buttons("Sell Product",
-                                                    parent,
-                                                    GTK_DIALOG_MODAL,
-                                                    "_Cancel", GTK_RESPONSE_CANCEL,
-                                                    "_Sell", GTK_RESPONSE_OK,
-                                                    NULL);
-    GtkWidget *content = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
-    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
-    gtk_widget_set_margin_top(vbox, 8);
-    gtk_widget_set_margin_bottom(vbox, 8);
-    gtk_widget_set_margin_start(vbox, 8);
-    gtk_widget_set_margin_end(vbox, 8);
-    gtk_box_append(GTK_BOX(content), vbox);
-
-    GtkWidget *entry_id, *entry_qty;
-    add_labeled_entry(vbox, "Product ID:", &entry_id);
-    add_labeled_entry(vbox, "Quantity to sell:", &entry_qty);
+void ui_show_update_stock_dialog(GtkWindow *parent) {
+    GtkWidget *vbox;
+    GtkWidget *dialog = new_form_dialog(parent, "Update Stock", "_Update", &vbox);
+    add_labeled_entry(dialog, vbox, "Product ID:", "id");
+    add_labeled_entry(dialog, vbox, "Quantity to add:", "quantity");
+    show_dialog(dialog, G_CALLBACK(on_update_stock_response));
+}
 
-    int resp = run_dialog_blocking(GTK_DIALOG(dialog));
-    if (resp == GTK_RESPONSE_OK) {
-        const char *id = gtk_editable_get_text(GTK_EDITABLE(entry_id));
-        const char *qty_str = gtk_editable_get_text(GTK_EDITABLE(entry_qty));
+static void on_sell_product_response(GtkDialog *dialog, int response_id, gpointer user_data) {
+    GtkWindow *parent = gtk_window_get_transient_for(GTK_WINDOW(dialog));
+    if (response_id == GTK_RESPONSE_OK) {
+        const char *id = get_entry_text(dialog, "id");
+        const char *qty_str = get_entry_text(dialog, "quantity");
         int qty = (int)g_ascii_strtoll(qty_str, NULL, 10);
 
         GError *err = NULL;
-        double total = 0.0;
+        Money total = 0;
         if (!sell_product(id, qty, &total, &err)) {
             show_error(parent, err->message);
             g_clear_error(&err);
         } else {
             char msg[128];
-            g_snprintf(msg, sizeof(msg), "Sale completed. Total = %.2f", total);
+            char total_buf[MONEY_BUF_SIZE];
+            g_snprintf(msg, sizeof(msg), "Sale completed. Total = %s",
+                       money_format(total, total_buf, sizeof(total_buf)));
             show_info(parent, msg);
-            ui_refresh_products_table();
-            ui_refresh_history_view();
         }
     }
 
@@ -209,30 +182,22 @@ void ui_show_sell_product_dialog(GtkWindow *parent) {
 }
 
 /**
- * Show dialog to check stock level for a product.
- * Displays current quantity and shows a warning if stock is below 5.
+ * Show dialog to sell a product.
+ * Collects product ID and quantity to sell, validates stock availability,
+ * and displays total sale value on success.
  */
-void ui_show_check_stock_dialog(GtkWindow *parent) {
-    GtkWidget *dialog = gtk_dialog_new_with_buttons("Check Stock Level",
-                                                    parent,
-                                                    GTK_DIALOG_MODAL,
-                                                    "_Cancel", GTK_RESPONSE_CANCEL,
-                                                    "_Check", GTK_RESPONSE_OK,
-                                                    NULL);
-    GtkWidget *content = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
-    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
-    gtk_widget_set_margin_top(vbox, 8);
-    gtk_widget_set_margin_bottom(vbox, 8);
-    gtk_widget_set_margin_start(vbox, 8);
-    gtk_widget_set_margin_end(vbox, 8);
-    gtk_box_append(GTK_BOX(content), vbox);
-
-    GtkWidget *entry_id;
-    add_labeled_entry(vbox, "Product ID:", &entry_id);
+void ui_show_sell_product_dialog(GtkWindow *parent) {
+    GtkWidget *vbox;
+    GtkWidget *dialog = new_form_dialog(parent, "Sell Product", "_Sell", &vbox);
+    add_labeled_entry(dialog, vbox, "Product ID:", "id");
+    add_labeled_entry(dialog, vbox, "Quantity to sell:", "quantity");
+    show_dialog(dialog, G_CALLBACK(on_sell_product_response));
+}
 
-    int resp = run_dialog_blocking(GTK_DIALOG(dialog));
-    if (resp == GTK_RESPONSE_OK) {
-        const char *id = gtk_editable_get_text(GTK_EDITABLE(entry_id));
+static void on_check_stock_response(GtkDialog *dialog, int response_id, gpointer user_data) {
+    GtkWindow *parent = gtk_window_get_transient_for(GTK_WINDOW(dialog));
+    if (response_id == GTK_RESPONSE_OK) {
+        const char *id = get_entry_text(dialog, "id");
         int qty = 0;
         GError *err = NULL;
         int res = get_stock_level(id, &qty, &err);
@@ -240,16 +205,14 @@ void ui_show_check_stock_dialog(GtkWindow *parent) {
             show_error(parent, err->message);
             g_clear_error(&err);
         } else {
-            char msg[128];
+            char msg[160];
             g_snprintf(msg, sizeof(msg), "Current stock for %s = %d", id, qty);
-            if (qty < 5) {
-                GtkWidget *d = gtk_message_dialog_new(parent,
-                                                      GTK_DIALOG_MODAL,
-                                                      GTK_MESSAGE_WARNING,
-                                                      GTK_BUTTONS_OK,
-                                                      "%s\nWarning: stock is below 5!", msg);
-                run_dialog_blocking(GTK_DIALOG(d));
-                gtk_window_destroy(GTK_WINDOW(d));
+            if (qty < LOW_STOCK_LIMIT) {
+                char warning[32];
+                g_snprintf(warning, sizeof(warning), "\nWarning: stock is below %d!",
+                           LOW_STOCK_LIMIT);
+                g_strlcat(msg, warning, sizeof(msg));
+                show_message(parent, GTK_MESSAGE_WARNING, msg);
             } else {
                 show_info(parent, msg);
             }
@@ -259,61 +222,50 @@ void ui_show_check_stock_dialog(GtkWindow *parent) {
     gtk_window_destroy(GTK_WINDOW(dialog));
 }
 
+/**
+ * Show dialog to check stock level for a product.
+ * Displays current quantity and shows a warning if stock is below 5.
+ */
+void ui_show_check_stock_dialog(GtkWindow *parent) {
+    GtkWidget *vbox;
+    GtkWidget *dialog = new_form_dialog(parent, "Check Stock Level", "_Check", &vbox);
+    add_labeled_entry(dialog, vbox, "Product ID:", "id");
+    show_dialog(dialog, G_CALLBACK(on_check_stock_response));
+}
+
 /**
  * Show dialog displaying total stock value.
  * Calculates and displays the sum of (price * quantity) for all products.
  */
 void ui_show_calculate_value_dialog(GtkWindow *parent) {
-    double total = compute_total_stock_value();
+    Money total = compute_total_stock_value();
     char msg[128];
-    g_snprintf(msg, sizeof(msg), "Total stock value = %.2f", total);
+    char total_buf[MONEY_BUF_SIZE];
+    g_snprintf(msg, sizeof(msg), "Total stock value = %s",
+               money_format(total, total_buf, sizeof(total_buf)));
     show_info(parent, msg);
 }
 
-/**
- * Show dialog to apply a discount to a product sale.
- * Collects product ID, quantity, and discount percentage (10-20%).
- * Calculates and displays the discounted total.
- */
-void ui_show_apply_discount_dialog(GtkWindow *parent) {
-    GtkWidget *dialog = gtk_dialog_new_with_buttons("Apply Discount",
-                                                    parent,
-                                                    GTK_DIALOG_MODAL,
-                                                    "_Cancel", GTK_RESPONSE_CANCEL,
-                                                    "_Apply", GTK_RESPONSE_OK,
-                                                    NULL);
-    GtkWidget *content = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
-    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
-    gtk_widget_set_margin_top(vbox, 8);
-    gtk_widget_set_margin_bottom(vbox, 8);
-    gtk_widget_set_margin_start(vbox, 8);
-    gtk_widget_set_margin_end(vbox, 8);
-    gtk_box_append(GTK_BOX(content), vbox);
-
-    GtkWidget *entry_id, *entry_qty, *entry_disc;
-    add_labeled_entry(vbox, "Product ID:", &entry_id);
-    add_labeled_entry(vbox, "Quantity:", &entry_qty);
-    add_labeled_entry(vbox, "Discount % (10-20):", &entry_disc);
-
-    int resp = run_dialog_blocking(GTK_DIALOG(dialog));
-    if (resp == GTK_RESPONSE_OK) {
-        const char *id = gtk_editable_get_text(GTK_EDITABLE(entry_id));
-        const char *qty_str = gtk_editable_get_text(GTK_EDITABLE(entry_qty));
-        const char *disc_str = gtk_editable_get_text(GTK_EDITABLE(entry_disc));
+static void on_apply_discount_response(GtkDialog *dialog, int response_id, gpointer user_data) {
+    GtkWindow *parent = gtk_window_get_transient_for(GTK_WINDOW(dialog));
+    if (response_id == GTK_RESPONSE_OK) {
+        const char *id = get_entry_text(dialog, "id");
+        const char *qty_str = get_entry_text(dialog, "quantity");
+        const char *disc_str = get_entry_text(dialog, "discount");
         int qty = (int)g_ascii_strtoll(qty_str, NULL, 10);
         double disc = g_ascii_strtod(disc_str, NULL);
 
         GError *err = NULL;
-        double discounted = 0.0;
+        Money discounted = 0;
         if (!apply_discount(id, qty, disc, &discounted, &err)) {
             show_error(parent, err->message);
             g_clear_error(&err);
         } else {
             char msg[128];
-            g_snprintf(msg, sizeof(msg),
-                       "Discounted total for %d units = %.2f", qty, discounted);
+            char total_buf[MONEY_BUF_SIZE];
+            g_snprintf(msg, sizeof(msg), "Discounted total for %d units = %s", qty,
+                       money_format(discounted, total_buf, sizeof(total_buf)));
             show_info(parent, msg);
-            ui_refresh_history_view();
         }
     }
 
@@ -321,54 +273,209 @@ void ui_show_apply_discount_dialog(GtkWindow *parent) {
 }
 
 /**
- * Show dialog to remove a product from inventory.
- * Collects product ID, shows confirmation dialog, and removes product if confirmed.
+ * Show dialog to apply a discount to a product sale.
+ * Collects product ID, quantity, and discount percentage (10-20%).
+ * Calculates and displays the discounted total.
  */
-void ui_show_remove_product_dialog(GtkWindow *parent) {
-    GtkWidget *dialog = gtk_dialog_new_with_buttons("Remove Product",
-                                                    parent,
-                                                    GTK_DIALOG_MODAL,
-                                                    "_Cancel", GTK_RESPONSE_CANCEL,
-                                                    "_Next", GTK_RESPONSE_OK,
-                                                    NULL);
-    GtkWidget *content = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
-    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
-    gtk_widget_set_margin_top(vbox, 8);
-    gtk_widget_set_margin_bottom(vbox, 8);
-    gtk_widget_set_margin_start(vbox, 8);
-    gtk_widget_set_margin_end(vbox, 8);
-    gtk_box_append(GTK_BOX(content), vbox);
+void ui_show_apply_discount_dialog(GtkWindow *parent) {
+    GtkWidget *vbox;
+    GtkWidget *dialog = new_form_dialog(parent, "Apply Discount", "_Apply", &vbox);
+    add_labeled_entry(dialog, vbox, "Product ID:", "id");
+    add_labeled_entry(dialog, vbox, "Quantity:", "quantity");
+    add_labeled_entry(dialog, vbox, "Discount % (10-20):", "discount");
+    show_dialog(dialog, G_CALLBACK(on_apply_discount_response));
+}
+
+/* The second step of removing: the user answered "are you sure?" */
+/* The product ID is stored on the question dialog */
+static void on_remove_confirm_response(GtkDialog *confirm, int response_id,
+                                       gpointer user_data) {
+    GtkWindow *parent = gtk_window_get_transient_for(GTK_WINDOW(confirm));
+    if (response_id == GTK_RESPONSE_YES) {
+        const char *id = g_object_get_data(G_OBJECT(confirm), "id");
+        GError *err = NULL;
+        if (!remove_product(id, &err)) {
+            show_error(parent, err->message);
+            g_clear_error(&err);
+        } else {
+            show_info(parent, "Product removed.");
+        }
+    }
 
-    GtkWidget *entry_id;
-    add_labeled_entry(vbox, "Product ID:", &entry_id);
+    gtk_window_destroy(GTK_WINDOW(confirm));
+}
 
-    int resp = run_dialog_blocking(GTK_DIALOG(dialog));
-    if (resp == GTK_RESPONSE_OK) {
-        const char *id = gtk_editable_get_text(GTK_EDITABLE(entry_id));
+static void on_remove_product_response(GtkDialog *dialog, int response_id, gpointer user_data) {
+    GtkWindow *parent = gtk_window_get_transient_for(GTK_WINDOW(dialog));
+    if (response_id == GTK_RESPONSE_OK) {
+        const char *id = get_entry_text(dialog, "id");
         GtkWidget *confirm = gtk_message_dialog_new(parent,
                                                     GTK_DIALOG_MODAL,
                                                     GTK_MESSAGE_QUESTION,
                                                     GTK_BUTTONS_YES_NO,
                                                     "Are you sure you want to remove product %s?",
                                                     id);
-        int c = run_dialog_blocking(GTK_DIALOG(confirm));
-        gtk_window_destroy(GTK_WINDOW(confirm));
-        if (c == GTK_RESPONSE_YES) {
-            GError *err = NULL;
-            if (!remove_product(id, &err)) {
-                show_error(parent, err->message);
-                g_clear_error(&err);
-            } else {
-                show_info(parent, "Product removed.");
-                ui_refresh_products_table();
-                ui_refresh_history_view();
-            }
-        }
+        /* The entry goes away with this dialog, so the question keeps its own copy */
+        g_object_set_data_full(G_OBJECT(confirm), "id", g_strdup(id), g_free);
+        show_dialog(confirm, G_CALLBACK(on_remove_confirm_response));
     }
 
     gtk_window_destroy(GTK_WINDOW(dialog));
 }
 
+/**
+ * Show dialog to remove a product from inventory.
+ * Collects product ID, shows confirmation dialog, and removes product if confirmed.
+ */
+void ui_show_remove_product_dialog(GtkWindow *parent) {
+    GtkWidget *vbox;
+    GtkWidget *dialog = new_form_dialog(parent, "Remove Product", "_Next", &vbox);
+    add_labeled_entry(dialog, vbox, "Product ID:", "id");
+    show_dialog(dialog, G_CALLBACK(on_remove_product_response));
+}
+
+/* The report window while the worker thread is busy with its numbers */
+typedef struct {
+    GtkWidget *win;           /* NULL once the window is closed */
+    GtkWidget *results;       /* Box the report goes into */
+    GtkWidget *progress_box;  /* Progress bar + Cancel, replaced by the report */
+    GtkWidget *progress_bar;
+    guint progress_timer;
+    GCancellable *cancellable;
+    Report *report;
+} ReportJob;
+
+/* Adds one line of text to the report */
+static void add_report_line(GtkWidget *box, const char *text) {
+    GtkWidget *lbl = gtk_label_new(text);
+    gtk_widget_set_halign(lbl, GTK_ALIGN_START);
+    gtk_box_append(GTK_BOX(box), lbl);
+}
+
+static void add_report_title(GtkWidget *box, const char *text) {
+    GtkWidget *title = gtk_label_new(text);
+    gtk_widget_add_css_class(title, "section-title");
+    gtk_box_append(GTK_BOX(box), title);
+}
+
+/* This function puts the finished report into the window */
+static void show_report_results(ReportJob *job) {
+    Report *r = job->report;
+    GtkWidget *vbox = job->results;
+    char buf[256];
+    char money_buf[MONEY_BUF_SIZE];
+
+    g_snprintf(buf, sizeof(buf), "Total products: %u", r->total_products);
+    add_report_line(vbox, buf);
+
+    g_snprintf(buf, sizeof(buf), "Total stock value: %s",
+               money_format(r->stock_value, money_buf, sizeof(money_buf)));
+    add_report_line(vbox, buf);
+
+    g_snprintf(buf, sizeof(buf), "Total stock sold: %" G_GINT64_FORMAT, r->total_sold);
+    add_report_line(vbox, buf);
+
+    if (r->n_top > 0) {
+        g_snprintf(buf, sizeof(buf), "Most active product: %s (sold %d)",
+                   r->top[0].name, r->top[0].sold);
+    } else {
+        g_snprintf(buf, sizeof(buf), "Most active product: N/A");
+    }
+    add_report_line(vbox, buf);
+
+    /* Top sellers list */
+    if (r->n_top > 0) {
+        add_report_title(vbox, "Best sellers:");
+        for (guint i = 0; i < r->n_top; i++) {
+            g_snprintf(buf, sizeof(buf), "%u. %s (%s) - sold %d",
+                       i + 1, r->top[i].name, r->top[i].id, r->top[i].sold);
+            add_report_line(vbox, buf);
+        }
+    }
+
+    /* History by operation - this is what the worker thread added up */
+    if (r->ops->len > 0) {
+        char first[32];
+        g_strlcpy(first, stock_history_format_time(r->first_time), sizeof(first));
+        g_snprintf(buf, sizeof(buf), "History (%u entries, %s to %s):", r->history_len,
+                   first, stock_history_format_time(r->last_time));
+        add_report_title(vbox, buf);
+        for (guint i = 0; i < r->ops->len; i++) {
+            ReportOp *op = &g_array_index(r->ops, ReportOp, i);
+            g_snprintf(buf, sizeof(buf),
+                       "%s: %" G_GUINT64_FORMAT " entries, quantity %+" G_GINT64_FORMAT
+                       ", value %s",
+                       history_string(op->op), op->entries, op->quantity,
+                       money_format(op->value, money_buf, sizeof(money_buf)));
+            add_report_line(vbox, buf);
+        }
+    }
+
+    /* Breakdown by category - every category keeps its own running totals */
+    if (r->categories->len > 0) {
+        add_report_title(vbox, "By category:");
+
+        GtkWidget *cat_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
+        for (guint i = 0; i < r->categories->len; i++) {
+            ReportCategory *c = &g_array_index(r->categories, ReportCategory, i);
+            g_snprintf(buf, sizeof(buf),
+                       "%s: %u products, %" G_GINT64_FORMAT " in stock, value %s, "
+                       "sold %" G_GINT64_FORMAT ", %u low on stock",
+                       c->name[0] ? c->name : "(no category)", c->products, c->quantity,
+                       money_format(c->stock_value, money_buf, sizeof(money_buf)),
+                       c->sold, c->low_stock);
+            add_report_line(cat_box, buf);
+        }
+        /* There can be lots of categories, so they get a scroll bar */
+        GtkWidget *cat_scroll = gtk_scrolled_window_new();
+        gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(cat_scroll), cat_box);
+        gtk_widget_set_vexpand(cat_scroll, TRUE);
+        gtk_box_append(GTK_BOX(vbox), cat_scroll);
+    }
+}
+
+/* Worker thread: only reads the snapshot in the Report */
+static void report_thread(GTask *task, gpointer source_object,
+                          gpointer task_data, GCancellable *cancellable) {
+    g_task_return_boolean(task, report_run(task_data, cancellable));
+}
+
+/* Moves the progress bar along while the worker runs */
+static gboolean on_report_progress(gpointer user_data) {
+    ReportJob *job = user_data;
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(job->progress_bar),
+                                  report_progress(job->report));
+    return G_SOURCE_CONTINUE;
+}
+
+/* Back on the main thread: the worker finished (or was cancelled) */
+static void on_report_ready(GObject *source, GAsyncResult *res, gpointer user_data) {
+    ReportJob *job = user_data;
+    gboolean done = g_task_propagate_boolean(G_TASK(res), NULL);
+
+    if (job->progress_timer) g_source_remove(job->progress_timer);
+    if (job->win && done) {
+        gtk_box_remove(GTK_BOX(job->results), job->progress_box);
+        show_report_results(job);
+    }
+    if (job->win) g_object_set_data(G_OBJECT(job->win), "report-job", NULL);
+
+    report_free(job->report);
+    g_object_unref(job->cancellable);
+    g_free(job);
+    g_application_release(g_application_get_default());  /* Matches the hold below */
+}
+
+/* The report window was closed - stop the worker if it's still going */
+static void on_report_window_destroy(GtkWidget *win, gpointer user_data) {
+    ReportJob *job = g_object_get_data(G_OBJECT(win), "report-job");
+    if (!job) return;  /* Already finished */
+    g_cancellable_cancel(job->cancellable);
+    if (job->progress_timer) g_source_remove(job->progress_timer);
+    job->progress_timer = 0;
+    job->win = NULL;
+}
+
 /**
  * Show report window with summary statistics.
  * Displays:
@@ -376,13 +483,20 @@ void ui_show_remove_product_dialog(GtkWindow *parent) {
  * - Total stock value
  * - Total stock sold
  * - Most active product (highest sold quantity)
+ * - The top REPORT_TOP_SELLERS best sellers
+ * - History totals per operation
+ * - Per category: products, units in stock, value, sold and low-stock count
+ *
+ * The numbers are worked out on a worker thread from a snapshot (see
+ * report.h), so the window opens right away with a progress bar and
+ * nothing changes for the rest of the UI while it runs.
  */
 void ui_show_report_window(GtkWindow *parent) {
     GtkWidget *win = gtk_window_new();
     gtk_window_set_title(GTK_WINDOW(win), "Stock Report");
     gtk_window_set_transient_for(GTK_WINDOW(win), parent);
     gtk_window_set_modal(GTK_WINDOW(win), TRUE);
-    gtk_window_set_default_size(GTK_WINDOW(win), 400, 200);
+    gtk_window_set_default_size(GTK_WINDOW(win), 480, 420);
 
     GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 8);
     gtk_widget_set_margin_top(vbox, 12);
@@ -391,48 +505,116 @@ void ui_show_report_window(GtkWindow *parent) {
     gtk_widget_set_margin_end(vbox, 12);
     gtk_window_set_child(GTK_WINDOW(win), vbox);
 
-    int total_products = (int)products->len;
-    double stock_value = compute_total_stock_value();
+    ReportJob *job = g_new0(ReportJob, 1);
+    job->win = win;
+    job->results = gtk_box_new(GTK_ORIENTATION_VERTICAL, 8);
+    gtk_widget_set_vexpand(job->results, TRUE);
+    gtk_box_append(GTK_BOX(vbox), job->results);
+
+    /* Shown until the report is ready */
+    job->progress_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    gtk_box_append(GTK_BOX(job->progress_box), gtk_label_new("Working out the report..."));
+    job->progress_bar = gtk_progress_bar_new();
+    gtk_box_append(GTK_BOX(job->progress_box), job->progress_bar);
+    GtkWidget *cancel_btn = gtk_button_new_with_label("Cancel");
+    gtk_widget_set_halign(cancel_btn, GTK_ALIGN_CENTER);
+    gtk_box_append(GTK_BOX(job->progress_box), cancel_btn);
+    gtk_box_append(GTK_BOX(job->results), job->progress_box);
+    /* Cancelling just closes the window, and closing it stops the worker */
+    g_signal_connect_swapped(cancel_btn, "clicked", G_CALLBACK(gtk_window_destroy), win);
 
-    int total_sold = 0;
-    Product *most_active = NULL;
-    for (guint i = 0; i < products->len; i++) {
-        Product *p = g_ptr_array_index(products, i);
-        total_sold += p->sold;
-        if (!most_active || p->sold > most_active->sold) {
-            most_active = p;
-        }
-    }
+    GtkWidget *close_btn = gtk_button_new_with_label("Close");
+    gtk_box_append(GTK_BOX(vbox), close_btn);
+    g_signal_connect_swapped(close_btn, "clicked",
+                             G_CALLBACK(gtk_window_destroy), win);
 
-    char buf[256];
+    g_object_set_data(G_OBJECT(win), "report-job", job);
+    g_signal_connect(win, "destroy", G_CALLBACK(on_report_window_destroy), NULL);
+
+    /* Copy what the report needs now, then let the worker do the rest */
+    job->report = report_new();
+    job->cancellable = g_cancellable_new();
+    job->progress_timer = g_timeout_add(100, on_report_progress, job);
+    /* The worker reads history memory, so the app must not shut down under it */
+    g_application_hold(g_application_get_default());
+    GTask *task = g_task_new(NULL, job->cancellable, on_report_ready, job);
+    g_task_set_task_data(task, job->report, NULL);
+    g_task_run_in_thread(task, report_thread);
+    g_object_unref(task);
+
+    gtk_widget_show(win);
+}
 
-    g_snprintf(buf, sizeof(buf), "Total products: %d", total_products);
-    GtkWidget *lbl1 = gtk_label_new(buf);
-    gtk_box_append(GTK_BOX(vbox), lbl1);
+/* How often the Performance window redraws its table */
+#define PERFORMANCE_REFRESH_MS 1000
 
-    g_snprintf(buf, sizeof(buf), "Total stock value: %.2f", stock_value);
-    GtkWidget *lbl2 = gtk_label_new(buf);
-    gtk_box_append(GTK_BOX(vbox), lbl2);
+static gboolean on_performance_tick(gpointer user_data) {
+    GtkLabel *label = user_data;
+    GString *text = g_string_new(NULL);
+    metrics_format(text);
+    gtk_label_set_text(label, text->str);
+    g_string_free(text, TRUE);
+    return G_SOURCE_CONTINUE;
+}
 
-    g_snprintf(buf, sizeof(buf), "Total stock sold: %d", total_sold);
-    GtkWidget *lbl3 = gtk_label_new(buf);
-    gtk_box_append(GTK_BOX(vbox), lbl3);
+static void on_performance_reset(GtkButton *button, gpointer user_data) {
+    metrics_reset();
+    on_performance_tick(user_data);
+}
 
-    if (most_active) {
-        g_snprintf(buf, sizeof(buf), "Most active product: %s (sold %d)",
-                   most_active->name, most_active->sold);
-    } else {
-        g_snprintf(buf, sizeof(buf), "Most active product: N/A");
-    }
-    GtkWidget *lbl4 = gtk_label_new(buf);
-    gtk_box_append(GTK_BOX(vbox), lbl4);
+static void on_performance_window_destroy(GtkWidget *win, gpointer user_data) {
+    guint timer = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(win), "refresh-timer"));
+    if (timer) g_source_remove(timer);
+}
+
+/**
+ * Show the Performance window: calls, failures and p50/p99/max times for
+ * every operation in metrics.h, redrawn once a second.
+ *
+ * The numbers are collected all the time (it's only a few atomic adds per
+ * call) - the window just reads them, and its timer only runs while it's open.
+ * It isn't modal, so it can stay open while you use the app.
+ */
+void ui_show_performance_window(GtkWindow *parent) {
+    GtkWidget *win = gtk_window_new();
+    gtk_window_set_title(GTK_WINDOW(win), "Performance");
+    gtk_window_set_transient_for(GTK_WINDOW(win), parent);
+    gtk_window_set_default_size(GTK_WINDOW(win), 760, 460);
 
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 8);
+    gtk_widget_set_margin_top(vbox, 12);
+    gtk_widget_set_margin_bottom(vbox, 12);
+    gtk_widget_set_margin_start(vbox, 12);
+    gtk_widget_set_margin_end(vbox, 12);
+    gtk_window_set_child(GTK_WINDOW(win), vbox);
+
+    GtkWidget *label = gtk_label_new(NULL);
+    gtk_widget_add_css_class(label, "monospace");
+    gtk_label_set_xalign(GTK_LABEL(label), 0);
+    gtk_label_set_yalign(GTK_LABEL(label), 0);
+    gtk_label_set_selectable(GTK_LABEL(label), TRUE);
+    GtkWidget *scroll = gtk_scrolled_window_new();
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scroll), label);
+    gtk_widget_set_vexpand(scroll, TRUE);
+    gtk_box_append(GTK_BOX(vbox), scroll);
+
+    GtkWidget *buttons = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
+    gtk_widget_set_halign(buttons, GTK_ALIGN_END);
+    GtkWidget *reset_btn = gtk_button_new_with_label("Reset");
+    gtk_widget_set_sensitive(reset_btn, metrics_enabled());
+    gtk_box_append(GTK_BOX(buttons), reset_btn);
     GtkWidget *close_btn = gtk_button_new_with_label("Close");
-    gtk_box_append(GTK_BOX(vbox), close_btn);
-    g_signal_connect_swapped(close_btn, "clicked",
-                             G_CALLBACK(gtk_window_destroy), win);
+    gtk_box_append(GTK_BOX(buttons), close_btn);
+    gtk_box_append(GTK_BOX(vbox), buttons);
+    g_signal_connect(reset_btn, "clicked", G_CALLBACK(on_performance_reset), label);
+    g_signal_connect_swapped(close_btn, "clicked", G_CALLBACK(gtk_window_destroy), win);
+
+    on_performance_tick(label);
+    if (metrics_enabled()) {
+        guint timer = g_timeout_add(PERFORMANCE_REFRESH_MS, on_performance_tick, label);
+        g_object_set_data(G_OBJECT(win), "refresh-timer", GUINT_TO_POINTER(timer));
+    }
+    g_signal_connect(win, "destroy", G_CALLBACK(on_performance_window_destroy), NULL);
 
     gtk_widget_show(win);
 }
-
-
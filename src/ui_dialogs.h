@@ -11,6 +11,7 @@ void ui_show_calculate_value_dialog(GtkWindow *parent);
 void ui_show_apply_discount_dialog(GtkWindow *parent);
 void ui_show_remove_product_dialog(GtkWindow *parent);
 void ui_show_report_window(GtkWindow *parent);
+void ui_show_performance_window(GtkWindow *parent);  /* Live operation timings */
 
 #endif /* UI_DIALOGS_H */
 
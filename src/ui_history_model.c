@@ -0,0 +1,118 @@
+#include "ui_history_model.h"
+#include "metrics.h"
+#include <time.h>
+
+/* These are the global arrays from main.c */
+extern HistoryList *history;
+
+/* Formatted timestamps we keep around - a screen of rows fits easily */
+#define TIME_CACHE_SIZE 256
+
+/* ---- The row item ---- */
+
+struct _StockHistoryItem {
+    GObject parent_instance;
+    const HistoryEntry *entry;  /* Not owned - lives in the pool */
+};
+
+G_DEFINE_TYPE(StockHistoryItem, stock_history_item, G_TYPE_OBJECT)
+
+static void stock_history_item_class_init(StockHistoryItemClass *klass) {
+}
+
+static void stock_history_item_init(StockHistoryItem *self) {
+}
+
+const HistoryEntry *stock_history_item_get_entry(StockHistoryItem *item) {
+    return item->entry;
+}
+
+/* ---- The list model ---- */
+
+struct _StockHistoryModel {
+    GObject parent_instance;
+    guint n_items;  /* How many rows GTK was last told about */
+};
+
+static void stock_history_model_list_init(GListModelInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(StockHistoryModel, stock_history_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_LIST_MODEL, stock_history_model_list_init))
+
+static GType stock_history_model_get_item_type(GListModel *list) {
+    return STOCK_TYPE_HISTORY_ITEM;
+}
+
+static guint stock_history_model_get_n_items(GListModel *list) {
+    return STOCK_HISTORY_MODEL(list)->n_items;
+}
+
+/* GTK calls this only for the rows it is about to show */
+static gpointer stock_history_model_get_item(GListModel *list, guint position) {
+    StockHistoryModel *self = STOCK_HISTORY_MODEL(list);
+    if (position >= self->n_items || position >= history->len) return NULL;
+
+    StockHistoryItem *item = g_object_new(STOCK_TYPE_HISTORY_ITEM, NULL);
+    item->entry = history_index(history, position);
+    return item;
+}
+
+static void stock_history_model_list_init(GListModelInterface *iface) {
+    iface->get_item_type = stock_history_model_get_item_type;
+    iface->get_n_items = stock_history_model_get_n_items;
+    iface->get_item = stock_history_model_get_item;
+}
+
+static void stock_history_model_class_init(StockHistoryModelClass *klass) {
+}
+
+static void stock_history_model_init(StockHistoryModel *self) {
+}
+
+StockHistoryModel *stock_history_model_new(void) {
+    return g_object_new(STOCK_TYPE_HISTORY_MODEL, NULL);
+}
+
+void stock_history_model_refresh(StockHistoryModel *self) {
+    METRIC_START(start);
+    guint old_n = self->n_items;
+    self->n_items = history->len;
+    g_list_model_items_changed(G_LIST_MODEL(self), 0, old_n, self->n_items);
+    METRIC_STOP(METRIC_UI_HISTORY_REFRESH, start, TRUE);
+}
+
+void stock_history_model_flush(StockHistoryModel *self) {
+    guint old_n = self->n_items;
+    if (history->len == old_n) return;
+    METRIC_START(start);
+    self->n_items = history->len;
+    g_list_model_items_changed(G_LIST_MODEL(self), old_n, 0, self->n_items - old_n);
+    METRIC_STOP(METRIC_UI_HISTORY_FLUSH, start, TRUE);
+}
+
+/* A tiny cache: a timestamp always goes in slot (timestamp % size), so a */
+/* lookup is one compare. Entries next to each other have close timestamps, */
+/* so the rows on screen hardly ever push each other out */
+static struct {
+    gint64 timestamp;
+    gboolean used;
+    char text[32];
+} time_cache[TIME_CACHE_SIZE];
+
+const char *stock_history_format_time(gint64 timestamp) {
+    guint slot = (guint)((guint64)timestamp % TIME_CACHE_SIZE);
+    if (time_cache[slot].used && time_cache[slot].timestamp == timestamp) {
+        return time_cache[slot].text;
+    }
+
+    time_t when = (time_t)timestamp;
+    struct tm *tm_info = localtime(&when);
+    if (!tm_info ||
+        strftime(time_cache[slot].text, sizeof(time_cache[slot].text),
+                 "%Y-%m-%d %H:%M:%S", tm_info) == 0) {
+        g_strlcpy(time_cache[slot].text, "?", sizeof(time_cache[slot].text));
+    }
+    time_cache[slot].timestamp = timestamp;
+    time_cache[slot].used = TRUE;
+    return time_cache[slot].text;
+}
@@ -0,0 +1,45 @@
+#ifndef UI_HISTORY_MODEL_H
+#define UI_HISTORY_MODEL_H
+
+#include <gtk/gtk.h>
+#include "model.h"
+
+/* This file lets the history table read the history array directly */
+/* Same idea as ui_product_model.h: nothing is copied, and GtkColumnView only */
+/* asks for (and formats) the rows that are on screen. History only grows, */
+/* so new entries are just "N more rows at the end". */
+
+/* The columns of the history table */
+typedef enum {
+    HISTORY_FIELD_TIME,
+    HISTORY_FIELD_OP,
+    HISTORY_FIELD_PRODUCT,
+    HISTORY_FIELD_QUANTITY,
+    HISTORY_FIELD_VALUE,
+    HISTORY_FIELD_DESCRIPTION
+} HistoryField;
+
+/* One row: a pointer to the HistoryEntry, made when GTK asks for the row */
+#define STOCK_TYPE_HISTORY_ITEM (stock_history_item_get_type())
+G_DECLARE_FINAL_TYPE(StockHistoryItem, stock_history_item, STOCK, HISTORY_ITEM, GObject)
+
+const HistoryEntry *stock_history_item_get_entry(StockHistoryItem *item);
+
+/* The list of rows (a GListModel over the global history array) */
+#define STOCK_TYPE_HISTORY_MODEL (stock_history_model_get_type())
+G_DECLARE_FINAL_TYPE(StockHistoryModel, stock_history_model, STOCK, HISTORY_MODEL, GObject)
+
+StockHistoryModel *stock_history_model_new(void);
+
+/* Redo the whole list (after loading) */
+void stock_history_model_refresh(StockHistoryModel *self);
+
+/* Tell GTK about the entries added since last time - costs the same for any history size */
+void stock_history_model_flush(StockHistoryModel *self);
+
+/* "2024-01-31 12:00:00" for a timestamp. Recently used ones are cached, so */
+/* scrolling doesn't call localtime + strftime for every cell. The text is */
+/* only good until the next call */
+const char *stock_history_format_time(gint64 timestamp);
+
+#endif /* UI_HISTORY_MODEL_H */
@@ -1,124 +1,238 @@
 #include "ui_main_window.h"
 #include "ui_dialogs.h"
 #include "model.h"
+#include "history.h"
+#include "ui_product_model.h"
+#include "ui_history_model.h"
+#include "trace.h"
 
 /* This file creates the main window with the table and buttons */
 /* It's the GUI part - what the user sees and clicks */
 
 /* These are the global arrays from main.c */
 extern GPtrArray *products;
-extern GPtrArray *history;
+extern HistoryList *history;
 
 /* These are the table widgets - I store them here so I can update them later */
-static GtkListStore *products_store = NULL;  /* The data for products table */
-static GtkListStore *history_store = NULL;   /* The data for history table */
-static GtkTreeView *products_view = NULL;    /* The actual products table widget */
-static GtkTreeView *history_view = NULL;     /* The actual history table widget */
-
-/* These numbers tell us which column is which in the products table */
-enum {
-    COL_ID,        /* Column 0: Product ID */
-    COL_NAME,      /* Column 1: Product name */
-    COL_CATEGORY,  /* Column 2: Category */
-    COL_QUANTITY,  /* Column 3: How many we have */
-    COL_PRICE,     /* Column 4: Price */
-    COL_SOLD,      /* Column 5: How many sold */
-    COL_COLOR,     /* Column 6: For coloring (not really used) */
-    N_COLS         /* Total columns = 7 */
+static StockProductModel *product_model = NULL;       /* The products table reads this */
+static GtkSingleSelection *product_selection = NULL;  /* Which product row is selected */
+static StockHistoryModel *history_model = NULL;       /* The history table reads this */
+static gboolean history_follow = TRUE;       /* Keep showing the newest entries */
+static GtkWidget *main_window = NULL;
+static guint flush_tick = 0;                 /* Pending per-frame update (0 = none) */
+static GtkWidget *loading_box = NULL;        /* Spinner + text shown while data loads */
+static GtkWidget *loading_spinner = NULL;
+static GtkWidget *loading_label = NULL;
+static GtkWidget *search_entry = NULL;       /* Off while products load (see ui_set_actions_enabled) */
+static GtkSorter *products_sorter = NULL;    /* The products view's sorter (the view owns it) */
+static gboolean products_ready = FALSE;      /* Products are loaded - sorting is safe */
+static gboolean sort_pending = FALSE;        /* A header was clicked while they were loading */
+
+/* These are the columns of the products table */
+static const struct {
+    const char *title;
+    ProductField field;
+} product_columns[] = {
+    { "ID",       PRODUCT_FIELD_ID },
+    { "Name",     PRODUCT_FIELD_NAME },
+    { "Category", PRODUCT_FIELD_CATEGORY },
+    { "Quantity", PRODUCT_FIELD_QUANTITY },
+    { "Price",    PRODUCT_FIELD_PRICE },
+    { "Sold",     PRODUCT_FIELD_SOLD }
 };
 
-/* These numbers tell us which column is which in the history table */
-enum {
-    H_COL_TIME,    /* Column 0: When it happened */
-    H_COL_OP,      /* Column 1: What operation (ADD, SELL, etc) */
-    H_COL_PID,     /* Column 2: Product ID */
-    H_COL_QTY,     /* Column 3: Quantity change */
-    H_COL_VAL,     /* Column 4: Value change */
-    H_COL_DESC,    /* Column 5: Description */
-    H_N_COLS       /* Total columns = 6 */
+/* These are the columns of the history table */
+static const struct {
+    const char *title;
+    HistoryField field;
+} history_columns[] = {
+    { "Time",        HISTORY_FIELD_TIME },
+    { "Op",          HISTORY_FIELD_OP },
+    { "Product ID",  HISTORY_FIELD_PRODUCT },
+    { "Qty",         HISTORY_FIELD_QUANTITY },
+    { "Value",       HISTORY_FIELD_VALUE },
+    { "Description", HISTORY_FIELD_DESCRIPTION }
 };
 
-/* This function makes the quantity cell red if stock is low (< 5) */
-/* GTK calls this for each cell to decide how to display it */
-static void quantity_cell_data_func(GtkTreeViewColumn *column,
-                                    GtkCellRenderer *renderer,
-                                    GtkTreeModel *model,
-                                    GtkTreeIter *iter,
-                                    gpointer data) {
-    gint quantity;
-    /* Get the quantity value from this row */
-    gtk_tree_model_get(model, iter, COL_QUANTITY, &quantity, -1);
-    /* If stock is less than 5, make it red (warning!) */
-    if (quantity < 5) {
-        g_object_set(renderer, "foreground", "red", NULL);
-    } else {
-        g_object_set(renderer, "foreground", NULL, NULL);  /* Normal color */
+/* A table cell is just a label (both tables use this) */
+static void table_cell_setup(GtkSignalListItemFactory *factory, GtkListItem *list_item,
+                               gpointer user_data) {
+    GtkWidget *label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0f);
+    gtk_list_item_set_child(list_item, label);
+}
+
+/* GTK calls this when a cell scrolls into view - user_data says which column */
+/* The text comes straight from the Product, nothing is stored per row */
+static void product_cell_bind(GtkSignalListItemFactory *factory, GtkListItem *list_item,
+                              gpointer user_data) {
+    GtkLabel *label = GTK_LABEL(gtk_list_item_get_child(list_item));
+    Product *p = stock_product_item_get_product(gtk_list_item_get_item(list_item));
+    char buf[MONEY_BUF_SIZE];
+
+    switch ((ProductField)GPOINTER_TO_INT(user_data)) {
+    case PRODUCT_FIELD_ID:       gtk_label_set_text(label, p->id); break;
+    case PRODUCT_FIELD_NAME:     gtk_label_set_text(label, p->name); break;
+    case PRODUCT_FIELD_CATEGORY: gtk_label_set_text(label, p->category); break;
+    case PRODUCT_FIELD_QUANTITY:
+        g_snprintf(buf, sizeof(buf), "%d", p->quantity);
+        gtk_label_set_text(label, buf);
+        /* If stock is low, make it red (warning!) */
+        if (p->quantity < LOW_STOCK_LIMIT) {
+            gtk_widget_add_css_class(GTK_WIDGET(label), "low-stock");
+        } else {
+            gtk_widget_remove_css_class(GTK_WIDGET(label), "low-stock");  /* Labels get reused */
+        }
+        break;
+    case PRODUCT_FIELD_PRICE:
+        gtk_label_set_text(label, money_format(p->price, buf, sizeof(buf)));
+        break;
+    case PRODUCT_FIELD_SOLD:
+        g_snprintf(buf, sizeof(buf), "%d", p->sold);
+        gtk_label_set_text(label, buf);
+        break;
+    default:
+        break;
+    }
+}
+
+/* The column headers need a sorter to be clickable. The model does the real */
+/* sorting (see on_products_sort_changed), this is only used if GTK asks */
+static int compare_product_items(gconstpointer a, gconstpointer b, gpointer user_data) {
+    Product *pa = stock_product_item_get_product((StockProductItem *)a);
+    Product *pb = stock_product_item_get_product((StockProductItem *)b);
+    int r = stock_product_compare(pa, pb, (ProductField)GPOINTER_TO_INT(user_data));
+    return r < 0 ? GTK_ORDERING_SMALLER : r > 0 ? GTK_ORDERING_LARGER : GTK_ORDERING_EQUAL;
+}
+
+/* Sort the model's row order by the column picked in the header */
+/* A GtkSortListModel would have to make an item for every product to sort them */
+static void apply_products_sort(void) {
+    GtkColumnViewSorter *view_sorter = GTK_COLUMN_VIEW_SORTER(products_sorter);
+    GtkColumnViewColumn *col = gtk_column_view_sorter_get_primary_sort_column(view_sorter);
+    ProductField field = PRODUCT_FIELD_NONE;
+    gboolean descending = FALSE;
+    if (col) {
+        field = (ProductField)GPOINTER_TO_INT(g_object_get_data(G_OBJECT(col), "product-field"));
+        descending = gtk_column_view_sorter_get_primary_sort_order(view_sorter) ==
+                     GTK_SORT_DESCENDING;
+    }
+    if (product_model) stock_product_model_set_sort(product_model, field, descending);
+}
+
+/* A column header was clicked */
+static void on_products_sort_changed(GtkSorter *sorter, GtkSorterChange change,
+                                     gpointer user_data) {
+    /* Sorting walks the products array, which the loader thread is still */
+    /* adding to - wait until ui_set_actions_enabled says it's done */
+    if (!products_ready) {
+        sort_pending = TRUE;
+        return;
+    }
+    apply_products_sort();
+}
+
+/* The search text changed (GtkSearchEntry waits until typing pauses) */
+static void on_search_changed(GtkSearchEntry *entry, gpointer user_data) {
+    if (product_model) {
+        stock_product_model_set_filter(product_model, gtk_editable_get_text(GTK_EDITABLE(entry)));
     }
 }
 
+/* Same for a history cell - only rows on screen get here, so only their */
+/* timestamps are ever formatted */
+static void history_cell_bind(GtkSignalListItemFactory *factory, GtkListItem *list_item,
+                              gpointer user_data) {
+    GtkLabel *label = GTK_LABEL(gtk_list_item_get_child(list_item));
+    const HistoryEntry *h = stock_history_item_get_entry(gtk_list_item_get_item(list_item));
+    char buf[MONEY_BUF_SIZE];
+
+    switch ((HistoryField)GPOINTER_TO_INT(user_data)) {
+    case HISTORY_FIELD_TIME:
+        gtk_label_set_text(label, stock_history_format_time(h->timestamp));
+        break;
+    case HISTORY_FIELD_OP:      gtk_label_set_text(label, history_op_name(h)); break;
+    case HISTORY_FIELD_PRODUCT: gtk_label_set_text(label, history_product_id(h)); break;
+    case HISTORY_FIELD_QUANTITY:
+        g_snprintf(buf, sizeof(buf), "%d", h->quantity_change);
+        gtk_label_set_text(label, buf);
+        break;
+    case HISTORY_FIELD_VALUE:
+        gtk_label_set_text(label, money_format(h->value_change, buf, sizeof(buf)));
+        break;
+    case HISTORY_FIELD_DESCRIPTION:
+        gtk_label_set_text(label, history_description(h));
+        break;
+    default:
+        break;
+    }
+}
+
+/* The user scrolled the history - keep following new entries only while */
+/* they're at the bottom */
+static void on_history_scrolled(GtkAdjustment *adj, gpointer user_data) {
+    double bottom = gtk_adjustment_get_upper(adj) - gtk_adjustment_get_page_size(adj);
+    history_follow = gtk_adjustment_get_value(adj) >= bottom - 1.0;
+}
+
+/* The history got longer (or the window bigger) - jump to the end if we're following */
+static void on_history_resized(GtkAdjustment *adj, gpointer user_data) {
+    if (!history_follow) return;
+    gtk_adjustment_set_value(adj, gtk_adjustment_get_upper(adj) -
+                                  gtk_adjustment_get_page_size(adj));
+}
+
 /* This function updates the products table to show current data */
 /* I call this after adding, selling, or updating products */
+/* Nothing is copied - the table only redraws the rows that are on screen */
 void ui_refresh_products_table(void) {
-    /* First, clear everything that's already there */
-    gtk_list_store_clear(products_store);
-    /* Then add each product from our list */
-    for (guint i = 0; i < products->len; i++) {
-        Product *p = g_ptr_array_index(products, i);
-        GtkTreeIter iter;
-        /* Add a new row to the table */
-        gtk_list_store_append(products_store, &iter);
-        /* Fill in all the columns with product data */
-        gtk_list_store_set(products_store, &iter,
-                           COL_ID, p->id,
-                           COL_NAME, p->name,
-                           COL_CATEGORY, p->category,
-                           COL_QUANTITY, p->quantity,
-                           COL_PRICE, p->price,
-                           COL_SOLD, p->sold,
-                           COL_COLOR, "",  /* Not really used */
-                           -1);
-    }
+    if (!product_model) return;  /* Window is gone */
+    TRACE_BEGIN("refresh_products_table");
+    stock_product_model_refresh(product_model);
+    TRACE_END("refresh_products_table");
 }
 
 /* This function updates the history table to show all operations */
-/* I call this after any operation that changes history */
+/* Only needed after loading - new entries show up through on_stock_changed */
 void ui_refresh_history_view(void) {
-    /* Clear the table first */
-    gtk_list_store_clear(history_store);
-    /* Add each history entry */
-    for (guint i = 0; i < history->len; i++) {
-        HistoryEntry *h = g_ptr_array_index(history, i);
-        GtkTreeIter iter;
-        /* Convert the timestamp to a readable date/time string */
-        char time_buf[64];
-        struct tm *tm_info = localtime(&h->timestamp);
-        strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", tm_info);
-        /* Add a new row */
-        gtk_list_store_append(history_store, &iter);
-        /* Fill in all the columns */
-        gtk_list_store_set(history_store, &iter,
-                           H_COL_TIME, time_buf,
-                           H_COL_OP, h->operation,
-                           H_COL_PID, h->product_id,
-                           H_COL_QTY, h->quantity_change,
-                           H_COL_VAL, h->value_change,
-                           H_COL_DESC, h->description,
-                           -1);
+    if (!history_model) return;  /* Window is gone */
+    history_follow = TRUE;  /* Start at the newest entries */
+    TRACE_BEGIN("refresh_history_view");
+    stock_history_model_refresh(history_model);
+    TRACE_END("refresh_history_view");
+}
+
+/* Runs once per frame when something changed - applies everything that */
+/* piled up since the last frame in one go */
+static gboolean flush_changes(GtkWidget *widget, GdkFrameClock *clock, gpointer user_data) {
+    flush_tick = 0;
+    TRACE_BEGIN("flush_changes");
+    if (product_model) stock_product_model_flush(product_model);
+    if (history_model) stock_history_model_flush(history_model);  /* Just the new rows */
+    TRACE_END("flush_changes");
+    return G_SOURCE_REMOVE;
+}
+
+/* logic.c calls this for every change - we only take note and wait for the next frame */
+static void on_stock_changed(StockChange change, guint position, Product *p,
+                             gpointer user_data) {
+    if (change != STOCK_CHANGE_HISTORY_APPENDED && product_model) {
+        stock_product_model_queue_change(product_model, change, position, p);
+    }
+    if (!flush_tick && main_window) {
+        flush_tick = gtk_widget_add_tick_callback(main_window, flush_changes, NULL, NULL);
     }
 }
 
 /* This function gets the product ID from the row the user clicked on */
 /* I could use this to pre-fill the ID in dialogs, but I'm not using it yet */
 char *ui_get_selected_product_id(void) {
-    GtkTreeSelection *sel = gtk_tree_view_get_selection(products_view);
-    GtkTreeModel *model;
-    GtkTreeIter iter;
+    if (!product_selection) return NULL;
     /* Check if user selected a row */
-    if (gtk_tree_selection_get_selected(sel, &model, &iter)) {
-        char *id = NULL;
+    StockProductItem *item = gtk_single_selection_get_selected_item(product_selection);
+    if (item) {
         /* Get the ID from that row */
-        gtk_tree_model_get(model, &iter, COL_ID, &id, -1);
-        return id;  /* Remember to free this later! */
+        return g_strdup(stock_product_item_get_product(item)->id);  /* Remember to free this later! */
     }
     return NULL;  /* Nothing selected */
 }
@@ -166,13 +280,95 @@ static void on_generate_report_clicked(GtkButton *btn, gpointer user_data) {
     ui_show_report_window(win);
 }
 
+static void on_performance_clicked(GtkButton *btn, gpointer user_data) {
+    GtkWindow *win = GTK_WINDOW(user_data);
+    ui_show_performance_window(win);
+}
+
+/* These are the toolbar buttons */
+/* needs_history marks the ones that add to (or read) history, so they have */
+/* to wait until everything is loaded */
+static struct {
+    const char *label;
+    GCallback cb;
+    gboolean needs_history;
+    GtkWidget *button;  /* Filled in by ui_create_main_window */
+} toolbar_buttons[] = {
+    { "Add Product",        G_CALLBACK(on_add_product_clicked),     TRUE,  NULL },
+    { "Update Stock",       G_CALLBACK(on_update_stock_clicked),    TRUE,  NULL },
+    { "Sell",               G_CALLBACK(on_sell_product_clicked),    TRUE,  NULL },
+    { "Check Stock",        G_CALLBACK(on_check_stock_clicked),     FALSE, NULL },
+    { "Calculate Value",    G_CALLBACK(on_calc_value_clicked),      FALSE, NULL },
+    { "Apply Discount",     G_CALLBACK(on_apply_discount_clicked),  TRUE,  NULL },
+    { "Remove Product",     G_CALLBACK(on_remove_product_clicked),  TRUE,  NULL },
+    { "Performance",        G_CALLBACK(on_performance_clicked),     FALSE, NULL },
+    /* Stays last - the last button gets the red style below */
+    { "Generate Report",    G_CALLBACK(on_generate_report_clicked), TRUE,  NULL }
+};
+
+/* This function turns the toolbar buttons (and the search bar) on or off */
+/* read_actions = buttons that only look at products */
+/* write_actions = buttons that change data or read history */
+void ui_set_actions_enabled(gboolean read_actions, gboolean write_actions) {
+    for (guint i = 0; i < G_N_ELEMENTS(toolbar_buttons); i++) {
+        if (!toolbar_buttons[i].button) continue;
+        gboolean on = toolbar_buttons[i].needs_history ? write_actions : read_actions;
+        gtk_widget_set_sensitive(toolbar_buttons[i].button, on);
+    }
+    /* The search index is still being filled by the loader thread until */
+    /* the products are in, and it has no lock of its own */
+    if (search_entry) gtk_widget_set_sensitive(search_entry, read_actions);
+    /* Same for sorting - a header clicked while loading is sorted by now */
+    products_ready = read_actions;
+    if (products_ready && sort_pending && products_sorter) {
+        sort_pending = FALSE;
+        apply_products_sort();
+    }
+}
+
+/* This function shows "Loading..." with a spinner, or hides it when message is NULL */
+void ui_show_loading(const char *message) {
+    if (!loading_box) return;
+    if (message) {
+        gtk_label_set_text(GTK_LABEL(loading_label), message);
+        gtk_spinner_start(GTK_SPINNER(loading_spinner));
+        gtk_widget_set_visible(loading_box, TRUE);
+    } else {
+        gtk_spinner_stop(GTK_SPINNER(loading_spinner));
+        gtk_widget_set_visible(loading_box, FALSE);
+    }
+}
+
+/* The window is gone (it can be closed while data is still loading) */
+/* Forget the widgets so the loading code doesn't touch freed memory */
+static void on_main_window_destroy(GtkWidget *window, gpointer user_data) {
+    logic_set_change_func(NULL, NULL);
+    main_window = NULL;
+    flush_tick = 0;  /* GTK drops the tick callback with the window */
+    product_model = NULL;
+    product_selection = NULL;
+    history_model = NULL;
+    loading_box = NULL;
+    loading_spinner = NULL;
+    loading_label = NULL;
+    search_entry = NULL;
+    products_sorter = NULL;
+    for (guint i = 0; i < G_N_ELEMENTS(toolbar_buttons); i++) {
+        toolbar_buttons[i].button = NULL;
+    }
+}
+
 /* This function creates the whole main window */
 /* It makes the buttons, tables, and puts everything together */
 GtkWidget *ui_create_main_window(GtkApplication *app) {
+    TRACE_BEGIN("build_main_window");
     /* Create the main window */
     GtkWidget *window = gtk_application_window_new(app);
     gtk_window_set_title(GTK_WINDOW(window), "Stock Management System");
     gtk_window_set_default_size(GTK_WINDOW(window), 900, 600);  /* Make it big enough */
+    g_signal_connect(window, "destroy", G_CALLBACK(on_main_window_destroy), NULL);
+    main_window = window;
+    logic_set_change_func(on_stock_changed, NULL);
 
     GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
     gtk_widget_set_margin_top(vbox, 8);
@@ -184,24 +380,11 @@ GtkWidget *ui_create_main_window(GtkApplication *app) {
     GtkWidget *toolbar = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
     gtk_box_append(GTK_BOX(vbox), toolbar);
 
-    struct {
-        const char *label;
-        GCallback cb;
-    } buttons[] = {
-        { "Add Product",        G_CALLBACK(on_add_product_clicked) },
-        { "Update Stock",       G_CALLBACK(on_update_stock_clicked) },
-        { "Sell",               G_CALLBACK(on_sell_product_clicked) },
-        { "Check Stock",        G_CALLBACK(on_check_stock_clicked) },
-        { "Calculate Value",    G_CALLBACK(on_calc_value_clicked) },
-        { "Apply Discount",     G_CALLBACK(on_apply_discount_clicked) },
-        { "Remove Product",     G_CALLBACK(on_remove_product_clicked) },
-        { "Generate Report",    G_CALLBACK(on_generate_report_clicked) }
-    };
-
-    for (guint i = 0; i < G_N_ELEMENTS(buttons); i++) {
-        GtkWidget *btn = gtk_button_new_with_label(buttons[i].label);
+    for (guint i = 0; i < G_N_ELEMENTS(toolbar_buttons); i++) {
+        GtkWidget *btn = gtk_button_new_with_label(toolbar_buttons[i].label);
         gtk_box_append(GTK_BOX(toolbar), btn);
-        g_signal_connect(btn, "clicked", buttons[i].cb, window);
+        g_signal_connect(btn, "clicked", toolbar_buttons[i].cb, window);
+        toolbar_buttons[i].button = btn;
     }
     /* Style primary and destructive actions */
     GtkWidget *first_btn = gtk_widget_get_first_child(toolbar);
@@ -218,6 +401,15 @@ GtkWidget *ui_create_main_window(GtkApplication *app) {
         gtk_widget_add_css_class(last_btn, "destructive-action");
     }
 
+    /* Loading indicator - hidden until main.c starts loading data */
+    loading_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    loading_spinner = gtk_spinner_new();
+    loading_label = gtk_label_new("");
+    gtk_box_append(GTK_BOX(loading_box), loading_spinner);
+    gtk_box_append(GTK_BOX(loading_box), loading_label);
+    gtk_widget_set_visible(loading_box, FALSE);
+    gtk_box_append(GTK_BOX(vbox), loading_box);
+
     GtkWidget *paned = gtk_paned_new(GTK_ORIENTATION_VERTICAL);
     gtk_box_append(GTK_BOX(vbox), paned);
 
@@ -228,94 +420,64 @@ GtkWidget *ui_create_main_window(GtkApplication *app) {
     gtk_widget_set_halign(products_label, GTK_ALIGN_START);
     gtk_box_append(GTK_BOX(products_box), products_label);
 
-    products_store = gtk_list_store_new(N_COLS,
-                                        G_TYPE_STRING,
-                                        G_TYPE_STRING,
-                                        G_TYPE_STRING,
-                                        G_TYPE_INT,
-                                        G_TYPE_DOUBLE,
-                                        G_TYPE_INT,
-                                        G_TYPE_STRING);
-
-    products_view = GTK_TREE_VIEW(gtk_tree_view_new_with_model(
-                                      GTK_TREE_MODEL(products_store)));
-    gtk_tree_view_set_headers_clickable(products_view, TRUE);
-
-    GtkCellRenderer *renderer;
-    GtkTreeViewColumn *col;
-
-    renderer = gtk_cell_renderer_text_new();
-    col = gtk_tree_view_column_new_with_attributes("ID", renderer, "text", COL_ID, NULL);
-    gtk_tree_view_column_set_sort_column_id(col, COL_ID);
-    gtk_tree_view_append_column(products_view, col);
-
-    renderer = gtk_cell_renderer_text_new();
-    col = gtk_tree_view_column_new_with_attributes("Name", renderer, "text", COL_NAME, NULL);
-    gtk_tree_view_column_set_sort_column_id(col, COL_NAME);
-    gtk_tree_view_append_column(products_view, col);
-
-    renderer = gtk_cell_renderer_text_new();
-    col = gtk_tree_view_column_new_with_attributes("Category", renderer, "text", COL_CATEGORY, NULL);
-    gtk_tree_view_column_set_sort_column_id(col, COL_CATEGORY);
-    gtk_tree_view_append_column(products_view, col);
-
-    renderer = gtk_cell_renderer_text_new();
-    col = gtk_tree_view_column_new_with_attributes("Quantity", renderer, "text", COL_QUANTITY, NULL);
-    gtk_tree_view_column_set_cell_data_func(col, renderer, quantity_cell_data_func, NULL, NULL);
-    gtk_tree_view_column_set_sort_column_id(col, COL_QUANTITY);
-    gtk_tree_view_append_column(products_view, col);
-
-    renderer = gtk_cell_renderer_text_new();
-    col = gtk_tree_view_column_new_with_attributes("Price", renderer, "text", COL_PRICE, NULL);
-    gtk_tree_view_column_set_sort_column_id(col, COL_PRICE);
-    gtk_tree_view_append_column(products_view, col);
-
-    renderer = gtk_cell_renderer_text_new();
-    col = gtk_tree_view_column_new_with_attributes("Sold", renderer, "text", COL_SOLD, NULL);
-    gtk_tree_view_column_set_sort_column_id(col, COL_SOLD);
-    gtk_tree_view_append_column(products_view, col);
+    /* Search bar - looks products up in the search index (search.c) */
+    search_entry = gtk_search_entry_new();
+    gtk_search_entry_set_placeholder_text(GTK_SEARCH_ENTRY(search_entry),
+                                          "Search by ID, name or category");
+    gtk_search_entry_set_search_delay(GTK_SEARCH_ENTRY(search_entry), 150);  /* ms */
+    g_signal_connect(search_entry, "search-changed", G_CALLBACK(on_search_changed), NULL);
+    gtk_box_append(GTK_BOX(products_box), search_entry);
+
+    /* The table reads the products array through product_model - no copies */
+    /* The selection model owns product_model, and the view owns the selection */
+    product_model = stock_product_model_new();
+    product_selection = gtk_single_selection_new(G_LIST_MODEL(product_model));
+    gtk_single_selection_set_autoselect(product_selection, FALSE);
+    gtk_single_selection_set_can_unselect(product_selection, TRUE);
+    GtkWidget *products_view = gtk_column_view_new(GTK_SELECTION_MODEL(product_selection));
+
+    for (guint i = 0; i < G_N_ELEMENTS(product_columns); i++) {
+        gpointer field = GINT_TO_POINTER(product_columns[i].field);
+        GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+        g_signal_connect(factory, "setup", G_CALLBACK(table_cell_setup), NULL);
+        g_signal_connect(factory, "bind", G_CALLBACK(product_cell_bind), field);
+
+        GtkColumnViewColumn *col = gtk_column_view_column_new(product_columns[i].title, factory);
+        GtkSorter *sorter = GTK_SORTER(gtk_custom_sorter_new(compare_product_items, field, NULL));
+        gtk_column_view_column_set_sorter(col, sorter);
+        g_object_unref(sorter);
+        g_object_set_data(G_OBJECT(col), "product-field", field);
+        gtk_column_view_column_set_resizable(col, TRUE);
+        gtk_column_view_append_column(GTK_COLUMN_VIEW(products_view), col);
+        g_object_unref(col);
+    }
+    products_sorter = gtk_column_view_get_sorter(GTK_COLUMN_VIEW(products_view));
+    g_signal_connect(products_sorter, "changed", G_CALLBACK(on_products_sort_changed), NULL);
 
     GtkWidget *scroll_products = gtk_scrolled_window_new();
-    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scroll_products),
-                                  GTK_WIDGET(products_view));
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scroll_products), products_view);
+    gtk_widget_set_vexpand(scroll_products, TRUE);
     gtk_box_append(GTK_BOX(products_box), scroll_products);
     gtk_paned_set_start_child(GTK_PANED(paned), products_box);
 
-    /* History table */
-    history_store = gtk_list_store_new(H_N_COLS,
-                                       G_TYPE_STRING,
-                                       G_TYPE_STRING,
-                                       G_TYPE_STRING,
-                                       G_TYPE_INT,
-                                       G_TYPE_DOUBLE,
-                                       G_TYPE_STRING);
-
-    history_view = GTK_TREE_VIEW(gtk_tree_view_new_with_model(
-                                     GTK_TREE_MODEL(history_store)));
-
-    renderer = gtk_cell_renderer_text_new();
-    col = gtk_tree_view_column_new_with_attributes("Time", renderer, "text", H_COL_TIME, NULL);
-    gtk_tree_view_append_column(history_view, col);
-
-    renderer = gtk_cell_renderer_text_new();
-    col = gtk_tree_view_column_new_with_attributes("Op", renderer, "text", H_COL_OP, NULL);
-    gtk_tree_view_append_column(history_view, col);
-
-    renderer = gtk_cell_renderer_text_new();
-    col = gtk_tree_view_column_new_with_attributes("Product ID", renderer, "text", H_COL_PID, NULL);
-    gtk_tree_view_append_column(history_view, col);
-
-    renderer = gtk_cell_renderer_text_new();
-    col = gtk_tree_view_column_new_with_attributes("Qty", renderer, "text", H_COL_QTY, NULL);
-    gtk_tree_view_append_column(history_view, col);
-
-    renderer = gtk_cell_renderer_text_new();
-    col = gtk_tree_view_column_new_with_attributes("Value", renderer, "text", H_COL_VAL, NULL);
-    gtk_tree_view_append_column(history_view, col);
-
-    renderer = gtk_cell_renderer_text_new();
-    col = gtk_tree_view_column_new_with_attributes("Description", renderer, "text", H_COL_DESC, NULL);
-    gtk_tree_view_append_column(history_view, col);
+    /* History table - a GtkColumnView over the history array, like the products */
+    history_model = stock_history_model_new();
+    GtkNoSelection *history_selection = gtk_no_selection_new(G_LIST_MODEL(history_model));
+    GtkWidget *history_view = gtk_column_view_new(GTK_SELECTION_MODEL(history_selection));
+
+    for (guint i = 0; i < G_N_ELEMENTS(history_columns); i++) {
+        GtkListItemFactory *factory = gtk_signal_list_item_factory_new();
+        g_signal_connect(factory, "setup", G_CALLBACK(table_cell_setup), NULL);
+        g_signal_connect(factory, "bind", G_CALLBACK(history_cell_bind),
+                         GINT_TO_POINTER(history_columns[i].field));
+        GtkColumnViewColumn *col = gtk_column_view_column_new(history_columns[i].title, factory);
+        gtk_column_view_column_set_resizable(col, TRUE);
+        if (history_columns[i].field == HISTORY_FIELD_DESCRIPTION) {
+            gtk_column_view_column_set_expand(col, TRUE);
+        }
+        gtk_column_view_append_column(GTK_COLUMN_VIEW(history_view), col);
+        g_object_unref(col);
+    }
 
     GtkWidget *history_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
     GtkWidget *history_label = gtk_label_new("Stock History");
@@ -324,14 +486,20 @@ GtkWidget *ui_create_main_window(GtkApplication *app) {
     gtk_box_append(GTK_BOX(history_box), history_label);
 
     GtkWidget *scroll_history = gtk_scrolled_window_new();
-    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scroll_history),
-                                  GTK_WIDGET(history_view));
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scroll_history), history_view);
+    gtk_widget_set_vexpand(scroll_history, TRUE);
+    /* Follow the newest entries, unless the user scrolls up to look at old ones */
+    GtkAdjustment *history_scroll =
+        gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(scroll_history));
+    g_signal_connect(history_scroll, "value-changed", G_CALLBACK(on_history_scrolled), NULL);
+    g_signal_connect(history_scroll, "changed", G_CALLBACK(on_history_resized), NULL);
     gtk_box_append(GTK_BOX(history_box), scroll_history);
     gtk_paned_set_end_child(GTK_PANED(paned), history_box);
 
     ui_refresh_products_table();
     ui_refresh_history_view();
 
+    TRACE_END("build_main_window");
     return window;
 }
 
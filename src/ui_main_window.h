@@ -10,6 +10,10 @@ void ui_refresh_history_view(void);
 
 char *ui_get_selected_product_id(void);
 
+/* Startup loading - the window shows up right away and fills in as data arrives */
+void ui_show_loading(const char *message);  /* NULL hides the loading indicator */
+void ui_set_actions_enabled(gboolean read_actions, gboolean write_actions);
+
 #endif /* UI_MAIN_WINDOW_H */
 
 
@@ -0,0 +1,322 @@
+#include "ui_product_model.h"
+#include "search.h"
+#include "metrics.h"
+#include <string.h>
+
+/* These are the global arrays from main.c */
+extern GPtrArray *products;
+
+/* More queued changes than this and a flush just redoes the whole list */
+#define MAX_PENDING_CHANGES 1024
+
+/* ---- The row item ---- */
+
+struct _StockProductItem {
+    GObject parent_instance;
+    Product *product;  /* Not owned - the products array owns it */
+};
+
+G_DEFINE_TYPE(StockProductItem, stock_product_item, G_TYPE_OBJECT)
+
+static void stock_product_item_class_init(StockProductItemClass *klass) {
+}
+
+static void stock_product_item_init(StockProductItem *self) {
+}
+
+Product *stock_product_item_get_product(StockProductItem *item) {
+    return item->product;
+}
+
+/* ---- The list model ---- */
+
+struct _StockProductModel {
+    GObject parent_instance;
+    guint n_items;            /* How many rows GTK was last told about */
+    ProductField sort_field;
+    gboolean descending;
+    char *filter;             /* Search text (NULL = show all) */
+    GSequence *rows;          /* Sorted or filtered: Product pointers in row order (else NULL) */
+    GHashTable *row_of;       /* Sorted or filtered: Product -> its GSequenceIter in rows */
+    GHashTable *items;        /* Product -> the StockProductItem GTK holds for it right now */
+    GHashTable *dirty;        /* Queued changes: row numbers (row = slot) or Products (rows) */
+    gboolean dirty_all;       /* Too many changes queued - redo everything */
+};
+
+static void stock_product_model_list_init(GListModelInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(StockProductModel, stock_product_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_LIST_MODEL, stock_product_model_list_init))
+
+/* A product is still in the list if its slot still points back at it */
+/* (a removed product's memory can already be a different, new product) */
+static gboolean product_is_live(const Product *p) {
+    return p->slot < products->len && g_ptr_array_index(products, p->slot) == p;
+}
+
+/* Does this product get a row? */
+static gboolean product_is_shown(StockProductModel *self, const Product *p) {
+    return product_is_live(p) && (!self->filter || search_matches(p, self->filter));
+}
+
+static GType stock_product_model_get_item_type(GListModel *list) {
+    return STOCK_TYPE_PRODUCT_ITEM;
+}
+
+static guint stock_product_model_get_n_items(GListModel *list) {
+    return STOCK_PRODUCT_MODEL(list)->n_items;
+}
+
+/* The item is gone (GTK let go of it) - forget it, unless a newer one took its place */
+static void item_finalized(gpointer data, GObject *where_the_object_was) {
+    StockProductModel *self = data;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, self->items);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        if (value == (gpointer)where_the_object_was) {
+            g_hash_table_iter_remove(&iter);
+            break;
+        }
+    }
+}
+
+/* GTK calls this only for the rows it is about to show */
+/* The same product always gives the same item while GTK holds it, so the */
+/* selection stays put when a row only changed */
+static gpointer stock_product_model_get_item(GListModel *list, guint position) {
+    StockProductModel *self = STOCK_PRODUCT_MODEL(list);
+    if (position >= self->n_items) return NULL;
+
+    Product *p;
+    if (self->rows) {
+        p = g_sequence_get(g_sequence_get_iter_at_pos(self->rows, (gint)position));
+    } else {
+        if (position >= products->len) return NULL;  /* Changed and not flushed yet */
+        p = g_ptr_array_index(products, position);
+    }
+
+    StockProductItem *item = g_hash_table_lookup(self->items, p);
+    if (item) return g_object_ref(item);
+    item = g_object_new(STOCK_TYPE_PRODUCT_ITEM, NULL);
+    item->product = p;
+    g_hash_table_insert(self->items, p, item);
+    g_object_weak_ref(G_OBJECT(item), item_finalized, self);
+    return item;
+}
+
+static void stock_product_model_list_init(GListModelInterface *iface) {
+    iface->get_item_type = stock_product_model_get_item_type;
+    iface->get_n_items = stock_product_model_get_n_items;
+    iface->get_item = stock_product_model_get_item;
+}
+
+static void stock_product_model_finalize(GObject *object) {
+    StockProductModel *self = STOCK_PRODUCT_MODEL(object);
+    /* Items can outlive the model - stop them from calling back into it */
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, self->items);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        g_object_weak_unref(G_OBJECT(value), item_finalized, self);
+    }
+    g_hash_table_destroy(self->items);
+    g_hash_table_destroy(self->dirty);
+    if (self->rows) {
+        g_sequence_free(self->rows);
+        g_hash_table_destroy(self->row_of);
+    }
+    g_free(self->filter);
+    G_OBJECT_CLASS(stock_product_model_parent_class)->finalize(object);
+}
+
+static void stock_product_model_class_init(StockProductModelClass *klass) {
+    G_OBJECT_CLASS(klass)->finalize = stock_product_model_finalize;
+}
+
+static void stock_product_model_init(StockProductModel *self) {
+    self->sort_field = PRODUCT_FIELD_NONE;
+    self->items = g_hash_table_new(g_direct_hash, g_direct_equal);
+    self->dirty = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+StockProductModel *stock_product_model_new(void) {
+    return g_object_new(STOCK_TYPE_PRODUCT_MODEL, NULL);
+}
+
+/* Compare two numbers without overflowing */
+#define COMPARE_NUMBERS(a, b) ((a) < (b) ? -1 : (a) > (b) ? 1 : 0)
+
+/* This function compares two products by one field, then by ID */
+int stock_product_compare(const Product *a, const Product *b, ProductField field) {
+    int r = 0;
+    switch (field) {
+    case PRODUCT_FIELD_NAME:     r = strcmp(a->name, b->name); break;
+    case PRODUCT_FIELD_CATEGORY: r = strcmp(a->category, b->category); break;
+    case PRODUCT_FIELD_QUANTITY: r = COMPARE_NUMBERS(a->quantity, b->quantity); break;
+    case PRODUCT_FIELD_PRICE:    r = COMPARE_NUMBERS(a->price, b->price); break;
+    case PRODUCT_FIELD_SOLD:     r = COMPARE_NUMBERS(a->sold, b->sold); break;
+    default: break;
+    }
+    if (r != 0) return r;
+    return strcmp(a->id, b->id);
+}
+
+static gint compare_rows(gconstpointer a, gconstpointer b, gpointer user_data) {
+    StockProductModel *self = user_data;
+    int r = stock_product_compare(a, b, self->sort_field);
+    return self->descending ? -r : r;
+}
+
+/* Rebuild the rows from scratch - only needed when sorted or filtered, */
+/* otherwise row = slot. Filtered but not sorted, rows go by ID */
+static void rebuild_rows(StockProductModel *self) {
+    if (self->rows) {
+        g_sequence_free(self->rows);
+        g_hash_table_destroy(self->row_of);
+        self->rows = NULL;
+        self->row_of = NULL;
+    }
+    if (self->sort_field == PRODUCT_FIELD_NONE && !self->filter) return;
+
+    /* Filtered, only the matches from the search index get rows */
+    GPtrArray *shown = self->filter ? search_products(self->filter) : products;
+    self->rows = g_sequence_new(NULL);
+    self->row_of = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (guint i = 0; i < shown->len; i++) {
+        Product *p = g_ptr_array_index(shown, i);
+        g_hash_table_insert(self->row_of, p, g_sequence_append(self->rows, p));
+    }
+    if (shown != products) g_ptr_array_free(shown, TRUE);
+    /* Only pointers move around here, the products themselves aren't touched */
+    g_sequence_sort(self->rows, compare_rows, self);
+}
+
+/* This function tells GTK that all rows may have changed */
+/* No product is copied - GTK just asks again for the rows it shows */
+/* Sorting and filtering go through here too, so they show up as refreshes in the metrics */
+void stock_product_model_refresh(StockProductModel *self) {
+    METRIC_START(start);
+    guint old_n = self->n_items;
+    g_hash_table_remove_all(self->dirty);
+    self->dirty_all = FALSE;
+    rebuild_rows(self);
+    self->n_items = self->rows ? (guint)g_sequence_get_length(self->rows) : products->len;
+    g_list_model_items_changed(G_LIST_MODEL(self), 0, old_n, self->n_items);
+    METRIC_STOP(METRIC_UI_PRODUCTS_REFRESH, start, TRUE);
+}
+
+void stock_product_model_set_sort(StockProductModel *self, ProductField field,
+                                  gboolean descending) {
+    if (self->sort_field == field && self->descending == descending) return;
+    self->sort_field = field;
+    self->descending = descending;
+    stock_product_model_refresh(self);
+}
+
+void stock_product_model_set_filter(StockProductModel *self, const char *text) {
+    if (text && !text[0]) text = NULL;
+    if (g_strcmp0(self->filter, text) == 0) return;
+    g_free(self->filter);
+    self->filter = g_strdup(text);
+    stock_product_model_refresh(self);
+}
+
+/* This function remembers a change from logic.c until the next flush */
+/* Not sorted or filtered, rows are slots, so the slots are queued. Otherwise */
+/* a change can move a row anywhere (or in/out of the filter), so the */
+/* products are queued instead */
+void stock_product_model_queue_change(StockProductModel *self, StockChange change,
+                                      guint position, Product *p) {
+    if (self->dirty_all) return;
+    if (g_hash_table_size(self->dirty) >= MAX_PENDING_CHANGES) {
+        self->dirty_all = TRUE;
+        g_hash_table_remove_all(self->dirty);
+        return;
+    }
+
+    if (self->rows) {
+        g_hash_table_add(self->dirty, p);
+        if (change == STOCK_CHANGE_PRODUCT_REMOVED) {
+            g_hash_table_remove(self->items, p);  /* A new product may get this memory */
+        }
+    } else {
+        g_hash_table_add(self->dirty, GUINT_TO_POINTER(position + 1));
+        if (change == STOCK_CHANGE_PRODUCT_REMOVED) {
+            g_hash_table_remove(self->items, p);
+            /* The last product moved into position, and the old last slot is gone */
+            g_hash_table_add(self->dirty, GUINT_TO_POINTER(products->len + 1));
+        }
+    }
+}
+
+/* Not sorted or filtered: tell GTK about each changed slot, then about the length change */
+static void flush_slots(StockProductModel *self) {
+    guint old_n = self->n_items;
+    guint new_n = products->len;
+    guint same = MIN(old_n, new_n);  /* Rows below this exist before and after */
+
+    /* n_items stays old_n until the length change is signalled - a handler */
+    /* of the per-row signals must still see the length it was last told */
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, self->dirty);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        guint position = GPOINTER_TO_UINT(key) - 1;
+        if (position < same) {
+            g_list_model_items_changed(G_LIST_MODEL(self), position, 1, 1);
+        }
+    }
+    self->n_items = new_n;
+    if (old_n != new_n) {
+        g_list_model_items_changed(G_LIST_MODEL(self), same, old_n - same, new_n - same);
+    }
+}
+
+/* Sorted or filtered: take every changed product out of the rows, then put */
+/* the ones that still get a row back where they belong now. Taking them all out first matters: the rows */
+/* around a changed product must all be in order when we search for a place */
+static void flush_products(StockProductModel *self) {
+    GHashTableIter iter;
+    gpointer key;
+
+    g_hash_table_iter_init(&iter, self->dirty);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        GSequenceIter *row = g_hash_table_lookup(self->row_of, key);
+        if (!row) continue;  /* Added and queued - not in the rows yet */
+        guint position = (guint)g_sequence_iter_get_position(row);
+        g_sequence_remove(row);
+        g_hash_table_remove(self->row_of, key);
+        self->n_items--;
+        g_list_model_items_changed(G_LIST_MODEL(self), position, 1, 0);
+    }
+
+    g_hash_table_iter_init(&iter, self->dirty);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        Product *p = key;
+        if (!product_is_shown(self, p)) continue;  /* Removed, or doesn't match */
+        GSequenceIter *row = g_sequence_insert_sorted(self->rows, p, compare_rows, self);
+        g_hash_table_insert(self->row_of, p, row);
+        self->n_items++;
+        g_list_model_items_changed(G_LIST_MODEL(self),
+                                   (guint)g_sequence_iter_get_position(row), 0, 1);
+    }
+}
+
+/* This function applies the queued changes - the main window calls it once per frame */
+void stock_product_model_flush(StockProductModel *self) {
+    if (self->dirty_all) {
+        stock_product_model_refresh(self);
+        return;
+    }
+    if (g_hash_table_size(self->dirty) == 0) return;
+
+    METRIC_START(start);
+    if (self->rows) {
+        flush_products(self);
+    } else {
+        flush_slots(self);
+    }
+    g_hash_table_remove_all(self->dirty);
+    METRIC_STOP(METRIC_UI_PRODUCTS_FLUSH, start, TRUE);
+}
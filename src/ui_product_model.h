@@ -0,0 +1,59 @@
+#ifndef UI_PRODUCT_MODEL_H
+#define UI_PRODUCT_MODEL_H
+
+#include <gtk/gtk.h>
+#include "model.h"
+#include "logic.h"
+
+/* This file lets the products table read the products array directly */
+/* GtkListStore needed a copy of every product; this model copies nothing. */
+/* It just says "there are N products" and makes a tiny item object for a */
+/* row only when GTK asks for it - and GtkColumnView only asks for the rows */
+/* that are on screen. Sorting and the search filter are done here too, in */
+/* a GSequence of rows. */
+/* Changes from logic.c are queued and applied together once per frame. */
+
+/* The columns of the products table, also used as sort keys */
+typedef enum {
+    PRODUCT_FIELD_ID,
+    PRODUCT_FIELD_NAME,
+    PRODUCT_FIELD_CATEGORY,
+    PRODUCT_FIELD_QUANTITY,
+    PRODUCT_FIELD_PRICE,
+    PRODUCT_FIELD_SOLD,
+    PRODUCT_FIELD_NONE  /* Not sorted - same order as the products array */
+} ProductField;
+
+/* One row: just a pointer to the Product, made when GTK asks for the row */
+#define STOCK_TYPE_PRODUCT_ITEM (stock_product_item_get_type())
+G_DECLARE_FINAL_TYPE(StockProductItem, stock_product_item, STOCK, PRODUCT_ITEM, GObject)
+
+Product *stock_product_item_get_product(StockProductItem *item);
+
+/* The list of rows (a GListModel over the global products array) */
+#define STOCK_TYPE_PRODUCT_MODEL (stock_product_model_get_type())
+G_DECLARE_FINAL_TYPE(StockProductModel, stock_product_model, STOCK, PRODUCT_MODEL, GObject)
+
+StockProductModel *stock_product_model_new(void);
+
+/* Redo the whole list (after loading, or when lots changed at once) */
+void stock_product_model_refresh(StockProductModel *self);
+
+/* Queue one change from logic.c (see StockChange), and apply all queued */
+/* changes - only the rows that changed are sent to GTK */
+void stock_product_model_queue_change(StockProductModel *self, StockChange change,
+                                      guint position, Product *p);
+void stock_product_model_flush(StockProductModel *self);
+
+/* Sort the rows by field (PRODUCT_FIELD_NONE = array order) */
+void stock_product_model_set_sort(StockProductModel *self, ProductField field,
+                                  gboolean descending);
+
+/* Only show products matching text (see search.h) - NULL or "" shows all */
+/* The rows come from the search index, not from checking every product */
+void stock_product_model_set_filter(StockProductModel *self, const char *text);
+
+/* Compare two products by one field (ties go by ID) */
+int stock_product_compare(const Product *a, const Product *b, ProductField field);
+
+#endif /* UI_PRODUCT_MODEL_H */